@@ -0,0 +1,173 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <pcl/point_cloud.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace ofxPCL
+{
+
+//
+// cloud pool
+//
+// recycles point clouds per point type. a cloud handed out by acquire()
+// goes back to the pool when its last Ptr is released, emptied but with its
+// point buffer still allocated, so the next frame's clouds of about the
+// same size don't allocate. New<T>() draws from here.
+//
+template <typename P>
+class CloudPool
+{
+public:
+
+	typedef pcl::PointCloud<P> Cloud;
+	typedef typename Cloud::Ptr Ptr;
+
+	static CloudPool& instance()
+	{
+		static CloudPool pool;
+		return pool;
+	}
+
+	Ptr acquire(size_t capacity = 0)
+	{
+		Cloud *cloud = NULL;
+
+		{
+			ofMutex::ScopedLock lock(storage->mutex);
+
+			if (!storage->free.empty())
+			{
+				cloud = storage->free.back();
+				storage->free.pop_back();
+				storage->num_reused++;
+			}
+			else
+			{
+				storage->num_allocated++;
+			}
+		}
+
+		if (!cloud) cloud = new Cloud;
+		if (capacity > 0) cloud->points.reserve(capacity);
+
+		return Ptr(cloud, Return(storage));
+	}
+
+	// clouds beyond this are deleted instead of kept
+	void setMaxCached(int n)
+	{
+		ofMutex::ScopedLock lock(storage->mutex);
+		storage->max_cached = n;
+		storage->trim();
+	}
+
+	int getMaxCached()
+	{
+		ofMutex::ScopedLock lock(storage->mutex);
+		return storage->max_cached;
+	}
+
+	int getNumCached()
+	{
+		ofMutex::ScopedLock lock(storage->mutex);
+		return storage->free.size();
+	}
+
+	// how many acquire() calls had to allocate and how many reused a cloud
+	int getNumAllocated()
+	{
+		ofMutex::ScopedLock lock(storage->mutex);
+		return storage->num_allocated;
+	}
+
+	int getNumReused()
+	{
+		ofMutex::ScopedLock lock(storage->mutex);
+		return storage->num_reused;
+	}
+
+	// frees the cached clouds, the ones in use come back later
+	void clear()
+	{
+		ofMutex::ScopedLock lock(storage->mutex);
+
+		const int max_cached = storage->max_cached;
+		storage->max_cached = 0;
+		storage->trim();
+		storage->max_cached = max_cached;
+	}
+
+protected:
+
+	struct Storage
+	{
+		ofMutex mutex;
+		vector<Cloud*> free;
+		int max_cached;
+		int num_allocated, num_reused;
+
+		Storage() : max_cached(16), num_allocated(0), num_reused(0) {}
+
+		~Storage()
+		{
+			for (int i = 0; i < free.size(); i++)
+				delete free[i];
+		}
+
+		void trim()
+		{
+			while (free.size() > max_cached)
+			{
+				delete free.back();
+				free.pop_back();
+			}
+		}
+	};
+
+	// the deleter of the handed out Ptrs. it only holds the storage weakly,
+	// so clouds released after the pool is gone (e.g. during static
+	// destruction) are simply deleted.
+	struct Return
+	{
+		boost::weak_ptr<Storage> storage;
+
+		Return(const boost::shared_ptr<Storage> &storage) : storage(storage) {}
+
+		template <typename H>
+		static void reset(H &header) { header = H(); }
+
+		void operator()(Cloud *cloud)
+		{
+			boost::shared_ptr<Storage> s = storage.lock();
+			if (!s)
+			{
+				delete cloud;
+				return;
+			}
+
+			// back to what a newly constructed cloud looks like, but keeps
+			// the capacity of the point buffer
+			cloud->clear();
+			cloud->is_dense = true;
+			reset(cloud->header);
+			cloud->sensor_origin_.setZero();
+			cloud->sensor_orientation_.setIdentity();
+
+			ofMutex::ScopedLock lock(s->mutex);
+
+			if (s->free.size() < s->max_cached)
+				s->free.push_back(cloud);
+			else
+				delete cloud;
+		}
+	};
+
+	boost::shared_ptr<Storage> storage;
+
+	CloudPool() : storage(new Storage) {}
+};
+
+}
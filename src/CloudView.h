@@ -0,0 +1,226 @@
+#pragma once
+
+#include "ofxPCL.h"
+
+namespace ofxPCL
+{
+
+//
+// cloud view
+//
+// a shared base cloud plus an optional list of the point indices in view.
+// copying a view copies two pointers, and filters that only select points
+// (threshold, outlier removal, segmentation) return a view on the same
+// base instead of rewriting the points, so branches of a processing graph
+// share one cloud. points are only copied when a view is materialized or
+// mutated.
+//
+template <typename T>
+class CloudView
+{
+public:
+
+	typedef typename T::value_type CloudType;
+	typedef typename CloudType::PointType PointType;
+	typedef pcl::IndicesConstPtr IndicesPtr;
+
+	CloudView() {}
+
+	// every point of `cloud`
+	CloudView(const T &cloud) : base(cloud) {}
+
+	CloudView(const T &cloud, const vector<int> &indices) : base(cloud), indices(new vector<int>(indices)) {}
+	CloudView(const T &cloud, const IndicesPtr &indices) : base(cloud), indices(indices) {}
+
+	const T& getBase() const { return base; }
+
+	// null for a view of every point
+	const IndicesPtr& getIndices() const { return indices; }
+	bool hasIndices() const { return indices.get() != NULL; }
+
+	size_t size() const { return indices ? indices->size() : (base ? base->points.size() : 0); }
+	bool empty() const { return size() == 0; }
+
+	// index into the base of the i-th point in view
+	int getBaseIndex(int i) const { return indices ? (*indices)[i] : i; }
+
+	const PointType& operator[](int i) const { return base->points[getBaseIndex(i)]; }
+
+	// another view on the same base, `subset` indexes this view
+	CloudView select(const vector<int> &subset) const
+	{
+		boost::shared_ptr<vector<int> > selected(new vector<int>(subset.size()));
+
+		for (int i = 0; i < subset.size(); i++)
+			(*selected)[i] = getBaseIndex(subset[i]);
+
+		return CloudView(base, IndicesPtr(selected));
+	}
+
+	// a cloud with only the points in view. a view of every point returns
+	// the base itself, don't write to it, use mutate() for that
+	T materialize() const
+	{
+		if (!indices) return base;
+
+		T cloud = New<T>();
+		pcl::copyPointCloud(*base, *indices, *cloud);
+		return cloud;
+	}
+
+	// write access to the points in view. the points are copied first if
+	// the view is a subset or the base is also held elsewhere, afterwards
+	// the view owns a full cloud of its own
+	CloudType& mutate()
+	{
+		assert(base);
+
+		if (indices)
+		{
+			base = materialize();
+			indices.reset();
+		}
+		else if (!base.unique())
+		{
+			T cloud = New<T>();
+			*cloud = *base;
+			base = cloud;
+		}
+
+		return *base;
+	}
+
+	// whether mutate() would copy
+	bool isShared() const { return indices || !base.unique(); }
+
+protected:
+
+	T base;
+	IndicesPtr indices;
+};
+
+// copies the points of a view into `dst`, like copy() for clouds
+template <typename T1, typename T2>
+inline void copy(const CloudView<T1> &view, T2 &dst)
+{
+	if (view.hasIndices())
+		pcl::copyPointCloud(*view.getBase(), *view.getIndices(), *dst);
+	else
+		pcl::copyPointCloud(*view.getBase(), *dst);
+}
+
+template <typename T>
+inline ofMesh toOF(const CloudView<T> &view)
+{
+	return toOF(view.materialize());
+}
+
+// runs an index filter on the base, restricted to the view
+template <typename T, typename F>
+inline CloudView<T> filterView(const CloudView<T> &view, F &filter)
+{
+	boost::shared_ptr<vector<int> > selected(new vector<int>);
+
+	filter.setInputCloud(view.getBase());
+	if (view.hasIndices()) filter.setIndices(view.getIndices());
+	filter.filter(*selected);
+
+	return CloudView<T>(view.getBase(), typename CloudView<T>::IndicesPtr(selected));
+}
+
+//
+// filters on views. the ones that only select points return a view on the
+// same base and copy nothing
+//
+template <typename T>
+inline CloudView<T> threshold(const CloudView<T> &view, const char *dimension = "X", float min = 0, float max = 100)
+{
+	if (view.empty()) return view;
+
+	pcl::PassThrough<typename T::value_type::PointType> pass;
+	pass.setFilterFieldName(dimension);
+	pass.setFilterLimits(min, max);
+
+	return filterView(view, pass);
+}
+
+template <typename T>
+inline CloudView<T> statisticalOutlierRemoval(const CloudView<T> &view, int nr_k = 50, double std_mul = 1.0)
+{
+	if (view.empty()) return view;
+
+	pcl::StatisticalOutlierRemoval<typename T::value_type::PointType> sor;
+	sor.setMeanK(nr_k);
+	sor.setStddevMulThresh(std_mul);
+
+	return filterView(view, sor);
+}
+
+template <typename T>
+inline CloudView<T> radiusOutlierRemoval(const CloudView<T> &view, double radius, int num_min_points)
+{
+	if (view.empty()) return view;
+
+	pcl::RadiusOutlierRemoval<typename T::value_type::PointType> outrem;
+	outrem.setRadiusSearch(radius);
+	outrem.setMinNeighborsInRadius(num_min_points);
+
+	return filterView(view, outrem);
+}
+
+// voxel centroids are new points, so this one returns a view of a new
+// cloud. only the points in view are read
+template <typename T>
+inline CloudView<T> downsample(const CloudView<T> &view, ofVec3f resolution = ofVec3f(1, 1, 1))
+{
+	if (view.empty()) return view;
+
+	T cloud = New<T>();
+
+	pcl::VoxelGrid<typename T::value_type::PointType> sor;
+	sor.setInputCloud(view.getBase());
+	if (view.hasIndices()) sor.setIndices(view.getIndices());
+	sor.setLeafSize(resolution.x, resolution.y, resolution.z);
+	sor.filter(*cloud);
+
+	return CloudView<T>(cloud);
+}
+
+// transforms in place when the view owns its points, otherwise into a new
+// cloud with only the points in view
+template <typename T>
+inline void transform(CloudView<T> &view, ofMatrix4x4 matrix)
+{
+	if (view.empty()) return;
+
+	vector<typename T::value_type*> clouds(1, &view.mutate());
+	transform(clouds, vector<PointTransform>(1, PointTransform(matrix)));
+}
+
+// the segments are views on the same base
+template <typename T>
+SegmentationResult<CloudView<T> > segmentation(const CloudView<T> &view, const SegmentationParams &params, const Deadline &deadline = Deadline())
+{
+	Poco::Timestamp timer;
+	SegmentationResult<CloudView<T> > result;
+
+	if (view.empty()) return result;
+
+	vector<int> candidates(view.size());
+	for (int i = 0; i < candidates.size(); i++)
+		candidates[i] = view.getBaseIndex(i);
+
+	// the views of the filters above keep the base order, others may not
+	if (view.hasIndices()) std::sort(candidates.begin(), candidates.end());
+
+	vector<vector<int> > segments;
+	result.truncated = segmentationIndices(view.getBase(), candidates, params, deadline, segments);
+
+	for (int i = 0; i < segments.size(); i++)
+		result.segments.push_back(CloudView<T>(view.getBase(), segments[i]));
+
+	result.elapsed_ms = timer.elapsed() * 0.001;
+	return result;
+}
+
+}
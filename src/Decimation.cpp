@@ -0,0 +1,618 @@
+#include "Decimation.h"
+
+#include "ofxPCL.h"
+
+#include <queue>
+
+namespace ofxPCL
+{
+
+//
+// quadric
+//
+struct Quadric
+{
+	// upper triangle of the symmetric 4x4 matrix
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+	Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+	Quadric(const ofVec3f &n, const ofVec3f &p, double weight)
+	{
+		const double a = n.x, b = n.y, c = n.z;
+		const double d = -(a * p.x + b * p.y + c * p.z);
+
+		a2 = weight * a * a; ab = weight * a * b; ac = weight * a * c; ad = weight * a * d;
+		b2 = weight * b * b; bc = weight * b * c; bd = weight * b * d;
+		c2 = weight * c * c; cd = weight * c * d;
+		d2 = weight * d * d;
+	}
+
+	Quadric& operator+=(const Quadric &q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		return *this;
+	}
+
+	double error(const ofVec3f &v) const
+	{
+		const double x = v.x, y = v.y, z = v.z;
+		return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+			+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+			+ c2 * z * z + 2 * cd * z
+			+ d2;
+	}
+
+	bool optimal(ofVec3f &v) const
+	{
+		Eigen::Matrix3d A;
+		A << a2, ab, ac,
+			 ab, b2, bc,
+			 ac, bc, c2;
+
+		if (fabs(A.determinant()) < 1e-12) return false;
+
+		const Eigen::Vector3d x = A.inverse() * Eigen::Vector3d(-ad, -bd, -cd);
+		v.set(x[0], x[1], x[2]);
+		return true;
+	}
+};
+
+struct Collapse
+{
+	double cost;
+	int keep, remove;
+	int keep_version, remove_version;
+	ofVec3f position;
+	float t;
+
+	bool operator<(const Collapse &o) const { return cost > o.cost; }
+};
+
+//
+// decimator
+//
+class QuadricDecimator
+{
+public:
+
+	vector<ofVec3f> positions;
+	vector<ofVec3f> normals;
+	vector<ofFloatColor> colors;
+	vector<int> triangles;
+	vector<char> locked;
+
+	int run(int target_triangles, double max_error, bool preserve_boundary)
+	{
+		const int num_vertices = positions.size();
+		const int num_triangles = triangles.size() / 3;
+
+		locked.resize(num_vertices, 0);
+		face_removed.assign(num_triangles, 0);
+		vertex_removed.assign(num_vertices, 0);
+		version.assign(num_vertices, 0);
+		quadrics.assign(num_vertices, Quadric());
+		vertex_faces.assign(num_vertices, vector<int>());
+
+		for (int f = 0; f < num_triangles; f++)
+		{
+			const int *t = &triangles[f * 3];
+
+			for (int k = 0; k < 3; k++)
+				vertex_faces[t[k]].push_back(f);
+
+			ofVec3f n = (positions[t[1]] - positions[t[0]]).getCrossed(positions[t[2]] - positions[t[0]]);
+			const float area = n.length();
+			if (area <= 0) continue;
+			n /= area;
+
+			const Quadric q(n, positions[t[0]], area * 0.5);
+			for (int k = 0; k < 3; k++)
+				quadrics[t[k]] += q;
+		}
+
+		if (preserve_boundary) addBoundaryQuadrics();
+
+		num_faces = num_triangles;
+
+		while (!heap.empty()) heap.pop();
+
+		// every edge once, boundary edges only appear in one orientation
+		vector<std::pair<int, int> > edges;
+		edges.reserve(num_triangles * 3);
+
+		for (int f = 0; f < num_triangles; f++)
+		{
+			const int *t = &triangles[f * 3];
+			for (int k = 0; k < 3; k++)
+			{
+				const int a = t[k], b = t[(k + 1) % 3];
+				edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+			}
+		}
+
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		for (int i = 0; i < edges.size(); i++)
+			push(edges[i].first, edges[i].second);
+
+		while (!heap.empty() && (target_triangles <= 0 || num_faces > target_triangles))
+		{
+			const Collapse c = heap.top();
+			heap.pop();
+
+			if (max_error > 0 && c.cost > max_error) break;
+			if (vertex_removed[c.keep] || vertex_removed[c.remove]) continue;
+			if (version[c.keep] != c.keep_version || version[c.remove] != c.remove_version) continue;
+
+			apply(c);
+		}
+
+		return num_faces;
+	}
+
+	void getTriangles(vector<int> &result) const
+	{
+		result.clear();
+		for (int f = 0; f < face_removed.size(); f++)
+		{
+			if (face_removed[f]) continue;
+			result.insert(result.end(), triangles.begin() + f * 3, triangles.begin() + f * 3 + 3);
+		}
+	}
+
+protected:
+
+	vector<Quadric> quadrics;
+	vector<vector<int> > vertex_faces;
+	vector<char> face_removed;
+	vector<char> vertex_removed;
+	vector<int> version;
+	int num_faces;
+
+	std::priority_queue<Collapse> heap;
+
+	vector<int> neighbors_a, neighbors_b;
+
+	void addBoundaryQuadrics()
+	{
+		// edges used by a single face, keyed by (min, max) vertex
+		std::map<std::pair<int, int>, int> edges;
+
+		for (int f = 0; f < triangles.size() / 3; f++)
+		{
+			const int *t = &triangles[f * 3];
+			for (int k = 0; k < 3; k++)
+			{
+				std::pair<int, int> e(std::min(t[k], t[(k + 1) % 3]), std::max(t[k], t[(k + 1) % 3]));
+				std::map<std::pair<int, int>, int>::iterator it = edges.find(e);
+				if (it == edges.end()) edges[e] = f;
+				else it->second = -1;
+			}
+		}
+
+		for (std::map<std::pair<int, int>, int>::iterator it = edges.begin(); it != edges.end(); ++it)
+		{
+			if (it->second < 0) continue;
+
+			const int *t = &triangles[it->second * 3];
+			const ofVec3f face_normal = (positions[t[1]] - positions[t[0]]).getCrossed(positions[t[2]] - positions[t[0]]);
+
+			const ofVec3f &a = positions[it->first.first];
+			const ofVec3f &b = positions[it->first.second];
+
+			// plane through the edge, perpendicular to the face
+			ofVec3f n = (b - a).getCrossed(face_normal);
+			if (n.length() <= 0) continue;
+			n.normalize();
+
+			const Quadric q(n, a, 1000 * (b - a).lengthSquared());
+			quadrics[it->first.first] += q;
+			quadrics[it->first.second] += q;
+		}
+	}
+
+	void push(int a, int b)
+	{
+		// the faces of a locked vertex aren't all known here, so neither
+		// its position nor its one ring may change
+		if (locked[a] || locked[b]) return;
+
+		Collapse c;
+		c.keep = a;
+		c.remove = b;
+		c.keep_version = version[a];
+		c.remove_version = version[b];
+
+		Quadric q = quadrics[a];
+		q += quadrics[b];
+
+		const ofVec3f &pa = positions[a];
+		const ofVec3f &pb = positions[b];
+
+		ofVec3f candidates[4] = { pa, pb, (pa + pb) * 0.5, ofVec3f() };
+		const int num_candidates = q.optimal(candidates[3]) ? 4 : 3;
+
+		c.cost = std::numeric_limits<double>::max();
+		for (int i = 0; i < num_candidates; i++)
+		{
+			const double e = q.error(candidates[i]);
+			if (e < c.cost)
+			{
+				c.cost = e;
+				c.position = candidates[i];
+			}
+		}
+
+		// where the new position falls along the edge, for attributes
+		const ofVec3f d = pb - pa;
+		const float length = d.lengthSquared();
+		c.t = length > 0 ? ofClamp((c.position - pa).dot(d) / length, 0, 1) : 0;
+
+		heap.push(c);
+	}
+
+	void gatherNeighbors(int v, vector<int> &result) const
+	{
+		result.clear();
+		const vector<int> &faces = vertex_faces[v];
+		for (int i = 0; i < faces.size(); i++)
+		{
+			if (face_removed[faces[i]]) continue;
+			const int *t = &triangles[faces[i] * 3];
+			for (int k = 0; k < 3; k++)
+				if (t[k] != v) result.push_back(t[k]);
+		}
+
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+	}
+
+	bool apply(const Collapse &c)
+	{
+		const int u = c.keep;
+		const int v = c.remove;
+
+		// link condition, the edge may only share the vertices of its own faces
+		gatherNeighbors(u, neighbors_a);
+		gatherNeighbors(v, neighbors_b);
+
+		int shared_faces = 0;
+		const vector<int> &v_faces = vertex_faces[v];
+		for (int i = 0; i < v_faces.size(); i++)
+		{
+			if (face_removed[v_faces[i]]) continue;
+			const int *t = &triangles[v_faces[i] * 3];
+			if (t[0] == u || t[1] == u || t[2] == u) shared_faces++;
+		}
+
+		vector<int> common;
+		std::set_intersection(neighbors_a.begin(), neighbors_a.end(), neighbors_b.begin(), neighbors_b.end(), std::back_inserter(common));
+		if (common.size() > shared_faces) return false;
+
+		// reject collapses that flip a face
+		for (int n = 0; n < 2; n++)
+		{
+			const int w = n == 0 ? u : v;
+			const vector<int> &faces = vertex_faces[w];
+
+			for (int i = 0; i < faces.size(); i++)
+			{
+				if (face_removed[faces[i]]) continue;
+
+				const int *t = &triangles[faces[i] * 3];
+				if ((t[0] == u || t[1] == u || t[2] == u) && (t[0] == v || t[1] == v || t[2] == v)) continue;
+
+				ofVec3f p[3], q[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = positions[t[k]];
+					q[k] = (t[k] == w) ? c.position : p[k];
+				}
+
+				const ofVec3f before = (p[1] - p[0]).getCrossed(p[2] - p[0]);
+				const ofVec3f after = (q[1] - q[0]).getCrossed(q[2] - q[0]);
+
+				// degenerate faces have no orientation to keep
+				if (before.lengthSquared() > 0 && after.dot(before) <= 0) return false;
+			}
+		}
+
+		positions[u] = c.position;
+
+		if (!normals.empty())
+			normals[u] = (normals[u] * (1 - c.t) + normals[v] * c.t).getNormalized();
+
+		if (!colors.empty())
+		{
+			ofFloatColor &a = colors[u];
+			const ofFloatColor &b = colors[v];
+			a.set(a.r + (b.r - a.r) * c.t, a.g + (b.g - a.g) * c.t, a.b + (b.b - a.b) * c.t, a.a + (b.a - a.a) * c.t);
+		}
+
+		quadrics[u] += quadrics[v];
+
+		for (int i = 0; i < v_faces.size(); i++)
+		{
+			const int f = v_faces[i];
+			if (face_removed[f]) continue;
+
+			int *t = &triangles[f * 3];
+			if (t[0] == u || t[1] == u || t[2] == u)
+			{
+				face_removed[f] = 1;
+				num_faces--;
+				continue;
+			}
+
+			for (int k = 0; k < 3; k++)
+				if (t[k] == v) t[k] = u;
+
+			vertex_faces[u].push_back(f);
+		}
+
+		vertex_removed[v] = 1;
+		vertex_faces[v].clear();
+		version[u]++;
+
+		// drop removed faces from the list that keeps growing
+		vector<int> &u_faces = vertex_faces[u];
+		int n = 0;
+		for (int i = 0; i < u_faces.size(); i++)
+			if (!face_removed[u_faces[i]]) u_faces[n++] = u_faces[i];
+		u_faces.resize(n);
+
+		gatherNeighbors(u, neighbors_a);
+		for (int i = 0; i < neighbors_a.size(); i++)
+			push(u, neighbors_a[i]);
+
+		return true;
+	}
+};
+
+//
+// partitions
+//
+class DecimatePartition
+{
+public:
+
+	DecimatePartition(const QuadricDecimator &mesh, const vector<int> &face_partition, int num_partitions, const DecimateParams &params,
+					  vector<QuadricDecimator> &results, vector<vector<int> > &global_ids)
+		: mesh(mesh), face_partition(face_partition), num_partitions(num_partitions), params(params), results(results), global_ids(global_ids)
+	{}
+
+	void operator()(int begin, int end)
+	{
+		const int num_faces = mesh.triangles.size() / 3;
+		const int num_vertices = mesh.positions.size();
+
+		for (int p = begin; p < end; p++)
+		{
+			QuadricDecimator &part = results[p];
+			vector<int> &ids = global_ids[p];
+			vector<int> local(num_vertices, -1);
+
+			// vertices used by another partition's faces are locked
+			vector<char> foreign(num_vertices, 0);
+			int part_faces = 0;
+
+			for (int f = 0; f < num_faces; f++)
+			{
+				const int *t = &mesh.triangles[f * 3];
+
+				if (face_partition[f] != p)
+				{
+					foreign[t[0]] = foreign[t[1]] = foreign[t[2]] = 1;
+					continue;
+				}
+
+				for (int k = 0; k < 3; k++)
+				{
+					if (local[t[k]] < 0)
+					{
+						local[t[k]] = ids.size();
+						ids.push_back(t[k]);
+					}
+					part.triangles.push_back(local[t[k]]);
+				}
+
+				part_faces++;
+			}
+
+			part.positions.resize(ids.size());
+			part.locked.resize(ids.size());
+			if (!mesh.normals.empty()) part.normals.resize(ids.size());
+			if (!mesh.colors.empty()) part.colors.resize(ids.size());
+
+			for (int i = 0; i < ids.size(); i++)
+			{
+				part.positions[i] = mesh.positions[ids[i]];
+				part.locked[i] = foreign[ids[i]];
+				if (!mesh.normals.empty()) part.normals[i] = mesh.normals[ids[i]];
+				if (!mesh.colors.empty()) part.colors[i] = mesh.colors[ids[i]];
+			}
+
+			const int target = params.target_triangles > 0
+				? std::max(1, (int)((long long)params.target_triangles * part_faces / num_faces))
+				: 0;
+
+			part.run(target, params.max_error, params.preserve_boundary);
+		}
+	}
+
+protected:
+
+	const QuadricDecimator &mesh;
+	const vector<int> &face_partition;
+	int num_partitions;
+	const DecimateParams &params;
+	vector<QuadricDecimator> &results;
+	vector<vector<int> > &global_ids;
+};
+
+static void decimatePartitions(QuadricDecimator &mesh, const DecimateParams &params)
+{
+	const int num_faces = mesh.triangles.size() / 3;
+	const int num_partitions = std::min(params.num_partitions, num_faces);
+
+	// equal face count slabs along the longest axis
+	ofVec3f min_pt(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	ofVec3f max_pt = -min_pt;
+	for (int i = 0; i < mesh.positions.size(); i++)
+	{
+		const ofVec3f &p = mesh.positions[i];
+		for (int k = 0; k < 3; k++)
+		{
+			min_pt[k] = std::min(min_pt[k], p[k]);
+			max_pt[k] = std::max(max_pt[k], p[k]);
+		}
+	}
+
+	const ofVec3f extent = max_pt - min_pt;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	vector<std::pair<float, int> > centroids(num_faces);
+	for (int f = 0; f < num_faces; f++)
+	{
+		const int *t = &mesh.triangles[f * 3];
+		centroids[f] = std::make_pair(mesh.positions[t[0]][axis] + mesh.positions[t[1]][axis] + mesh.positions[t[2]][axis], f);
+	}
+	std::sort(centroids.begin(), centroids.end());
+
+	vector<int> face_partition(num_faces);
+	for (int i = 0; i < num_faces; i++)
+		face_partition[centroids[i].second] = (long long)i * num_partitions / num_faces;
+
+	vector<QuadricDecimator> results(num_partitions);
+	vector<vector<int> > global_ids(num_partitions);
+
+	DecimatePartition partition(mesh, face_partition, num_partitions, params, results, global_ids);
+	parallelFor(0, num_partitions, partition);
+
+	// unlocked vertices belong to one partition only, copy them back
+	mesh.triangles.clear();
+
+	vector<int> triangles;
+	for (int p = 0; p < num_partitions; p++)
+	{
+		const QuadricDecimator &part = results[p];
+		const vector<int> &ids = global_ids[p];
+
+		for (int i = 0; i < ids.size(); i++)
+		{
+			if (part.locked[i]) continue;
+			mesh.positions[ids[i]] = part.positions[i];
+			if (!mesh.normals.empty()) mesh.normals[ids[i]] = part.normals[i];
+			if (!mesh.colors.empty()) mesh.colors[ids[i]] = part.colors[i];
+		}
+
+		part.getTriangles(triangles);
+		for (int i = 0; i < triangles.size(); i++)
+			mesh.triangles.push_back(ids[triangles[i]]);
+	}
+}
+
+//
+// entry points
+//
+static void weld(const ofMesh &input, QuadricDecimator &mesh)
+{
+	const vector<ofVec3f> &vertices = input.getVertices();
+	const bool has_normals = input.getNumNormals() == vertices.size();
+	const bool has_colors = input.getNumColors() == vertices.size();
+
+	vector<int> remap(vertices.size());
+
+	// merge vertices at the same position, triangle soups and the zero
+	// area slivers marching cubes leaves at exact crossings
+	std::map<std::pair<float, std::pair<float, float> >, int> unique;
+
+	for (int i = 0; i < vertices.size(); i++)
+	{
+		const ofVec3f &v = vertices[i];
+		std::pair<std::map<std::pair<float, std::pair<float, float> >, int>::iterator, bool> r
+			= unique.insert(std::make_pair(std::make_pair(v.x, std::make_pair(v.y, v.z)), (int)mesh.positions.size()));
+
+		remap[i] = r.first->second;
+
+		if (r.second)
+		{
+			mesh.positions.push_back(v);
+			if (has_normals) mesh.normals.push_back(input.getNormals()[i]);
+			if (has_colors) mesh.colors.push_back(input.getColors()[i]);
+		}
+	}
+
+	const int num_indices = input.getNumIndices() > 0 ? input.getNumIndices() : vertices.size();
+	mesh.triangles.reserve(num_indices);
+
+	for (int i = 0; i + 2 < num_indices; i += 3)
+	{
+		int t[3];
+		for (int k = 0; k < 3; k++)
+			t[k] = remap[input.getNumIndices() > 0 ? input.getIndices()[i + k] : i + k];
+
+		if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) continue;
+
+		mesh.triangles.insert(mesh.triangles.end(), t, t + 3);
+	}
+}
+
+void decimate(const ofMesh &input, ofMesh &output, const DecimateParams &params)
+{
+	QuadricDecimator mesh;
+	weld(input, mesh);
+
+	if (params.num_partitions > 1)
+		decimatePartitions(mesh, params);
+
+	// whole mesh pass, cleans up the locked seams between partitions
+	vector<int> triangles;
+	mesh.run(params.target_triangles, params.max_error, params.preserve_boundary);
+	mesh.getTriangles(triangles);
+
+	// compact to the referenced vertices
+	vector<int> remap(mesh.positions.size(), -1);
+
+	output.clear();
+	output.setMode(OF_PRIMITIVE_TRIANGLES);
+
+	vector<ofIndexType> &indices = output.getIndices();
+	indices.resize(triangles.size());
+
+	for (int i = 0; i < triangles.size(); i++)
+	{
+		int &index = remap[triangles[i]];
+		if (index < 0)
+		{
+			index = output.getNumVertices();
+			output.addVertex(mesh.positions[triangles[i]]);
+			if (!mesh.normals.empty()) output.addNormal(mesh.normals[triangles[i]]);
+			if (!mesh.colors.empty()) output.addColor(mesh.colors[triangles[i]]);
+		}
+		indices[i] = index;
+	}
+}
+
+void decimate(const pcl::PolygonMesh &input, ofMesh &output, const DecimateParams &params)
+{
+	ofMesh mesh;
+	convert(input, mesh);
+	decimate(mesh, output, params);
+}
+
+ofMesh decimate(const ofMesh &input, int target_triangles)
+{
+	ofMesh mesh;
+	decimate(input, mesh, DecimateParams(target_triangles));
+	return mesh;
+}
+
+}
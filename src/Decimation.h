@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <pcl/PolygonMesh.h>
+
+namespace ofxPCL
+{
+
+//
+// decimation
+//
+// quadric error metric edge collapse (garland & heckbert). colors and
+// normals are interpolated along the collapsed edges. with num_partitions
+// > 1 the mesh is cut into slabs that are decimated in parallel with their
+// shared vertices locked, then the seams are cleaned up in a last pass.
+//
+struct DecimateParams
+{
+	// stop when the mesh has this many triangles, 0 to only use max_error
+	int target_triangles;
+
+	// stop when the cheapest collapse costs more than this, 0 for no limit
+	float max_error;
+
+	// keep open borders in place
+	bool preserve_boundary;
+
+	int num_partitions;
+
+	DecimateParams(int target_triangles = 0)
+		: target_triangles(target_triangles)
+		, max_error(0)
+		, preserve_boundary(true)
+		, num_partitions(1)
+	{}
+};
+
+// vertices at the same position are welded first, so triangle soups
+// without indices work too
+void decimate(const ofMesh &input, ofMesh &output, const DecimateParams &params);
+void decimate(const pcl::PolygonMesh &input, ofMesh &output, const DecimateParams &params);
+
+ofMesh decimate(const ofMesh &input, int target_triangles);
+
+}
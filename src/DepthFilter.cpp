@@ -0,0 +1,388 @@
+#include "DepthFilter.h"
+
+#include "Parallel.h"
+
+#include <Eigen/Core>
+
+namespace ofxPCL
+{
+
+typedef Eigen::Array<float, Eigen::Dynamic, 1> FloatRow;
+typedef Eigen::Array<bool, Eigen::Dynamic, 1> MaskRow;
+typedef Eigen::Map<Eigen::Array<float, Eigen::Dynamic, 1> > FloatRowMap;
+typedef Eigen::Map<Eigen::Array<unsigned short, Eigen::Dynamic, 1> > DepthRowMap;
+typedef Eigen::Map<const Eigen::Array<unsigned short, Eigen::Dynamic, 1> > ConstDepthRowMap;
+typedef Eigen::Map<Eigen::Array<unsigned char, Eigen::Dynamic, 1> > MaskRowMap;
+
+// rows per parallel range
+static const int ROW_GRAIN = 8;
+
+// the background of a pixel is known from here on, with some slack for
+// the summed up foreground learning rates
+static const float KNOWN = 0.999f;
+
+//
+// temporal filter
+//
+TemporalDepthFilter::TemporalDepthFilter()
+	: mode(EXPONENTIAL)
+	, alpha(0.3)
+	, median_frames(5)
+	, hole_frames(5)
+	, reset_threshold(100)
+	, width(0)
+	, height(0)
+	, history_index(0)
+{
+}
+
+void TemporalDepthFilter::reset()
+{
+	width = height = 0;
+	state.clear();
+	age.clear();
+	history.clear();
+	history_index = 0;
+}
+
+void TemporalDepthFilter::allocate(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	const int n = width * height;
+
+	state.assign(mode == EXPONENTIAL ? n : 0, 0);
+	age.assign(mode == EXPONENTIAL ? n : 0, 0);
+	history.assign(mode == MEDIAN ? n * median_frames : 0, 0);
+	history_index = 0;
+}
+
+class ExponentialRows
+{
+public:
+
+	ExponentialRows(const ofShortPixels &depth, ofShortPixels &filtered, float *state, float *age,
+					float alpha, float hole_frames, float reset_threshold)
+		: depth(depth), filtered(filtered), state(state), age(age)
+		, alpha(alpha), hole_frames(hole_frames), reset_threshold(reset_threshold) {}
+
+	void operator()(int begin, int end)
+	{
+		const int width = depth.getWidth();
+
+		for (int y = begin; y < end; y++)
+		{
+			const int offset = y * width;
+
+			const FloatRow d = ConstDepthRowMap(depth.getPixels() + offset, width).cast<float>();
+			FloatRowMap s(state + offset, width);
+			FloatRowMap a(age + offset, width);
+
+			const MaskRow valid = d > 0;
+			const MaskRow jump = (s == 0) || ((d - s).abs() > reset_threshold);
+
+			s = valid.select(jump.select(d, s + alpha * (d - s)), s);
+			a = valid.select(FloatRow::Zero(width), a + 1);
+
+			// holes older than hole_frames are let through
+			s = (a > hole_frames).select(FloatRow::Zero(width), s);
+
+			DepthRowMap(filtered.getPixels() + offset, width) = (s + 0.5f).cast<unsigned short>();
+		}
+	}
+
+protected:
+
+	const ofShortPixels &depth;
+	ofShortPixels &filtered;
+	float *state, *age;
+	float alpha, hole_frames, reset_threshold;
+};
+
+class MedianRows
+{
+public:
+
+	MedianRows(const ofShortPixels &depth, ofShortPixels &filtered, const vector<unsigned short> &history, int num_frames)
+		: depth(depth), filtered(filtered), history(history), num_frames(num_frames) {}
+
+	void operator()(int begin, int end)
+	{
+		const int width = depth.getWidth();
+		const int frame_size = width * depth.getHeight();
+
+		unsigned short samples[16];
+
+		for (int y = begin; y < end; y++)
+		{
+			unsigned short *out = filtered.getPixels() + y * width;
+
+			for (int x = 0; x < width; x++)
+			{
+				const int i = y * width + x;
+
+				// the valid samples, insertion sorted
+				int n = 0;
+				for (int f = 0; f < num_frames; f++)
+				{
+					const unsigned short v = history[f * frame_size + i];
+					if (v == 0) continue;
+
+					int k = n++;
+					while (k > 0 && samples[k - 1] > v)
+					{
+						samples[k] = samples[k - 1];
+						k--;
+					}
+					samples[k] = v;
+				}
+
+				out[x] = n ? samples[n / 2] : 0;
+			}
+		}
+	}
+
+protected:
+
+	const ofShortPixels &depth;
+	ofShortPixels &filtered;
+	const vector<unsigned short> &history;
+	int num_frames;
+};
+
+void TemporalDepthFilter::update(const ofShortPixels &depth, ofShortPixels &filtered)
+{
+	if (!depth.isAllocated()) return;
+
+	const int w = depth.getWidth();
+	const int h = depth.getHeight();
+
+	if (w != width || h != height || (mode == EXPONENTIAL ? state.empty() : history.empty()))
+		allocate(w, h);
+
+	if (filtered.getWidth() != w || filtered.getHeight() != h || !filtered.isAllocated())
+		filtered.allocate(w, h, 1);
+
+	if (mode == EXPONENTIAL)
+	{
+		ExponentialRows body(depth, filtered, &state[0], &age[0], alpha, hole_frames, reset_threshold);
+		parallelFor(0, h, body, ROW_GRAIN);
+	}
+	else
+	{
+		// the sample buffer of MedianRows holds 16
+		const int num_frames = std::min(median_frames, 16);
+
+		memcpy(&history[history_index * w * h], depth.getPixels(), sizeof(unsigned short) * w * h);
+		history_index = (history_index + 1) % num_frames;
+
+		// frames not seen yet are zero and count as holes
+		MedianRows body(depth, filtered, history, num_frames);
+		parallelFor(0, h, body, ROW_GRAIN);
+	}
+}
+
+//
+// background
+//
+DepthBackground::DepthBackground()
+	: learning_rate(0.01)
+	, foreground_learning_rate(0)
+	, sigma(3)
+	, min_distance(30)
+	, width(0)
+	, height(0)
+{
+}
+
+void DepthBackground::reset()
+{
+	width = height = 0;
+	mean.clear();
+	variance.clear();
+	known.clear();
+}
+
+void DepthBackground::allocate(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	const int n = width * height;
+	mean.assign(n, 0);
+	variance.assign(n, 0);
+	known.assign(n, 0);
+}
+
+class BackgroundRows
+{
+public:
+
+	BackgroundRows(const ofShortPixels &depth, ofPixels *mask, float *mean, float *variance, float *known,
+				   float learning_rate, float foreground_learning_rate, float sigma, float min_distance,
+				   bool classify, bool adapt)
+		: depth(depth), mask(mask), mean(mean), variance(variance), known(known)
+		, learning_rate(learning_rate), foreground_learning_rate(foreground_learning_rate)
+		, sigma(sigma), min_distance(min_distance), classify(classify), adapt(adapt) {}
+
+	void operator()(int begin, int end)
+	{
+		const int width = depth.getWidth();
+
+		// the spread a pixel starts with, in millimeters
+		const float initial_variance = min_distance * min_distance;
+
+		for (int y = begin; y < end; y++)
+		{
+			const int offset = y * width;
+
+			const FloatRow d = ConstDepthRowMap(depth.getPixels() + offset, width).cast<float>();
+			FloatRowMap m(mean + offset, width);
+			FloatRowMap v(variance + offset, width);
+			FloatRowMap k(known + offset, width);
+
+			const MaskRow valid = d > 0;
+			const MaskRow is_known = k >= KNOWN;
+			const FloatRow diff = d - m;
+			const FloatRow limit = (v.sqrt() * sigma).max(FloatRow::Constant(width, min_distance));
+
+			MaskRow foreground = MaskRow::Constant(width, false);
+
+			if (classify)
+			{
+				foreground = valid && ((is_known == false) || (diff < -limit));
+
+				if (mask)
+				{
+					MaskRowMap(mask->getPixels() + offset, width) = foreground.select(
+						Eigen::Array<unsigned char, Eigen::Dynamic, 1>::Constant(width, 255),
+						Eigen::Array<unsigned char, Eigen::Dynamic, 1>::Zero(width));
+				}
+			}
+
+			if (!adapt) continue;
+
+			// a pixel without a background starts over from the depth it has
+			// whenever that moves beyond the limit. learn() takes it as
+			// background right away, update() only once it stayed put for
+			// about 1 / foreground_learning_rate frames
+			const MaskRow unknown = valid && (is_known == false);
+			const MaskRow restart = classify ? MaskRow(unknown && ((m == 0) || (diff.abs() > limit))) : unknown;
+
+			const FloatRow rate = foreground.select(FloatRow::Constant(width, foreground_learning_rate), FloatRow::Constant(width, learning_rate));
+			const FloatRow r = valid.select(rate, FloatRow::Zero(width));
+
+			v = restart.select(FloatRow::Constant(width, initial_variance), (1 - r) * (v + r * diff.square()));
+			m = restart.select(d, m + r * diff);
+
+			if (classify)
+				k = unknown.select(restart.select(FloatRow::Zero(width), (k + foreground_learning_rate).min(FloatRow::Ones(width))), k);
+			else
+				k = unknown.select(FloatRow::Ones(width), k);
+		}
+	}
+
+protected:
+
+	const ofShortPixels &depth;
+	ofPixels *mask;
+	float *mean, *variance, *known;
+	float learning_rate, foreground_learning_rate;
+	float sigma, min_distance;
+	bool classify, adapt;
+};
+
+void DepthBackground::process(const ofShortPixels &depth, ofPixels *mask, bool classify, bool adapt)
+{
+	const int w = depth.getWidth();
+	const int h = depth.getHeight();
+
+	if (mask && (mask->getWidth() != w || mask->getHeight() != h || mask->getNumChannels() != 1 || !mask->isAllocated()))
+		mask->allocate(w, h, 1);
+
+	BackgroundRows body(depth, mask, &mean[0], &variance[0], &known[0],
+						learning_rate, foreground_learning_rate, sigma, min_distance, classify, adapt);
+	parallelFor(0, h, body, ROW_GRAIN);
+}
+
+void DepthBackground::learn(const ofShortPixels &depth)
+{
+	if (!depth.isAllocated()) return;
+
+	if (depth.getWidth() != width || depth.getHeight() != height)
+		allocate(depth.getWidth(), depth.getHeight());
+
+	process(depth, NULL, false, true);
+}
+
+void DepthBackground::update(const ofShortPixels &depth, ofPixels &mask)
+{
+	if (!depth.isAllocated()) return;
+
+	if (depth.getWidth() != width || depth.getHeight() != height)
+		allocate(depth.getWidth(), depth.getHeight());
+
+	process(depth, &mask, true, true);
+}
+
+void DepthBackground::getMask(const ofShortPixels &depth, ofPixels &mask) const
+{
+	if (!depth.isAllocated() || depth.getWidth() != width || depth.getHeight() != height) return;
+
+	// classification only reads the model
+	const_cast<DepthBackground*>(this)->process(depth, &mask, true, false);
+}
+
+void DepthBackground::getBackground(ofShortPixels &background) const
+{
+	if (mean.empty()) return;
+
+	background.allocate(width, height, 1);
+
+	const int n = width * height;
+	Eigen::Map<const FloatRow> m(&mean[0], n);
+	Eigen::Map<const FloatRow> k(&known[0], n);
+
+	DepthRowMap(background.getPixels(), n) = ((k >= KNOWN).select(m, FloatRow::Zero(n)) + 0.5f).cast<unsigned short>();
+}
+
+//
+// mask
+//
+class MaskRows
+{
+public:
+
+	MaskRows(const ofPixels &mask, ofShortPixels &depth) : mask(mask), depth(depth) {}
+
+	void operator()(int begin, int end)
+	{
+		const int width = depth.getWidth();
+
+		for (int y = begin; y < end; y++)
+		{
+			const unsigned char *m = mask.getPixels() + y * width;
+			unsigned short *d = depth.getPixels() + y * width;
+
+			for (int x = 0; x < width; x++)
+				d[x] = m[x] ? d[x] : 0;
+		}
+	}
+
+protected:
+
+	const ofPixels &mask;
+	ofShortPixels &depth;
+};
+
+void applyMask(const ofPixels &mask, ofShortPixels &depth)
+{
+	assert(mask.getWidth() == depth.getWidth() && mask.getHeight() == depth.getHeight());
+	assert(mask.getNumChannels() == 1);
+
+	MaskRows body(mask, depth);
+	parallelFor(0, depth.getHeight(), body, ROW_GRAIN);
+}
+
+}
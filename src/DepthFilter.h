@@ -0,0 +1,142 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxPCL
+{
+
+//
+// depth frame filters
+//
+// per pixel filters on the raw depth frames in millimeters, before they
+// become points. both keep their state in flat float arrays and run row by
+// row on the thread pool, every row as eigen array expressions that
+// compile to sse / neon.
+//
+
+// temporal smoothing against the flicker of structured light and time of
+// flight sensors. a pixel that drops out keeps its last value for a few
+// frames, and a jump larger than the reset threshold is taken as is so
+// moving edges don't smear.
+class TemporalDepthFilter
+{
+public:
+
+	enum Mode
+	{
+		EXPONENTIAL,
+		MEDIAN
+	};
+
+	TemporalDepthFilter();
+
+	// EXPONENTIAL blends in `alpha` of every new frame, MEDIAN takes the
+	// median of the valid samples of the last `median_frames`
+	void setMode(Mode mode) { this->mode = mode; reset(); }
+	Mode getMode() const { return mode; }
+
+	void setAlpha(float alpha) { this->alpha = alpha; }
+	float getAlpha() const { return alpha; }
+
+	// 3 or 5 work well
+	void setMedianFrames(int n) { median_frames = std::max(1, n); reset(); }
+	int getMedianFrames() const { return median_frames; }
+
+	// frames a hole is bridged with the last valid depth
+	void setHoleFrames(int n) { hole_frames = n; }
+	int getHoleFrames() const { return hole_frames; }
+
+	// in millimeters
+	void setResetThreshold(float mm) { reset_threshold = mm; }
+	float getResetThreshold() const { return reset_threshold; }
+
+	void update(const ofShortPixels &depth, ofShortPixels &filtered);
+
+	void reset();
+
+protected:
+
+	Mode mode;
+	float alpha;
+	int median_frames;
+	int hole_frames;
+	float reset_threshold;
+
+	int width, height;
+
+	// EXPONENTIAL: the smoothed depth, 0 for none
+	vector<float> state;
+
+	// frames since the pixel was last valid
+	vector<float> age;
+
+	// MEDIAN: the last frames, frame after frame
+	vector<unsigned short> history;
+	int history_index;
+
+	void allocate(int width, int height);
+};
+
+// running mean and variance of the depth of the static scene. a pixel is
+// foreground when it is closer than the background by more than
+// `sigma` standard deviations and at least `min_distance`. pixels whose
+// background was never seen count as foreground as soon as they have a
+// depth, until they stayed put long enough for the foreground learning
+// rate.
+class DepthBackground
+{
+public:
+
+	DepthBackground();
+
+	// how fast the background adapts to background pixels, per frame
+	void setLearningRate(float rate) { learning_rate = rate; }
+	float getLearningRate() const { return learning_rate; }
+
+	// how fast foreground that stays put becomes background, 0 for never
+	void setForegroundLearningRate(float rate) { foreground_learning_rate = rate; }
+	float getForegroundLearningRate() const { return foreground_learning_rate; }
+
+	void setThreshold(float sigma, float min_distance_mm) { this->sigma = sigma; min_distance = min_distance_mm; }
+	float getSigma() const { return sigma; }
+	float getMinDistance() const { return min_distance; }
+
+	// adds an empty scene frame to the model, every pixel counts as
+	// background
+	void learn(const ofShortPixels &depth);
+
+	// classifies `depth` into `mask` (255 for foreground, 0 otherwise) and
+	// adapts the model
+	void update(const ofShortPixels &depth, ofPixels &mask);
+
+	// only classifies
+	void getMask(const ofShortPixels &depth, ofPixels &mask) const;
+
+	bool isLearned() const { return !mean.empty(); }
+	void reset();
+
+	// the mean background depth in millimeters, 0 where it's unknown
+	void getBackground(ofShortPixels &background) const;
+
+protected:
+
+	float learning_rate, foreground_learning_rate;
+	float sigma, min_distance;
+
+	int width, height;
+
+	vector<float> mean, variance;
+
+	// 1 where the background is known, pixels that were never background
+	// climb there by the foreground learning rate while they stay put
+	vector<float> known;
+
+	void allocate(int width, int height);
+	void process(const ofShortPixels &depth, ofPixels *mask, bool classify, bool adapt);
+};
+
+// zeroes the depth of the pixels `mask` marks as background, so every
+// converter skips them
+void applyMask(const ofPixels &mask, ofShortPixels &depth);
+
+}
@@ -0,0 +1,218 @@
+#include "DepthLookup.h"
+
+#include "Parallel.h"
+
+namespace ofxPCL
+{
+
+DepthLookup::DepthLookup()
+	: color_distortion(false)
+	, width(0)
+	, height(0)
+	, skip(1)
+{
+	translation[0] = translation[1] = translation[2] = 0;
+}
+
+void DepthLookup::setup(const CameraIntrinsics &depth, int skip)
+{
+	this->skip = std::max(1, skip);
+
+	depth_intrinsics = depth;
+	color_intrinsics = CameraIntrinsics();
+	color_distortion = false;
+
+	width = depth.width / this->skip;
+	height = depth.height / this->skip;
+
+	rays.resize(width * height * 2);
+	color_rays.clear();
+	translation[0] = translation[1] = translation[2] = 0;
+
+	const bool distortion = depth.hasDistortion();
+
+	for (int gy = 0; gy < height; gy++)
+	{
+		for (int gx = 0; gx < width; gx++)
+		{
+			float x = (gx * this->skip - depth.cx) / depth.fx;
+			float y = (gy * this->skip - depth.cy) / depth.fy;
+
+			if (distortion) depth.undistort(x, y);
+
+			float *ray = &rays[(gy * width + gx) * 2];
+			ray[0] = x;
+			ray[1] = y;
+		}
+	}
+}
+
+void DepthLookup::setup(const CameraIntrinsics &depth, const CameraIntrinsics &color, const ofMatrix4x4 &depth_to_color, int skip)
+{
+	setup(depth, skip);
+
+	color_intrinsics = color;
+	color_distortion = color.hasDistortion();
+
+	const Eigen::Matrix4f m = toEigen(depth_to_color);
+	const Eigen::Matrix3f r = m.topLeftCorner<3, 3>();
+
+	translation[0] = m(0, 3);
+	translation[1] = m(1, 3);
+	translation[2] = m(2, 3);
+
+	const int n = width * height;
+	color_rays.resize(n * 3);
+
+	for (int i = 0; i < n; i++)
+	{
+		const Eigen::Vector3f ray = r * Eigen::Vector3f(rays[i * 2], rays[i * 2 + 1], 1);
+
+		color_rays[i * 3] = ray.x();
+		color_rays[i * 3 + 1] = ray.y();
+		color_rays[i * 3 + 2] = ray.z();
+	}
+}
+
+class DepthLookupConvert
+{
+public:
+
+	// with a `mask` every row writes only its valid masked points to the
+	// front of its part of the cloud and counts them in `row_kept`
+	DepthLookupConvert(const ofPixels &color, const ofShortPixels &depth, ColorPointCloud::value_type &cloud, const DepthLookup &lookup,
+					   const ofPixels *mask = NULL, vector<int> *row_kept = NULL)
+		: color(color), depth(depth), cloud(cloud), lookup(lookup), mask(mask), row_kept(row_kept) {}
+
+	void operator()(int begin, int end)
+	{
+		const int grid_width = lookup.getWidth();
+		const int skip = lookup.getSkip();
+		const int depth_width = depth.getWidth();
+
+		const bool has_color = color.isAllocated();
+
+		const float bad_point = std::numeric_limits<float>::quiet_NaN();
+
+		for (int gy = begin; gy < end; gy++)
+		{
+			const int y = gy * skip;
+			const unsigned short *depth_row = depth.getPixels() + depth_width * y;
+			const unsigned char *mask_row = mask ? mask->getPixels() + depth_width * y : NULL;
+
+			int k = gy * grid_width;
+
+			for (int gx = 0; gx < grid_width; gx++)
+			{
+				const int i = gy * grid_width + gx;
+				const int x = gx * skip;
+				const unsigned short d = depth_row[x];
+
+				if (mask_row && (d == 0 || !mask_row[x])) continue;
+
+				ColorPointType &pp = cloud.points[mask_row ? k++ : i];
+				pp.r = pp.g = pp.b = has_color ? 0 : 255;
+
+				if (d == 0)
+				{
+					pp.x = pp.y = pp.z = bad_point;
+					continue;
+				}
+
+				// millimeter to meter
+				const float z = d * 0.001;
+				const float *ray = lookup.getRay(i);
+
+				pp.x = ray[0] * z;
+				pp.y = ray[1] * z;
+				pp.z = z;
+
+				if (!has_color) continue;
+
+				const unsigned char *c = lookup.getColor(color, i, x, y, z);
+				if (!c) continue;
+
+				pp.r = c[0];
+				pp.g = c[1];
+				pp.b = c[2];
+			}
+
+			if (row_kept) (*row_kept)[gy] = k - gy * grid_width;
+		}
+	}
+
+protected:
+
+	const ofPixels &color;
+	const ofShortPixels &depth;
+	ColorPointCloud::value_type &cloud;
+	const DepthLookup &lookup;
+	const ofPixels *mask;
+	vector<int> *row_kept;
+};
+
+void convert(const ofPixels &color, const ofShortPixels &depth, ColorPointCloud &cloud, const DepthLookup &lookup)
+{
+	assert(lookup.isSetup());
+	assert(depth.getWidth() / lookup.getSkip() >= lookup.getWidth());
+	assert(depth.getHeight() / lookup.getSkip() >= lookup.getHeight());
+
+	if (!cloud)
+		cloud = New<ColorPointCloud>();
+
+	cloud->width = lookup.getWidth();
+	cloud->height = lookup.getHeight();
+	cloud->is_dense = false;
+
+	cloud->sensor_origin_.setZero();
+	cloud->sensor_orientation_.w () = 0.0;
+	cloud->sensor_orientation_.x () = 1.0;
+	cloud->sensor_orientation_.y () = 0.0;
+	cloud->sensor_orientation_.z () = 0.0;
+
+	cloud->resize(cloud->width * cloud->height);
+
+	DepthLookupConvert body(color, depth, *cloud, lookup);
+	parallelFor(0, lookup.getHeight(), body, 16);
+}
+
+void convert(const ofPixels &color, const ofShortPixels &depth, const ofPixels &mask, ColorPointCloud &cloud, const DepthLookup &lookup)
+{
+	assert(lookup.isSetup());
+	assert(depth.getWidth() / lookup.getSkip() >= lookup.getWidth());
+	assert(depth.getHeight() / lookup.getSkip() >= lookup.getHeight());
+	assert(mask.getWidth() == depth.getWidth() && mask.getHeight() == depth.getHeight());
+	assert(mask.getNumChannels() == 1);
+
+	if (!cloud)
+		cloud = New<ColorPointCloud>();
+
+	const int grid_width = lookup.getWidth();
+	const int grid_height = lookup.getHeight();
+
+	cloud->resize(grid_width * grid_height);
+
+	vector<int> row_kept(grid_height, 0);
+
+	DepthLookupConvert body(color, depth, *cloud, lookup, &mask, &row_kept);
+	parallelFor(0, grid_height, body, 16);
+
+	// close the gaps between the rows
+	int size = 0;
+	for (int gy = 0; gy < grid_height; gy++)
+	{
+		const int offset = gy * grid_width;
+
+		if (size != offset)
+			std::copy(cloud->points.begin() + offset, cloud->points.begin() + offset + row_kept[gy], cloud->points.begin() + size);
+
+		size += row_kept[gy];
+	}
+
+	cloud->points.resize(size);
+	cloud->width = size;
+	cloud->height = 1;
+	cloud->is_dense = true;
+}
+
+}
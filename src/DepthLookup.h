@@ -0,0 +1,115 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Types.h"
+#include "Utility.h"
+
+namespace ofxPCL
+{
+
+//
+// depth lookup
+//
+// tables built once per calibration so that convert() undistorts the depth
+// image and registers the color image while it produces the points,
+// instead of remapping both images first. every pixel of the depth grid
+// gets its undistorted ray, and with a color camera also that ray in the
+// color camera's frame, so sampling the color of a point at depth z is a
+// multiply-add, a division and the color lens' distortion polynomial.
+//
+class DepthLookup
+{
+public:
+
+	DepthLookup();
+
+	// undistortion only, the color image is taken as registered to the
+	// depth image
+	void setup(const CameraIntrinsics &depth, int skip = 1);
+
+	// `depth_to_color` takes points from the depth camera's space into the
+	// color camera's
+	void setup(const CameraIntrinsics &depth, const CameraIntrinsics &color, const ofMatrix4x4 &depth_to_color, int skip = 1);
+
+	bool isSetup() const { return !rays.empty(); }
+	bool hasColorCamera() const { return !color_rays.empty(); }
+
+	const CameraIntrinsics& getDepthIntrinsics() const { return depth_intrinsics; }
+	const CameraIntrinsics& getColorIntrinsics() const { return color_intrinsics; }
+
+	// the grid of depth pixels the tables cover
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getSkip() const { return skip; }
+
+	// x and y of the ray through grid pixel `i`, at z = 1
+	const float* getRay(int i) const { return &rays[i * 2]; }
+
+	// the color pixel seen by grid pixel `i` at depth `z`, false when it
+	// falls outside a `color_width` x `color_height` image
+	bool projectColor(int i, float z, int color_width, int color_height, int &u, int &v) const
+	{
+		const float *r = &color_rays[i * 3];
+
+		const float cz = r[2] * z + translation[2];
+		if (cz <= 0) return false;
+
+		const float inv_z = 1. / cz;
+		float x = (r[0] * z + translation[0]) * inv_z;
+		float y = (r[1] * z + translation[1]) * inv_z;
+
+		if (color_distortion) color_intrinsics.distort(x, y);
+
+		// floor, not truncation, for the pixels just left of or above the image
+		const float fu = color_intrinsics.fx * x + color_intrinsics.cx + 0.5f;
+		const float fv = color_intrinsics.fy * y + color_intrinsics.cy + 0.5f;
+		if (fu < 0 || fv < 0) return false;
+
+		u = fu;
+		v = fv;
+		return u < color_width && v < color_height;
+	}
+
+	// the color pixel of grid pixel `i`, which is (`x`, `y`) in the depth
+	// image, at depth `z`. NULL when it falls outside `color`
+	const unsigned char* getColor(const ofPixels &color, int i, int x, int y, float z) const
+	{
+		const int color_width = color.getWidth();
+		const int color_height = color.getHeight();
+
+		int u = x, v = y;
+
+		if (hasColorCamera())
+		{
+			if (!projectColor(i, z, color_width, color_height, u, v)) return NULL;
+		}
+		else if (u >= color_width || v >= color_height)
+		{
+			return NULL;
+		}
+
+		return color.getPixels() + (v * color_width + u) * color.getBytesPerPixel();
+	}
+
+protected:
+
+	CameraIntrinsics depth_intrinsics, color_intrinsics;
+	bool color_distortion;
+
+	int width, height, skip;
+
+	vector<float> rays;
+	vector<float> color_rays;
+	float translation[3];
+};
+
+// like convert(color, depth, cloud, intrinsics, skip) with the grid, the
+// undistortion and the color registration of `lookup`
+void convert(const ofPixels &color, const ofShortPixels &depth, ColorPointCloud &cloud, const DepthLookup &lookup);
+
+// only the pixels `mask` marks, e.g. the foreground of a DepthBackground,
+// as an unorganized cloud without invalid points
+void convert(const ofPixels &color, const ofShortPixels &depth, const ofPixels &mask, ColorPointCloud &cloud, const DepthLookup &lookup);
+
+}
@@ -0,0 +1,265 @@
+#include "DepthMesher.h"
+
+#include "ofxPCL.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace ofxPCL
+{
+
+class DepthMesherPositions
+{
+public:
+
+	DepthMesherPositions(const ofPixels &color, const ofShortPixels &depth, ofMesh &mesh, const vector<float> &column_factors,
+						 const CameraIntrinsics &intrinsics, int skip, int grid_width, unsigned short near_mm, unsigned short far_mm)
+		: color(color), depth(depth)
+		, vertices(mesh.getVertices()), colors(mesh.getColors())
+		, column_factors(column_factors), intrinsics(intrinsics)
+		, skip(skip), grid_width(grid_width), near_mm(near_mm), far_mm(far_mm)
+	{}
+
+	void operator()(int begin, int end)
+	{
+		const int width = depth.getWidth();
+		const float inv_fy = 1. / intrinsics.fy;
+		const int bytes_per_pixel = color.getBytesPerPixel();
+		const float inv_byte = 1. / 255.;
+
+		// without a registered color image of the same size the mesh is white
+		const bool has_color = color.isAllocated() && color.getNumChannels() >= 3
+			&& color.getWidth() == width && color.getHeight() == depth.getHeight();
+
+		vector<float> z(grid_width);
+
+		for (int gy = begin; gy < end; gy++)
+		{
+			const int y = gy * skip;
+			const unsigned short *depth_ptr = depth.getPixels() + width * y;
+			const unsigned char *color_ptr = has_color ? color.getPixels() + width * y * bytes_per_pixel : NULL;
+			const float row_factor = (y - intrinsics.cy) * inv_fy;
+
+			int gx = 0;
+
+#ifdef __SSE2__
+			if (skip == 1)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i near_v = _mm_set1_epi32(near_mm - 1);
+				const __m128i far_v = _mm_set1_epi32(far_mm + 1);
+				const __m128 scale = _mm_set1_ps(0.001f);
+
+				for (; gx + 4 <= grid_width; gx += 4)
+				{
+					__m128i d = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(depth_ptr + gx)), zero);
+					__m128i valid = _mm_and_si128(_mm_cmpgt_epi32(d, near_v), _mm_cmplt_epi32(d, far_v));
+					__m128 meter = _mm_and_ps(_mm_mul_ps(_mm_cvtepi32_ps(d), scale), _mm_castsi128_ps(valid));
+					_mm_storeu_ps(&z[gx], meter);
+				}
+			}
+#endif
+
+			for (; gx < grid_width; gx++)
+			{
+				const unsigned short d = depth_ptr[gx * skip];
+				z[gx] = (d >= near_mm && d <= far_mm) ? d * 0.001f : 0;
+			}
+
+			ofVec3f *v = &vertices[gy * grid_width];
+			ofFloatColor *c = &colors[gy * grid_width];
+
+			for (gx = 0; gx < grid_width; gx++)
+			{
+				const float pz = z[gx];
+				v[gx].set(column_factors[gx] * pz, row_factor * pz, pz);
+
+				if (has_color)
+				{
+					const unsigned char *p = color_ptr + gx * skip * bytes_per_pixel;
+					c[gx].set(p[0] * inv_byte, p[1] * inv_byte, p[2] * inv_byte);
+				}
+				else
+				{
+					c[gx].set(1, 1, 1);
+				}
+			}
+		}
+	}
+
+protected:
+
+	const ofPixels &color;
+	const ofShortPixels &depth;
+	vector<ofVec3f> &vertices;
+	vector<ofFloatColor> &colors;
+	const vector<float> &column_factors;
+	const CameraIntrinsics &intrinsics;
+	int skip, grid_width;
+	unsigned short near_mm, far_mm;
+};
+
+class DepthMesherTriangles
+{
+public:
+
+	DepthMesherTriangles(ofMesh &mesh, vector<vector<ofIndexType> > &row_indices, int grid_width, int grid_height, float max_depth_jump)
+		: vertices(mesh.getVertices()), normals(mesh.getNormals())
+		, row_indices(row_indices)
+		, grid_width(grid_width), grid_height(grid_height), max_depth_jump(max_depth_jump)
+	{}
+
+	inline bool connected(const ofVec3f &a, const ofVec3f &b) const
+	{
+		return a.z > 0 && b.z > 0 && fabsf(a.z - b.z) <= max_depth_jump * std::min(a.z, b.z);
+	}
+
+	void operator()(int begin, int end)
+	{
+		for (int gy = begin; gy < end; gy++)
+		{
+			const int row = gy * grid_width;
+
+			// normals from the cross product of the neighbor differences,
+			// falling back to one-sided differences at holes and edges
+			for (int gx = 0; gx < grid_width; gx++)
+			{
+				const int i = row + gx;
+				const ofVec3f &c = vertices[i];
+				ofVec3f &n = normals[i];
+
+				if (c.z <= 0)
+				{
+					n.set(0, 0, 0);
+					continue;
+				}
+
+				const ofVec3f &l = (gx > 0 && connected(c, vertices[i - 1])) ? vertices[i - 1] : c;
+				const ofVec3f &r = (gx + 1 < grid_width && connected(c, vertices[i + 1])) ? vertices[i + 1] : c;
+				const ofVec3f &u = (gy > 0 && connected(c, vertices[i - grid_width])) ? vertices[i - grid_width] : c;
+				const ofVec3f &d = (gy + 1 < grid_height && connected(c, vertices[i + grid_width])) ? vertices[i + grid_width] : c;
+
+				// y points down and z away from the camera, dy x dx faces the viewer
+				n = (d - u).getCrossed(r - l);
+
+				const float length = n.length();
+				if (length > 0) n /= length;
+			}
+
+			vector<ofIndexType> &indices = row_indices[gy];
+			indices.clear();
+
+			if (gy + 1 >= grid_height) continue;
+
+			for (int gx = 0; gx + 1 < grid_width; gx++)
+			{
+				const int tl = row + gx;
+				const int tr = tl + 1;
+				const int bl = tl + grid_width;
+				const int br = bl + 1;
+
+				const ofVec3f &vtl = vertices[tl];
+				const ofVec3f &vtr = vertices[tr];
+				const ofVec3f &vbl = vertices[bl];
+				const ofVec3f &vbr = vertices[br];
+
+				const bool diagonal = connected(vtr, vbl);
+
+				if (diagonal && connected(vtl, vtr) && connected(vtl, vbl))
+				{
+					indices.push_back(tl);
+					indices.push_back(bl);
+					indices.push_back(tr);
+				}
+
+				if (diagonal && connected(vbr, vtr) && connected(vbr, vbl))
+				{
+					indices.push_back(tr);
+					indices.push_back(bl);
+					indices.push_back(br);
+				}
+			}
+		}
+	}
+
+protected:
+
+	const vector<ofVec3f> &vertices;
+	vector<ofVec3f> &normals;
+	vector<vector<ofIndexType> > &row_indices;
+	int grid_width, grid_height;
+	float max_depth_jump;
+};
+
+DepthMesher::DepthMesher()
+	: skip(1)
+	, near_mm(1)
+	, far_mm(std::numeric_limits<unsigned short>::max())
+	, max_depth_jump(0.05)
+	, grid_width(0)
+	, grid_height(0)
+{
+}
+
+void DepthMesher::setSkip(int skip_)
+{
+	skip = std::max(1, skip_);
+}
+
+void DepthMesher::setDepthRange(unsigned short near_mm_, unsigned short far_mm_)
+{
+	near_mm = std::max<unsigned short>(1, near_mm_);
+	far_mm = far_mm_;
+}
+
+void DepthMesher::setMaxDepthJump(float ratio)
+{
+	max_depth_jump = ratio;
+}
+
+void DepthMesher::update(const ofPixels& color, const ofShortPixels& depth, ofMesh &mesh)
+{
+	const int width = depth.getWidth();
+	const int height = depth.getHeight();
+
+	grid_width = (width + skip - 1) / skip;
+	grid_height = (height + skip - 1) / skip;
+
+	const int num_vertices = grid_width * grid_height;
+
+	column_factors.resize(grid_width);
+	for (int gx = 0; gx < grid_width; gx++)
+		column_factors[gx] = (gx * skip - intrinsics.cx) / intrinsics.fx;
+
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	mesh.getVertices().resize(num_vertices);
+	mesh.getColors().resize(num_vertices);
+	mesh.getNormals().resize(num_vertices);
+
+	row_indices.resize(grid_height);
+	for (int i = 0; i < grid_height; i++)
+		row_indices[i].reserve((grid_width - 1) * 6);
+
+	DepthMesherPositions positions(color, depth, mesh, column_factors, intrinsics, skip, grid_width, near_mm, far_mm);
+	parallelFor(0, grid_height, positions, 8);
+
+	DepthMesherTriangles triangles(mesh, row_indices, grid_width, grid_height, max_depth_jump);
+	parallelFor(0, grid_height, triangles, 8);
+
+	row_offsets.resize(grid_height);
+	size_t num_indices = 0;
+	for (int i = 0; i < grid_height; i++)
+	{
+		row_offsets[i] = num_indices;
+		num_indices += row_indices[i].size();
+	}
+
+	vector<ofIndexType> &indices = mesh.getIndices();
+	indices.resize(num_indices);
+
+	IndexBufferCopy copy(row_indices, row_offsets, indices);
+	parallelFor(0, grid_height, copy, 8);
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Utility.h"
+
+namespace ofxPCL
+{
+
+//
+// depth mesher
+//
+// meshes a depth image directly, without going through a point cloud.
+// positions, colors, normals and the triangle indices are computed row
+// parallel in a single update(). the vertex buffer always holds one vertex
+// per grid point (invalid ones at the origin) so its size never changes,
+// only the index buffer does.
+//
+class DepthMesher
+{
+public:
+
+	DepthMesher();
+
+	// of the depth camera, the default is the kinect's
+	void setIntrinsics(const CameraIntrinsics &intrinsics) { this->intrinsics = intrinsics; }
+	const CameraIntrinsics& getIntrinsics() const { return intrinsics; }
+
+	// sample every n-th pixel
+	void setSkip(int skip);
+	int getSkip() const { return skip; }
+
+	// depth range in millimeters, pixels outside are treated as holes
+	void setDepthRange(unsigned short near_mm, unsigned short far_mm);
+
+	// triangles are dropped where neighboring depths differ by more than
+	// `ratio` times their depth
+	void setMaxDepthJump(float ratio);
+	float getMaxDepthJump() const { return max_depth_jump; }
+
+	// color may be unallocated, the vertices are white then
+	void update(const ofPixels& color, const ofShortPixels& depth, ofMesh &mesh);
+
+	int getGridWidth() const { return grid_width; }
+	int getGridHeight() const { return grid_height; }
+
+protected:
+
+	CameraIntrinsics intrinsics;
+
+	int skip;
+	unsigned short near_mm, far_mm;
+	float max_depth_jump;
+
+	int grid_width, grid_height;
+
+	vector<float> column_factors;
+	vector<vector<ofIndexType> > row_indices;
+	vector<size_t> row_offsets;
+};
+
+}
@@ -0,0 +1,439 @@
+#pragma once
+
+#include "ofxPCL.h"
+
+#include <pcl/features/shot.h>
+
+namespace ofxPCL
+{
+
+//
+// descriptors
+//
+// one row per described point, stored contiguously so the matrix can be
+// handed to a nearest neighbor index as is. rows of points without enough
+// neighbors are all zero.
+//
+struct Descriptors
+{
+	int rows, cols;
+	vector<float> data;
+
+	// point index of each row
+	vector<int> indices;
+
+	Descriptors() : rows(0), cols(0) {}
+
+	void resize(int r, int c)
+	{
+		rows = r;
+		cols = c;
+		data.assign(r * c, 0);
+		indices.resize(r);
+	}
+
+	float* row(int i) { return &data[i * cols]; }
+	const float* row(int i) const { return &data[i * cols]; }
+};
+
+//
+// fpfh
+//
+// pcl::FPFHEstimation computes the SPFH of a point again for every query
+// that has it as a neighbor. here each needed SPFH is computed once into a
+// shared buffer, then the FPFH rows are weighted sums of it.
+//
+enum
+{
+	FPFH_BINS = 11,
+	FPFH_SIZE = FPFH_BINS * 3
+};
+
+// the angle features of a point pair, like pcl::computePairFeatures
+inline bool pairFeatures(const Eigen::Vector3f &p1, const Eigen::Vector3f &n1,
+						 const Eigen::Vector3f &p2, const Eigen::Vector3f &n2,
+						 float &f1, float &f2, float &f3)
+{
+	Eigen::Vector3f dp = p2 - p1;
+	const float distance = dp.norm();
+	if (distance == 0) return false;
+
+	Eigen::Vector3f source = n1, target = n2;
+
+	// the point whose normal makes the smaller angle with the line is the source
+	float angle1 = source.dot(dp) / distance;
+	const float angle2 = target.dot(dp) / distance;
+
+	if (acosf(fabsf(angle1)) > acosf(fabsf(angle2)))
+	{
+		std::swap(source, target);
+		dp = -dp;
+		angle1 = -angle2;
+	}
+
+	f3 = angle1;
+
+	// darboux frame
+	Eigen::Vector3f v = dp.cross(source);
+	const float v_norm = v.norm();
+	if (v_norm == 0) return false;
+	v /= v_norm;
+
+	const Eigen::Vector3f w = source.cross(v);
+
+	f2 = v.dot(target);
+	f1 = atan2f(w.dot(target), source.dot(target));
+	return true;
+}
+
+template <typename T>
+class FPFHNeighbors
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	FPFHNeighbors(const T &cloud, const KdTree<PointType> &kdtree, float radius, const vector<int> &points,
+				  vector<vector<int> > &neighbors, vector<vector<float> > &distances)
+		: cloud(cloud), kdtree(kdtree), radius(radius), points(points), neighbors(neighbors), distances(distances) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const PointType &p = cloud->points[points[i]];
+			if (!pcl_isfinite(p.x)) continue;
+
+			kdtree.kdtree->radiusSearch(p, radius, neighbors[i], distances[i]);
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	const KdTree<PointType> &kdtree;
+	float radius;
+	const vector<int> &points;
+	vector<vector<int> > &neighbors;
+	vector<vector<float> > &distances;
+};
+
+template <typename T>
+class SPFHFill
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	SPFHFill(const T &cloud, const vector<int> &points, const vector<vector<int> > &neighbors, float *spfh)
+		: cloud(cloud), points(points), neighbors(neighbors), spfh(spfh) {}
+
+	void operator()(int begin, int end)
+	{
+		const float bin_f1 = FPFH_BINS / (2 * M_PI);
+		const float bin_f2 = FPFH_BINS * 0.5f;
+
+		for (int i = begin; i < end; i++)
+		{
+			const vector<int> &nn = neighbors[i];
+			float *h = spfh + i * FPFH_SIZE;
+
+			if (nn.size() < 2) continue;
+
+			const PointType &p = cloud->points[points[i]];
+			const Eigen::Vector3f pp = p.getVector3fMap();
+			const Eigen::Vector3f pn = p.getNormalVector3fMap();
+
+			if (!pcl_isfinite(pn.x())) continue;
+
+			const float increment = 100.f / (nn.size() - 1);
+
+			for (int k = 0; k < nn.size(); k++)
+			{
+				if (nn[k] == points[i]) continue;
+
+				const PointType &q = cloud->points[nn[k]];
+				if (!pcl_isfinite(q.normal_x)) continue;
+
+				float f1, f2, f3;
+				if (!pairFeatures(pp, pn, q.getVector3fMap(), q.getNormalVector3fMap(), f1, f2, f3)) continue;
+
+				const int b1 = ofClamp(floorf((f1 + M_PI) * bin_f1), 0, FPFH_BINS - 1);
+				const int b2 = ofClamp(floorf((f2 + 1) * bin_f2), 0, FPFH_BINS - 1);
+				const int b3 = ofClamp(floorf((f3 + 1) * bin_f2), 0, FPFH_BINS - 1);
+
+				h[b1] += increment;
+				h[FPFH_BINS + b2] += increment;
+				h[FPFH_BINS * 2 + b3] += increment;
+			}
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	const vector<int> &points;
+	const vector<vector<int> > &neighbors;
+	float *spfh;
+};
+
+class FPFHAccumulate
+{
+public:
+
+	FPFHAccumulate(const vector<int> &slots, const vector<vector<int> > &neighbors, const vector<vector<float> > &distances,
+				   const vector<float> &spfh, Descriptors &descriptors)
+		: slots(slots), neighbors(neighbors), distances(distances), spfh(spfh), descriptors(descriptors) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const vector<int> &nn = neighbors[i];
+			const vector<float> &dd = distances[i];
+			float *f = descriptors.row(i);
+
+			if (nn.size() < 2) continue;
+
+			// neighbors weighted by inverse squared distance, each of the
+			// three sub histograms normalized to 100
+			float sum[3] = { 0, 0, 0 };
+
+			for (int k = 0; k < nn.size(); k++)
+			{
+				if (dd[k] == 0) continue;
+
+				const float weight = 1.f / dd[k];
+				const float *h = &spfh[slots[nn[k]] * FPFH_SIZE];
+
+				for (int j = 0; j < FPFH_SIZE; j++)
+				{
+					const float v = h[j] * weight;
+					sum[j / FPFH_BINS] += v;
+					f[j] += v;
+				}
+			}
+
+			for (int j = 0; j < FPFH_SIZE; j++)
+				if (sum[j / FPFH_BINS] > 0) f[j] *= 100.f / sum[j / FPFH_BINS];
+
+			const float *own = &spfh[slots[descriptors.indices[i]] * FPFH_SIZE];
+			for (int j = 0; j < FPFH_SIZE; j++)
+				f[j] += own[j];
+		}
+	}
+
+protected:
+
+	const vector<int> &slots;
+	const vector<vector<int> > &neighbors;
+	const vector<vector<float> > &distances;
+	const vector<float> &spfh;
+	Descriptors &descriptors;
+};
+
+// `kdtree` must be built on `cloud_with_normals`. without `indices` every
+// point gets a row, otherwise only the listed ones (e.g. keypoints) do.
+template <typename T>
+void computeFPFH(const T &cloud_with_normals, const KdTree<typename T::value_type::PointType> &kdtree, float radius,
+				 Descriptors &descriptors, const vector<int> *indices = NULL)
+{
+	assert(cloud_with_normals);
+
+	const int num_points = cloud_with_normals->points.size();
+
+	if (indices)
+	{
+		descriptors.resize(indices->size(), FPFH_SIZE);
+		descriptors.indices = *indices;
+	}
+	else
+	{
+		descriptors.resize(num_points, FPFH_SIZE);
+		for (int i = 0; i < num_points; i++)
+			descriptors.indices[i] = i;
+	}
+
+	if (descriptors.rows == 0) return;
+
+	// neighborhoods of the queries
+	vector<vector<int> > neighbors(descriptors.rows);
+	vector<vector<float> > distances(descriptors.rows);
+
+	FPFHNeighbors<T> query_neighbors(cloud_with_normals, kdtree, radius, descriptors.indices, neighbors, distances);
+	parallelFor(0, descriptors.rows, query_neighbors, 64);
+
+	// every point whose SPFH is needed gets a slot, the queries first
+	vector<int> slots(num_points, -1);
+	vector<int> points = descriptors.indices;
+
+	for (int i = 0; i < points.size(); i++)
+		slots[points[i]] = i;
+
+	for (int i = 0; i < descriptors.rows; i++)
+	{
+		const vector<int> &nn = neighbors[i];
+		for (int k = 0; k < nn.size(); k++)
+		{
+			if (slots[nn[k]] >= 0) continue;
+			slots[nn[k]] = points.size();
+			points.push_back(nn[k]);
+		}
+	}
+
+	// neighborhoods of the extra points, only needed for their SPFH
+	const int num_queries = descriptors.rows;
+	const int num_extra = points.size() - num_queries;
+
+	vector<int> extra_points(points.begin() + num_queries, points.end());
+	vector<vector<int> > extra_neighbors(num_extra);
+	vector<vector<float> > extra_distances(num_extra);
+
+	FPFHNeighbors<T> more_neighbors(cloud_with_normals, kdtree, radius, extra_points, extra_neighbors, extra_distances);
+	parallelFor(0, num_extra, more_neighbors, 64);
+
+	// queries first, then the extra points, in slot order
+	vector<float> spfh(points.size() * FPFH_SIZE, 0);
+
+	SPFHFill<T> query_spfh(cloud_with_normals, descriptors.indices, neighbors, &spfh[0]);
+	parallelFor(0, num_queries, query_spfh, 64);
+
+	if (num_extra > 0)
+	{
+		SPFHFill<T> more_spfh(cloud_with_normals, extra_points, extra_neighbors, &spfh[num_queries * FPFH_SIZE]);
+		parallelFor(0, num_extra, more_spfh, 64);
+	}
+
+	FPFHAccumulate accumulate(slots, neighbors, distances, spfh, descriptors);
+	parallelFor(0, num_queries, accumulate, 64);
+}
+
+template <typename T>
+Descriptors computeFPFH(const T &cloud_with_normals, float radius)
+{
+	KdTree<typename T::value_type::PointType> kdtree(cloud_with_normals);
+
+	Descriptors descriptors;
+	computeFPFH(cloud_with_normals, kdtree, radius, descriptors);
+	return descriptors;
+}
+
+//
+// shot
+//
+// pcl's SHOTEstimation on ranges of the queries on the thread pool, every
+// range with an estimation and a search method of its own on top of the
+// caller's kd-tree, instead of SHOTEstimationOMP's own openmp threads on
+// top of the pool
+//
+enum
+{
+	SHOT_SIZE = 352
+};
+
+// the search method of one range. Feature::initCompute() sets the input
+// cloud of its search method every time, which would rebuild the shared
+// kd-tree under the other ranges, so this forwards the queries to the
+// already built tree and only keeps the cloud it is given.
+template <typename PointType>
+class SharedSearch : public pcl::search::Search<PointType>
+{
+public:
+
+	typedef pcl::search::Search<PointType> Base;
+
+	using Base::nearestKSearch;
+	using Base::radiusSearch;
+
+	SharedSearch(const KdTree<PointType> &kdtree) : Base("SharedSearch"), kdtree(kdtree) {}
+
+	void setInputCloud(const typename Base::PointCloudConstPtr &cloud,
+					   const typename Base::IndicesConstPtr &indices = typename Base::IndicesConstPtr())
+	{
+		this->input_ = cloud;
+		this->indices_ = indices;
+	}
+
+	int nearestKSearch(const PointType &point, int k, vector<int> &indices, vector<float> &distances) const
+	{
+		return kdtree.kdtree->nearestKSearch(point, k, indices, distances);
+	}
+
+	int radiusSearch(const PointType &point, double radius, vector<int> &indices, vector<float> &distances,
+					 unsigned int max_nn = 0) const
+	{
+		return kdtree.kdtree->radiusSearch(point, radius, indices, distances, max_nn);
+	}
+
+protected:
+
+	const KdTree<PointType> &kdtree;
+};
+
+template <typename T>
+class SHOTRanges
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	SHOTRanges(const T &cloud_with_normals, const KdTree<PointType> &kdtree, float radius, Descriptors &descriptors)
+		: cloud_with_normals(cloud_with_normals), kdtree(kdtree), radius(radius), descriptors(descriptors) {}
+
+	void operator()(int begin, int end)
+	{
+		pcl::SHOTEstimation<PointType, PointType, pcl::SHOT352> shot;
+		pcl::PointCloud<pcl::SHOT352> result;
+
+		shot.setInputCloud(cloud_with_normals);
+		shot.setInputNormals(cloud_with_normals);
+		shot.setSearchMethod(typename pcl::search::Search<PointType>::Ptr(new SharedSearch<PointType>(kdtree)));
+		shot.setRadiusSearch(radius);
+		shot.setIndices(pcl::IndicesPtr(new vector<int>(descriptors.indices.begin() + begin, descriptors.indices.begin() + end)));
+
+		shot.compute(result);
+
+		for (int i = 0; i < result.points.size(); i++)
+		{
+			const float *d = result.points[i].descriptor;
+			if (!pcl_isfinite(d[0])) continue;
+
+			std::copy(d, d + SHOT_SIZE, descriptors.row(begin + i));
+		}
+	}
+
+protected:
+
+	const T &cloud_with_normals;
+	const KdTree<PointType> &kdtree;
+	float radius;
+	Descriptors &descriptors;
+};
+
+template <typename T>
+void computeSHOT(const T &cloud_with_normals, const KdTree<typename T::value_type::PointType> &kdtree, float radius,
+				 Descriptors &descriptors, const vector<int> *indices = NULL)
+{
+	assert(cloud_with_normals);
+
+	const int num_points = cloud_with_normals->points.size();
+
+	if (indices)
+	{
+		descriptors.resize(indices->size(), SHOT_SIZE);
+		descriptors.indices = *indices;
+	}
+	else
+	{
+		descriptors.resize(num_points, SHOT_SIZE);
+		for (int i = 0; i < num_points; i++)
+			descriptors.indices[i] = i;
+	}
+
+	if (descriptors.rows == 0) return;
+
+	SHOTRanges<T> ranges(cloud_with_normals, kdtree, radius, descriptors);
+	parallelFor(0, descriptors.rows, ranges, 64);
+}
+
+}
@@ -0,0 +1,523 @@
+#pragma once
+
+#include "ofxPCL.h"
+
+#include <Eigen/Geometry>
+#include <flann/flann.hpp>
+#include <Poco/Timestamp.h>
+
+namespace ofxPCL
+{
+
+//
+// global registration
+//
+// coarse alignment of two scans from their descriptors, without an initial
+// guess. descriptors are matched with an approximate kd-tree, matches that
+// disagree with each other are pruned by comparing edge lengths of random
+// triples, and the rigid transform is estimated with ransac on what is
+// left. the result is good enough to start ICP from.
+//
+struct GlobalRegistrationParams
+{
+	// correspondences closer than this after alignment are inliers, a few
+	// times the sampling distance of the clouds
+	float max_correspondence_distance;
+
+	// only keep matches that are each other's nearest neighbor
+	bool mutual_filter;
+
+	// 0 to 1, corresponding edges of a triple must have at least this
+	// length ratio to be consistent
+	float edge_similarity;
+
+	// random triples the consistency test draws, per match
+	int tuple_trials;
+
+	int max_iterations;
+
+	// ransac stops once an outlier free sample has been drawn with this
+	// probability
+	float confidence;
+
+	// leaves visited per kd-tree search, more is slower but closer to exact
+	int checks;
+
+	GlobalRegistrationParams(float max_correspondence_distance = 0.05)
+		: max_correspondence_distance(max_correspondence_distance)
+		, mutual_filter(true)
+		, edge_similarity(0.9)
+		, tuple_trials(100)
+		, max_iterations(100000)
+		, confidence(0.999)
+		, checks(32)
+	{}
+};
+
+struct GlobalRegistrationResult
+{
+	// maps the source onto the target, ready for transform() or as the
+	// initial guess of ICP
+	ofMatrix4x4 transform;
+
+	bool valid;
+
+	int num_matches;
+	int num_correspondences;
+	int num_inliers;
+	int iterations;
+
+	// rms distance of the inliers
+	float fitness;
+
+	// source and target point indices of the inliers
+	vector<std::pair<int, int> > inliers;
+
+	float elapsed_ms;
+
+	GlobalRegistrationResult() : valid(false), num_matches(0), num_correspondences(0), num_inliers(0), iterations(0), fitness(0), elapsed_ms(0) {}
+};
+
+// xorshift, each ransac block gets its own state so the threads don't
+// share a generator
+inline unsigned int randomNext(unsigned int &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+inline bool isZeroDescriptor(const float *d, int size)
+{
+	for (int i = 0; i < size; i++)
+		if (d[i] != 0) return false;
+	return true;
+}
+
+// kd-tree over the valid rows of a descriptor matrix
+class DescriptorIndex
+{
+public:
+
+	typedef flann::Index<flann::L2<float> > Index;
+
+	DescriptorIndex(const Descriptors &descriptors, int num_trees = 4) : cols(descriptors.cols)
+	{
+		for (int i = 0; i < descriptors.rows; i++)
+		{
+			const float *d = descriptors.row(i);
+			if (isZeroDescriptor(d, cols)) continue;
+
+			data.insert(data.end(), d, d + cols);
+			rows.push_back(i);
+		}
+
+		if (rows.empty()) return;
+
+		index = boost::shared_ptr<Index>(new Index(flann::Matrix<float>(&data[0], rows.size(), cols), flann::KDTreeIndexParams(num_trees)));
+		index->buildIndex();
+	}
+
+	bool empty() const { return rows.empty(); }
+
+	// row of the nearest descriptor, -1 if there is none
+	int nearest(const float *query, int checks) const
+	{
+		if (empty()) return -1;
+
+		int i;
+		float distance;
+
+		flann::Matrix<float> q(const_cast<float*>(query), 1, cols);
+		flann::Matrix<int> indices(&i, 1, 1);
+		flann::Matrix<float> distances(&distance, 1, 1);
+
+		if (index->knnSearch(q, indices, distances, 1, flann::SearchParams(checks)) < 1) return -1;
+		return rows[i];
+	}
+
+protected:
+
+	int cols;
+	vector<float> data;
+	vector<int> rows;
+	boost::shared_ptr<Index> index;
+};
+
+class DescriptorMatching
+{
+public:
+
+	DescriptorMatching(const Descriptors &queries, const DescriptorIndex &index, int checks, vector<int> &matches)
+		: queries(queries), index(index), checks(checks), matches(matches) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const float *d = queries.row(i);
+			matches[i] = isZeroDescriptor(d, queries.cols) ? -1 : index.nearest(d, checks);
+		}
+	}
+
+protected:
+
+	const Descriptors &queries;
+	const DescriptorIndex &index;
+	int checks;
+	vector<int> &matches;
+};
+
+// edge lengths of both triangles agree, so the three correspondences can
+// come from the same rigid motion
+inline bool consistentTriple(const vector<Eigen::Vector3f> &source, const vector<Eigen::Vector3f> &target,
+							 int a, int b, int c, float similarity)
+{
+	const int pairs[3][2] = { { a, b }, { b, c }, { c, a } };
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float ls = (source[pairs[i][0]] - source[pairs[i][1]]).norm();
+		const float lt = (target[pairs[i][0]] - target[pairs[i][1]]).norm();
+
+		if (ls < lt * similarity || lt < ls * similarity) return false;
+	}
+
+	return true;
+}
+
+inline bool sampleTriple(unsigned int &state, int n, int &a, int &b, int &c)
+{
+	a = randomNext(state) % n;
+	b = randomNext(state) % n;
+	c = randomNext(state) % n;
+	return a != b && b != c && c != a;
+}
+
+class TupleTest
+{
+public:
+
+	TupleTest(const vector<Eigen::Vector3f> &source, const vector<Eigen::Vector3f> &target, float similarity,
+			  int trials_per_block)
+		: source(source), target(target), similarity(similarity), trials_per_block(trials_per_block) {}
+
+	// collects the matches of every consistent triple, with repeats
+	void operator()(int begin, int end, vector<int> &passed)
+	{
+		const int n = source.size();
+
+		for (int block = begin; block < end; block++)
+		{
+			unsigned int state = block * 2654435761u + 1;
+
+			for (int k = 0; k < trials_per_block; k++)
+			{
+				int a, b, c;
+				if (!sampleTriple(state, n, a, b, c)) continue;
+				if (!consistentTriple(source, target, a, b, c, similarity)) continue;
+
+				passed.push_back(a);
+				passed.push_back(b);
+				passed.push_back(c);
+			}
+		}
+	}
+
+	void join(vector<int> &passed, const vector<int> &partial)
+	{
+		passed.insert(passed.end(), partial.begin(), partial.end());
+	}
+
+protected:
+
+	const vector<Eigen::Vector3f> &source;
+	const vector<Eigen::Vector3f> &target;
+	float similarity;
+	int trials_per_block;
+};
+
+inline Eigen::Matrix4f estimateRigidTransform(const vector<Eigen::Vector3f> &source, const vector<Eigen::Vector3f> &target,
+											  const vector<int> &indices)
+{
+	Eigen::Matrix3Xf s(3, indices.size()), t(3, indices.size());
+
+	for (int i = 0; i < indices.size(); i++)
+	{
+		s.col(i) = source[indices[i]];
+		t.col(i) = target[indices[i]];
+	}
+
+	return Eigen::umeyama(s, t, false);
+}
+
+inline int countInliers(const vector<Eigen::Vector3f> &source, const vector<Eigen::Vector3f> &target,
+						const Eigen::Matrix4f &transform, float max_distance, vector<int> *inliers = NULL)
+{
+	const Eigen::Matrix3f R = transform.topLeftCorner<3, 3>();
+	const Eigen::Vector3f t = transform.topRightCorner<3, 1>();
+	const float max_squared = max_distance * max_distance;
+
+	if (inliers) inliers->clear();
+
+	int count = 0;
+	for (int i = 0; i < source.size(); i++)
+	{
+		if ((R * source[i] + t - target[i]).squaredNorm() > max_squared) continue;
+
+		count++;
+		if (inliers) inliers->push_back(i);
+	}
+
+	return count;
+}
+
+//
+// ransac in blocks of hypotheses. every finished block lowers the number of
+// iterations still needed from the best inlier ratio so far, and blocks
+// that start after that number is reached return right away.
+//
+class RansacBlocks
+{
+public:
+
+	enum { BLOCK_SIZE = 256 };
+
+	RansacBlocks(const vector<Eigen::Vector3f> &source, const vector<Eigen::Vector3f> &target,
+				 const GlobalRegistrationParams &params)
+		: source(source), target(target), params(params)
+		, best_count(0), best_transform(Eigen::Matrix4f::Identity())
+		, iterations(0), needed_iterations(params.max_iterations)
+	{}
+
+	void operator()(int begin, int end)
+	{
+		const int n = source.size();
+		vector<int> sample(3);
+
+		for (int block = begin; block < end; block++)
+		{
+			{
+				ofMutex::ScopedLock lock(mutex);
+				if (iterations >= needed_iterations) return;
+			}
+
+			unsigned int state = block * 2654435761u + 1;
+
+			int local_count = 0;
+			Eigen::Matrix4f local_transform = Eigen::Matrix4f::Identity();
+
+			for (int k = 0; k < BLOCK_SIZE; k++)
+			{
+				if (!sampleTriple(state, n, sample[0], sample[1], sample[2])) continue;
+
+				// cheap rejection before the estimate and the inlier count
+				if (!consistentTriple(source, target, sample[0], sample[1], sample[2], params.edge_similarity)) continue;
+
+				const Eigen::Matrix4f transform = estimateRigidTransform(source, target, sample);
+				const int count = countInliers(source, target, transform, params.max_correspondence_distance);
+
+				if (count > local_count)
+				{
+					local_count = count;
+					local_transform = transform;
+				}
+			}
+
+			ofMutex::ScopedLock lock(mutex);
+
+			iterations += BLOCK_SIZE;
+
+			if (local_count > best_count)
+			{
+				best_count = local_count;
+				best_transform = local_transform;
+
+				const double w = (double)best_count / n;
+				const double outlier_free = w * w * w;
+
+				if (outlier_free >= 1)
+					needed_iterations = 0;
+				else if (outlier_free > 0)
+					needed_iterations = std::min<double>(params.max_iterations, log(1. - params.confidence) / log(1. - outlier_free));
+			}
+		}
+	}
+
+	int getBestCount() const { return best_count; }
+	const Eigen::Matrix4f& getBestTransform() const { return best_transform; }
+	int getIterations() const { return std::min(iterations, params.max_iterations); }
+
+protected:
+
+	const vector<Eigen::Vector3f> &source;
+	const vector<Eigen::Vector3f> &target;
+	const GlobalRegistrationParams &params;
+
+	int best_count;
+	Eigen::Matrix4f best_transform;
+	int iterations, needed_iterations;
+	ofMutex mutex;
+};
+
+// `source_features` and `target_features` are descriptors of the two clouds,
+// e.g. from computeFPFH() on keypoints
+template <typename T>
+GlobalRegistrationResult globalRegistration(const T &source, const Descriptors &source_features,
+											const T &target, const Descriptors &target_features,
+											const GlobalRegistrationParams &params = GlobalRegistrationParams())
+{
+	assert(source);
+	assert(target);
+	assert(source_features.cols == target_features.cols);
+
+	Poco::Timestamp timer;
+	GlobalRegistrationResult result;
+
+	// nearest descriptors, both ways for the mutual filter
+	vector<int> forward(source_features.rows, -1);
+	vector<int> backward;
+
+	{
+		DescriptorIndex target_index(target_features);
+		DescriptorMatching matching(source_features, target_index, params.checks, forward);
+		parallelFor(0, source_features.rows, matching, 64);
+	}
+
+	if (params.mutual_filter)
+	{
+		backward.assign(target_features.rows, -1);
+
+		DescriptorIndex source_index(source_features);
+		DescriptorMatching matching(target_features, source_index, params.checks, backward);
+		parallelFor(0, target_features.rows, matching, 64);
+	}
+
+	vector<std::pair<int, int> > matches;
+	vector<Eigen::Vector3f> source_points, target_points;
+
+	for (int i = 0; i < forward.size(); i++)
+	{
+		const int j = forward[i];
+		if (j < 0) continue;
+		if (params.mutual_filter && backward[j] != i) continue;
+
+		const int s = source_features.indices[i];
+		const int t = target_features.indices[j];
+
+		if (!pcl_isfinite(source->points[s].x) || !pcl_isfinite(target->points[t].x)) continue;
+
+		matches.push_back(std::make_pair(s, t));
+		source_points.push_back(source->points[s].getVector3fMap());
+		target_points.push_back(target->points[t].getVector3fMap());
+	}
+
+	result.num_matches = matches.size();
+
+	if (matches.size() < 3)
+	{
+		result.elapsed_ms = timer.elapsed() * 0.001;
+		return result;
+	}
+
+	// keep the matches that took part in at least one consistent triple,
+	// unless that leaves too few to estimate from
+	{
+		const int block_trials = 1024;
+		const int num_blocks = std::max<int>(1, ((long long)matches.size() * params.tuple_trials + block_trials - 1) / block_trials);
+
+		TupleTest tuple_test(source_points, target_points, params.edge_similarity, block_trials);
+		const vector<int> passed = parallelReduce(0, num_blocks, vector<int>(), tuple_test, 1);
+
+		vector<char> keep(matches.size(), 0);
+		for (int i = 0; i < passed.size(); i++)
+			keep[passed[i]] = 1;
+
+		int n = 0;
+		for (int i = 0; i < matches.size(); i++)
+			n += keep[i];
+
+		if (n >= 3)
+		{
+			int k = 0;
+			for (int i = 0; i < matches.size(); i++)
+			{
+				if (!keep[i]) continue;
+
+				matches[k] = matches[i];
+				source_points[k] = source_points[i];
+				target_points[k] = target_points[i];
+				k++;
+			}
+
+			matches.resize(k);
+			source_points.resize(k);
+			target_points.resize(k);
+		}
+	}
+
+	result.num_correspondences = matches.size();
+
+	const int num_blocks = (params.max_iterations + RansacBlocks::BLOCK_SIZE - 1) / RansacBlocks::BLOCK_SIZE;
+
+	RansacBlocks ransac(source_points, target_points, params);
+	parallelFor(0, num_blocks, ransac, 1);
+
+	result.iterations = ransac.getIterations();
+
+	if (ransac.getBestCount() < 3)
+	{
+		result.elapsed_ms = timer.elapsed() * 0.001;
+		return result;
+	}
+
+	// least squares on the inliers of the best hypothesis, then once more on
+	// the inliers of the refined one
+	Eigen::Matrix4f transform = ransac.getBestTransform();
+	vector<int> inliers;
+
+	for (int i = 0; i < 2; i++)
+	{
+		countInliers(source_points, target_points, transform, params.max_correspondence_distance, &inliers);
+		if (inliers.size() < 3) break;
+
+		transform = estimateRigidTransform(source_points, target_points, inliers);
+	}
+
+	countInliers(source_points, target_points, transform, params.max_correspondence_distance, &inliers);
+
+	const Eigen::Matrix3f R = transform.topLeftCorner<3, 3>();
+	const Eigen::Vector3f t = transform.topRightCorner<3, 1>();
+
+	double sum_squared = 0;
+	result.inliers.resize(inliers.size());
+
+	for (int i = 0; i < inliers.size(); i++)
+	{
+		const int k = inliers[i];
+		sum_squared += (R * source_points[k] + t - target_points[k]).squaredNorm();
+		result.inliers[i] = matches[k];
+	}
+
+	result.transform = toOF(transform);
+	result.num_inliers = inliers.size();
+	result.valid = result.num_inliers >= 3;
+	result.fitness = result.num_inliers > 0 ? sqrt(sum_squared / result.num_inliers) : 0;
+	result.elapsed_ms = timer.elapsed() * 0.001;
+
+	return result;
+}
+
+// computes fpfh on all points of both clouds, downsample them first
+template <typename T>
+GlobalRegistrationResult globalRegistration(const T &source_with_normals, const T &target_with_normals, float feature_radius,
+											const GlobalRegistrationParams &params = GlobalRegistrationParams())
+{
+	const Descriptors source_features = computeFPFH(source_with_normals, feature_radius);
+	const Descriptors target_features = computeFPFH(target_with_normals, feature_radius);
+
+	return globalRegistration(source_with_normals, source_features, target_with_normals, target_features, params);
+}
+
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "ofxPCL.h"
+
+namespace ofxPCL
+{
+
+//
+// keypoints
+//
+// every detector returns indices into the cloud it was given, sorted, so
+// they can go straight into computeFPFH() or computeSHOT(). the detectors
+// that need neighborhoods take the caller's kd-tree so it can be shared
+// with the descriptors.
+//
+
+// per point responses, NO_RESPONSE where a point is not a candidate
+const float NO_RESPONSE = -std::numeric_limits<float>::max();
+
+template <typename T>
+class ISSResponse
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	ISSResponse(const T &cloud, const KdTree<PointType> &kdtree, float radius, float gamma_21, float gamma_32,
+				int min_neighbors, vector<float> &response)
+		: cloud(cloud), kdtree(kdtree), radius(radius), gamma_21(gamma_21), gamma_32(gamma_32)
+		, min_neighbors(min_neighbors), response(response)
+	{}
+
+	void operator()(int begin, int end)
+	{
+		vector<int> indices;
+		vector<float> distances;
+
+		for (int i = begin; i < end; i++)
+		{
+			const PointType &p = cloud->points[i];
+			if (!pcl_isfinite(p.x)) continue;
+
+			if (kdtree.kdtree->radiusSearch(p, radius, indices, distances) < min_neighbors) continue;
+
+			// scatter matrix around the point itself
+			const Eigen::Vector3d c = p.getVector3fMap().template cast<double>();
+			Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero();
+
+			for (int k = 0; k < indices.size(); k++)
+			{
+				const Eigen::Vector3d d = cloud->points[indices[k]].getVector3fMap().template cast<double>() - c;
+				scatter += d * d.transpose();
+			}
+
+			scatter /= indices.size();
+
+			// ascending, so e1 >= e2 >= e3 are reversed
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(scatter, Eigen::EigenvaluesOnly);
+			const double e1 = solver.eigenvalues()[2];
+			const double e2 = solver.eigenvalues()[1];
+			const double e3 = solver.eigenvalues()[0];
+
+			if (e1 <= 0 || e2 <= 0) continue;
+			if (e2 / e1 >= gamma_21 || e3 / e2 >= gamma_32) continue;
+
+			response[i] = e3;
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	const KdTree<PointType> &kdtree;
+	float radius, gamma_21, gamma_32;
+	int min_neighbors;
+	vector<float> &response;
+};
+
+template <typename T>
+class HarrisResponse
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	HarrisResponse(const T &cloud, const KdTree<PointType> &kdtree, float radius, float threshold, vector<float> &response)
+		: cloud(cloud), kdtree(kdtree), radius(radius), threshold(threshold), response(response) {}
+
+	void operator()(int begin, int end)
+	{
+		vector<int> indices;
+		vector<float> distances;
+
+		for (int i = begin; i < end; i++)
+		{
+			const PointType &p = cloud->points[i];
+			if (!pcl_isfinite(p.x)) continue;
+
+			if (kdtree.kdtree->radiusSearch(p, radius, indices, distances) < 3) continue;
+
+			// covariance of the neighboring normals, like pcl::HarrisKeypoint3D
+			Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+			int count = 0;
+
+			for (int k = 0; k < indices.size(); k++)
+			{
+				const Eigen::Vector3d n = PointNormalAccess<PointType>::get(cloud->points[indices[k]]).template cast<double>();
+				if (!pcl_isfinite(n.x())) continue;
+
+				covariance += n * n.transpose();
+				count++;
+			}
+
+			if (count < 3) continue;
+			covariance /= count;
+
+			// with the 0.04 offset pcl adds, the normals being unit length
+			// keeps the trace at 1 and the plain response below 0
+			const double trace = covariance.trace();
+			const double r = 0.04 + covariance.determinant() - 0.04 * trace * trace;
+
+			if (r > threshold) response[i] = r;
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	const KdTree<PointType> &kdtree;
+	float radius, threshold;
+	vector<float> &response;
+};
+
+// keeps the candidates whose response is the largest within `radius`, ties
+// go to the lower index
+template <typename T>
+class KeypointSuppression
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	KeypointSuppression(const T &cloud, const KdTree<PointType> &kdtree, float radius, const vector<float> &response, vector<char> &keep)
+		: cloud(cloud), kdtree(kdtree), radius(radius), response(response), keep(keep) {}
+
+	void operator()(int begin, int end)
+	{
+		vector<int> indices;
+		vector<float> distances;
+
+		for (int i = begin; i < end; i++)
+		{
+			const float r = response[i];
+			if (r == NO_RESPONSE) continue;
+
+			kdtree.kdtree->radiusSearch(cloud->points[i], radius, indices, distances);
+
+			bool maximum = true;
+			for (int k = 0; k < indices.size() && maximum; k++)
+			{
+				const int j = indices[k];
+				if (response[j] > r || (response[j] == r && j < i)) maximum = false;
+			}
+
+			keep[i] = maximum;
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	const KdTree<PointType> &kdtree;
+	float radius;
+	const vector<float> &response;
+	vector<char> &keep;
+};
+
+template <typename T>
+void suppressKeypoints(const T &cloud, const KdTree<typename T::value_type::PointType> &kdtree, float radius,
+					   const vector<float> &response, vector<int> &keypoints)
+{
+	const int n = cloud->points.size();
+
+	vector<char> keep(n, 0);
+	KeypointSuppression<T> suppression(cloud, kdtree, radius, response, keep);
+	parallelFor(0, n, suppression, 256);
+
+	keypoints.clear();
+	for (int i = 0; i < n; i++)
+		if (keep[i]) keypoints.push_back(i);
+}
+
+//
+// intrinsic shape signatures. points whose neighborhood scatter has three
+// clearly distinct eigenvalues, ranked by the smallest one.
+//
+template <typename T>
+void issKeypoints(const T &cloud, const KdTree<typename T::value_type::PointType> &kdtree, vector<int> &keypoints,
+				  float salient_radius, float non_max_radius, float gamma_21 = 0.975, float gamma_32 = 0.975, int min_neighbors = 5)
+{
+	assert(cloud);
+
+	vector<float> response(cloud->points.size(), NO_RESPONSE);
+
+	ISSResponse<T> iss(cloud, kdtree, salient_radius, gamma_21, gamma_32, min_neighbors, response);
+	parallelFor(0, cloud->points.size(), iss, 256);
+
+	suppressKeypoints(cloud, kdtree, non_max_radius, response, keypoints);
+}
+
+template <typename T>
+vector<int> issKeypoints(const T &cloud, float salient_radius, float non_max_radius)
+{
+	KdTree<typename T::value_type::PointType> kdtree(cloud);
+
+	vector<int> keypoints;
+	issKeypoints(cloud, kdtree, keypoints, salient_radius, non_max_radius);
+	return keypoints;
+}
+
+//
+// harris 3d on the normals, needs a cloud with normals
+//
+template <typename T>
+void harrisKeypoints(const T &cloud_with_normals, const KdTree<typename T::value_type::PointType> &kdtree, vector<int> &keypoints,
+					 float radius, float threshold = 0)
+{
+	assert(cloud_with_normals);
+
+	typedef typename T::value_type::PointType PointType;
+
+	keypoints.clear();
+
+	if (!PointNormalAccess<PointType>::enabled)
+	{
+		ofLogError("ofxPCL::harrisKeypoints") << "needs a cloud with normals";
+		return;
+	}
+
+	vector<float> response(cloud_with_normals->points.size(), NO_RESPONSE);
+
+	HarrisResponse<T> harris(cloud_with_normals, kdtree, radius, threshold, response);
+	parallelFor(0, cloud_with_normals->points.size(), harris, 256);
+
+	suppressKeypoints(cloud_with_normals, kdtree, radius, response, keypoints);
+}
+
+template <typename T>
+vector<int> harrisKeypoints(const T &cloud_with_normals, float radius, float threshold = 0)
+{
+	KdTree<typename T::value_type::PointType> kdtree(cloud_with_normals);
+
+	vector<int> keypoints;
+	harrisKeypoints(cloud_with_normals, kdtree, keypoints, radius, threshold);
+	return keypoints;
+}
+
+//
+// uniform keypoints, the point closest to the center of each occupied
+// voxel. unlike downsample() the result indexes the original points.
+//
+template <typename T>
+class VoxelKeys
+{
+public:
+
+	VoxelKeys(const T &cloud, float voxel_size, const Eigen::Vector3f &origin, const Eigen::Vector3i &dims,
+			  vector<std::pair<long long, int> > &keys, vector<float> &distances)
+		: cloud(cloud), voxel_size(voxel_size), origin(origin), dims(dims), keys(keys), distances(distances) {}
+
+	void operator()(int begin, int end)
+	{
+		const float inv_size = 1.f / voxel_size;
+
+		for (int i = begin; i < end; i++)
+		{
+			const Eigen::Vector3f p = cloud->points[i].getVector3fMap();
+
+			if (!pcl_isfinite(p.x()))
+			{
+				keys[i] = std::make_pair(-1LL, i);
+				continue;
+			}
+
+			const Eigen::Vector3f v = (p - origin) * inv_size;
+			const int x = std::min<int>(v.x(), dims.x() - 1);
+			const int y = std::min<int>(v.y(), dims.y() - 1);
+			const int z = std::min<int>(v.z(), dims.z() - 1);
+
+			const Eigen::Vector3f center = origin + (Eigen::Vector3f(x, y, z) + Eigen::Vector3f::Constant(0.5)) * voxel_size;
+
+			keys[i] = std::make_pair(((long long)z * dims.y() + y) * dims.x() + x, i);
+			distances[i] = (p - center).squaredNorm();
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	float voxel_size;
+	Eigen::Vector3f origin;
+	Eigen::Vector3i dims;
+	vector<std::pair<long long, int> > &keys;
+	vector<float> &distances;
+};
+
+template <typename T>
+void uniformKeypoints(const T &cloud, float voxel_size, vector<int> &keypoints)
+{
+	assert(cloud);
+
+	keypoints.clear();
+
+	const int n = cloud->points.size();
+	if (n == 0) return;
+
+	Eigen::Vector3f min_p = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+	Eigen::Vector3f max_p = -min_p;
+
+	for (int i = 0; i < n; i++)
+	{
+		const Eigen::Vector3f p = cloud->points[i].getVector3fMap();
+		if (!pcl_isfinite(p.x())) continue;
+
+		min_p = min_p.cwiseMin(p);
+		max_p = max_p.cwiseMax(p);
+	}
+
+	if (min_p.x() > max_p.x()) return;
+
+	const Eigen::Vector3f extent = (max_p - min_p) / voxel_size;
+	const Eigen::Vector3i dims(extent.x() + 1, extent.y() + 1, extent.z() + 1);
+
+	vector<std::pair<long long, int> > keys(n);
+	vector<float> distances(n, 0);
+
+	VoxelKeys<T> voxel_keys(cloud, voxel_size, min_p, dims, keys, distances);
+	parallelFor(0, n, voxel_keys, 4096);
+
+	std::sort(keys.begin(), keys.end());
+
+	for (int i = 0; i < n;)
+	{
+		const long long key = keys[i].first;
+
+		int best = keys[i].second;
+		int j = i + 1;
+
+		for (; j < n && keys[j].first == key; j++)
+			if (distances[keys[j].second] < distances[best]) best = keys[j].second;
+
+		if (key >= 0) keypoints.push_back(best);
+		i = j;
+	}
+
+	std::sort(keypoints.begin(), keypoints.end());
+}
+
+template <typename T>
+vector<int> uniformKeypoints(const T &cloud, float voxel_size)
+{
+	vector<int> keypoints;
+	uniformKeypoints(cloud, voxel_size, keypoints);
+	return keypoints;
+}
+
+}
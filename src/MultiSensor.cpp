@@ -0,0 +1,537 @@
+#include "MultiSensor.h"
+
+#include "Parallel.h"
+
+#include <Poco/Timestamp.h>
+
+namespace ofxPCL
+{
+
+// grid rows per band, a few of them per camera so that a handful of
+// cameras still spread over all threads
+static const int BAND_ROWS = 32;
+
+// hash buckets the overlap merge sorts independently
+static const int MERGE_BUCKETS = 64;
+
+MultiSensor::MultiSensor()
+	: skip(1)
+	, merge_voxel_size(0)
+	, elapsed_ms(0)
+{
+}
+
+int MultiSensor::addSensor(const CameraIntrinsics &intrinsics, const ofMatrix4x4 &extrinsics)
+{
+	Sensor sensor;
+	sensor.intrinsics = intrinsics;
+	sensor.extrinsics = extrinsics;
+	sensor.has_color_camera = false;
+	sensor.lookup_dirty = true;
+	sensor.color = NULL;
+	sensor.depth = NULL;
+	sensor.mask = NULL;
+	sensor.num_points = 0;
+
+	sensors.push_back(sensor);
+	return sensors.size() - 1;
+}
+
+void MultiSensor::setIntrinsics(int sensor, const CameraIntrinsics &intrinsics)
+{
+	sensors[sensor].intrinsics = intrinsics;
+	sensors[sensor].lookup_dirty = true;
+}
+
+void MultiSensor::setExtrinsics(int sensor, const ofMatrix4x4 &extrinsics)
+{
+	sensors[sensor].extrinsics = extrinsics;
+}
+
+void MultiSensor::setColorCamera(int sensor, const CameraIntrinsics &color, const ofMatrix4x4 &depth_to_color)
+{
+	Sensor &s = sensors[sensor];
+	s.has_color_camera = true;
+	s.color_intrinsics = color;
+	s.depth_to_color = depth_to_color;
+	s.lookup_dirty = true;
+}
+
+void MultiSensor::setSkip(int skip)
+{
+	this->skip = std::max(1, skip);
+
+	for (int i = 0; i < sensors.size(); i++)
+		sensors[i].lookup_dirty = true;
+}
+
+void MultiSensor::setFrame(int sensor, const ofPixels &color, const ofShortPixels &depth)
+{
+	sensors[sensor].color = &color;
+	sensors[sensor].depth = &depth;
+	sensors[sensor].mask = NULL;
+}
+
+void MultiSensor::setFrame(int sensor, const ofPixels &color, const ofShortPixels &depth, const ofPixels &mask)
+{
+	assert(mask.getWidth() == depth.getWidth() && mask.getHeight() == depth.getHeight());
+	assert(mask.getNumChannels() == 1);
+
+	sensors[sensor].color = &color;
+	sensors[sensor].depth = &depth;
+	sensors[sensor].mask = &mask;
+}
+
+void MultiSensor::clearFrames()
+{
+	for (int i = 0; i < sensors.size(); i++)
+	{
+		sensors[i].color = NULL;
+		sensors[i].depth = NULL;
+		sensors[i].mask = NULL;
+	}
+}
+
+//
+// conversion
+//
+struct SensorBand
+{
+	const DepthLookup *lookup;
+	const ofMatrix4x4 *extrinsics;
+	const ofPixels *color;
+	const ofShortPixels *depth;
+	const ofPixels *mask;
+
+	int sensor;
+
+	// grid rows, and where the band's slice of the merged cloud starts
+	int row_begin, row_end;
+	int offset;
+
+	// valid points written to the front of the slice
+	int kept;
+};
+
+class SensorBandConvert
+{
+public:
+
+	SensorBandConvert(vector<SensorBand> &bands, int skip, ColorPointCloud::value_type &cloud, vector<int> *sensor_ids)
+		: bands(bands), skip(skip), cloud(cloud), sensor_ids(sensor_ids) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			run(bands[i]);
+	}
+
+protected:
+
+	vector<SensorBand> &bands;
+	int skip;
+	ColorPointCloud::value_type &cloud;
+	vector<int> *sensor_ids;
+
+	void run(SensorBand &band)
+	{
+		const DepthLookup &lookup = *band.lookup;
+		const ofShortPixels &depth = *band.depth;
+		const ofPixels &color = *band.color;
+
+		const Eigen::Matrix4f m = toEigen(*band.extrinsics);
+		const Eigen::Matrix3f r = m.topLeftCorner<3, 3>();
+		const Eigen::Vector3f t = m.block<3, 1>(0, 3);
+
+		const int width = depth.getWidth();
+		const int grid_width = lookup.getWidth();
+
+		const bool has_color = color.isAllocated();
+
+		int k = band.offset;
+
+		for (int gy = band.row_begin; gy < band.row_end; gy++)
+		{
+			const int y = gy * skip;
+			const unsigned short *depth_row = depth.getPixels() + width * y;
+			const unsigned char *mask_row = band.mask ? band.mask->getPixels() + width * y : NULL;
+
+			for (int gx = 0; gx < grid_width; gx++)
+			{
+				const int x = gx * skip;
+				const unsigned short d = depth_row[x];
+				if (d == 0 || (mask_row && !mask_row[x])) continue;
+
+				// millimeter to meter
+				const float z = d * 0.001;
+				const int i = gy * grid_width + gx;
+				const float *ray = lookup.getRay(i);
+				const Eigen::Vector3f p = r * Eigen::Vector3f(ray[0] * z, ray[1] * z, z) + t;
+
+				ColorPointType &pp = cloud.points[k];
+				pp.x = p.x();
+				pp.y = p.y();
+				pp.z = p.z();
+				pp.r = pp.g = pp.b = has_color ? 0 : 255;
+
+				if (has_color)
+				{
+					const unsigned char *c = lookup.getColor(color, i, x, y, z);
+
+					if (c)
+					{
+						pp.r = c[0];
+						pp.g = c[1];
+						pp.b = c[2];
+					}
+				}
+
+				if (sensor_ids) (*sensor_ids)[k] = band.sensor;
+
+				k++;
+			}
+		}
+
+		band.kept = k - band.offset;
+	}
+};
+
+void MultiSensor::process(ColorPointCloud &cloud)
+{
+	Poco::Timestamp timer;
+
+	if (!cloud)
+		cloud = New<ColorPointCloud>();
+
+	// every sensor gets a slice as large as its grid, the bands compact
+	// the valid points to the front of their part of it
+	vector<SensorBand> bands;
+	int num_points = 0;
+	int num_active = 0;
+
+	for (int i = 0; i < sensors.size(); i++)
+	{
+		Sensor &sensor = sensors[i];
+		sensor.num_points = 0;
+
+		if (!sensor.depth || !sensor.depth->isAllocated()) continue;
+
+		if (sensor.lookup_dirty)
+		{
+			if (sensor.has_color_camera)
+				sensor.lookup.setup(sensor.intrinsics, sensor.color_intrinsics, sensor.depth_to_color, skip);
+			else
+				sensor.lookup.setup(sensor.intrinsics, skip);
+
+			sensor.lookup_dirty = false;
+		}
+
+		const int grid_width = sensor.lookup.getWidth();
+		const int grid_height = sensor.lookup.getHeight();
+
+		// frames smaller than the calibration are left out
+		if (sensor.depth->getWidth() / skip < grid_width || sensor.depth->getHeight() / skip < grid_height) continue;
+
+		for (int row = 0; row < grid_height; row += BAND_ROWS)
+		{
+			SensorBand band;
+			band.lookup = &sensor.lookup;
+			band.extrinsics = &sensor.extrinsics;
+			band.color = sensor.color;
+			band.depth = sensor.depth;
+			band.mask = sensor.mask;
+			band.sensor = i;
+			band.row_begin = row;
+			band.row_end = std::min(grid_height, row + BAND_ROWS);
+			band.offset = num_points + row * grid_width;
+			band.kept = 0;
+			bands.push_back(band);
+		}
+
+		num_points += grid_width * grid_height;
+		num_active++;
+	}
+
+	const bool merge = merge_voxel_size > 0 && num_active > 1;
+
+	cloud->points.resize(num_points);
+
+	vector<int> sensor_ids;
+	if (merge) sensor_ids.resize(num_points);
+
+	SensorBandConvert body(bands, skip, *cloud, merge ? &sensor_ids : NULL);
+	parallelFor(0, bands.size(), body);
+
+	// close the gaps between the bands, in order
+	int size = 0;
+	for (int i = 0; i < bands.size(); i++)
+	{
+		const SensorBand &band = bands[i];
+
+		if (size != band.offset)
+		{
+			std::copy(cloud->points.begin() + band.offset, cloud->points.begin() + band.offset + band.kept, cloud->points.begin() + size);
+			if (merge) std::copy(sensor_ids.begin() + band.offset, sensor_ids.begin() + band.offset + band.kept, sensor_ids.begin() + size);
+		}
+
+		size += band.kept;
+		sensors[band.sensor].num_points += band.kept;
+	}
+
+	cloud->points.resize(size);
+	cloud->width = size;
+	cloud->height = 1;
+	cloud->is_dense = true;
+
+	if (merge)
+	{
+		sensor_ids.resize(size);
+		mergeOverlaps(cloud, sensor_ids);
+	}
+
+	// the frames were only borrowed for this call
+	clearFrames();
+
+	elapsed_ms = timer.elapsed() * 0.001;
+}
+
+//
+// overlap merge
+//
+// the points are hashed into buckets by voxel, every bucket is sorted by
+// voxel on its own, and runs of one voxel holding more than one sensor's
+// points are averaged
+//
+static inline unsigned long long bucketOf(unsigned long long key)
+{
+	return (key * 0x9E3779B97F4A7C15ULL) >> 58;
+}
+
+class VoxelKeyChunks
+{
+public:
+
+	VoxelKeyChunks(const ColorPointCloud::value_type &cloud, float voxel_size, int chunk_size,
+				   vector<unsigned long long> &keys, vector<vector<int> > &counts)
+		: cloud(cloud), inv_size(1. / voxel_size), chunk_size(chunk_size), keys(keys), counts(counts) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			vector<int> &count = counts[c];
+			count.assign(MERGE_BUCKETS, 0);
+
+			const int last = std::min<int>(cloud.points.size(), (c + 1) * chunk_size);
+			for (int i = c * chunk_size; i < last; i++)
+			{
+				const ColorPointType &p = cloud.points[i];
+
+				// 21 bits per axis around the origin
+				const unsigned long long ix = (long long)floorf(p.x * inv_size) + (1 << 20);
+				const unsigned long long iy = (long long)floorf(p.y * inv_size) + (1 << 20);
+				const unsigned long long iz = (long long)floorf(p.z * inv_size) + (1 << 20);
+
+				const unsigned long long mask = (1 << 21) - 1;
+				keys[i] = ((ix & mask) << 42) | ((iy & mask) << 21) | (iz & mask);
+
+				count[bucketOf(keys[i])]++;
+			}
+		}
+	}
+
+protected:
+
+	const ColorPointCloud::value_type &cloud;
+	float inv_size;
+	int chunk_size;
+	vector<unsigned long long> &keys;
+	vector<vector<int> > &counts;
+};
+
+class VoxelKeyScatter
+{
+public:
+
+	VoxelKeyScatter(int num_points, int chunk_size, const vector<unsigned long long> &keys,
+					vector<vector<int> > &offsets, vector<int> &entries)
+		: num_points(num_points), chunk_size(chunk_size), keys(keys), offsets(offsets), entries(entries) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			vector<int> &offset = offsets[c];
+
+			const int last = std::min(num_points, (c + 1) * chunk_size);
+			for (int i = c * chunk_size; i < last; i++)
+				entries[offset[bucketOf(keys[i])]++] = i;
+		}
+	}
+
+protected:
+
+	int num_points;
+	int chunk_size;
+	const vector<unsigned long long> &keys;
+	vector<vector<int> > &offsets;
+	vector<int> &entries;
+};
+
+struct VoxelKeyLess
+{
+	const vector<unsigned long long> &keys;
+
+	VoxelKeyLess(const vector<unsigned long long> &keys) : keys(keys) {}
+
+	bool operator()(int a, int b) const
+	{
+		return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+	}
+};
+
+class VoxelBucketMerge
+{
+public:
+
+	VoxelBucketMerge(const ColorPointCloud::value_type &cloud, const vector<int> &sensor_ids, const vector<unsigned long long> &keys,
+					 const vector<int> &bucket_begin, vector<int> &entries, vector<ColorPointCloud> &outputs)
+		: cloud(cloud), sensor_ids(sensor_ids), keys(keys), bucket_begin(bucket_begin), entries(entries), outputs(outputs) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int b = begin; b < end; b++)
+			run(b);
+	}
+
+protected:
+
+	const ColorPointCloud::value_type &cloud;
+	const vector<int> &sensor_ids;
+	const vector<unsigned long long> &keys;
+	const vector<int> &bucket_begin;
+	vector<int> &entries;
+	vector<ColorPointCloud> &outputs;
+
+	void run(int bucket)
+	{
+		vector<int>::iterator first = entries.begin() + bucket_begin[bucket];
+		vector<int>::iterator last = entries.begin() + bucket_begin[bucket + 1];
+
+		std::sort(first, last, VoxelKeyLess(keys));
+
+		ColorPointCloud output = New<ColorPointCloud>();
+		output->points.reserve(last - first);
+
+		while (first != last)
+		{
+			// one voxel
+			vector<int>::iterator run_end = first + 1;
+			bool shared = false;
+
+			while (run_end != last && keys[*run_end] == keys[*first])
+			{
+				if (sensor_ids[*run_end] != sensor_ids[*first]) shared = true;
+				run_end++;
+			}
+
+			if (!shared)
+			{
+				for (vector<int>::iterator it = first; it != run_end; it++)
+					output->points.push_back(cloud.points[*it]);
+			}
+			else
+			{
+				Eigen::Vector3f position(0, 0, 0);
+				Eigen::Vector3f color(0, 0, 0);
+
+				for (vector<int>::iterator it = first; it != run_end; it++)
+				{
+					const ColorPointType &p = cloud.points[*it];
+					position += Eigen::Vector3f(p.x, p.y, p.z);
+					color += Eigen::Vector3f(p.r, p.g, p.b);
+				}
+
+				const float inv_n = 1. / (run_end - first);
+				position *= inv_n;
+				color *= inv_n;
+
+				ColorPointType p = cloud.points[*first];
+				p.x = position.x();
+				p.y = position.y();
+				p.z = position.z();
+				p.r = color.x() + 0.5f;
+				p.g = color.y() + 0.5f;
+				p.b = color.z() + 0.5f;
+
+				output->points.push_back(p);
+			}
+
+			first = run_end;
+		}
+
+		outputs[bucket] = output;
+	}
+};
+
+void MultiSensor::mergeOverlaps(ColorPointCloud &cloud, const vector<int> &sensor_ids)
+{
+	const int num_points = cloud->points.size();
+	if (num_points == 0) return;
+
+	const int chunk_size = 65536;
+	const int num_chunks = (num_points + chunk_size - 1) / chunk_size;
+
+	vector<unsigned long long> keys(num_points);
+	vector<vector<int> > counts(num_chunks);
+
+	VoxelKeyChunks key_body(*cloud, merge_voxel_size, chunk_size, keys, counts);
+	parallelFor(0, num_chunks, key_body);
+
+	// buckets are contiguous, the chunks keep their order inside them
+	vector<int> bucket_begin(MERGE_BUCKETS + 1, 0);
+	vector<vector<int> > &offsets = counts;
+	int offset = 0;
+
+	for (int b = 0; b < MERGE_BUCKETS; b++)
+	{
+		bucket_begin[b] = offset;
+
+		for (int c = 0; c < num_chunks; c++)
+		{
+			const int n = counts[c][b];
+			offsets[c][b] = offset;
+			offset += n;
+		}
+	}
+
+	bucket_begin[MERGE_BUCKETS] = offset;
+
+	vector<int> entries(num_points);
+
+	VoxelKeyScatter scatter_body(num_points, chunk_size, keys, offsets, entries);
+	parallelFor(0, num_chunks, scatter_body);
+
+	vector<ColorPointCloud> outputs(MERGE_BUCKETS);
+
+	VoxelBucketMerge merge_body(*cloud, sensor_ids, keys, bucket_begin, entries, outputs);
+	parallelFor(0, MERGE_BUCKETS, merge_body);
+
+	int size = 0;
+	for (int b = 0; b < MERGE_BUCKETS; b++)
+		size += outputs[b]->points.size();
+
+	cloud->points.resize(size);
+
+	int k = 0;
+	for (int b = 0; b < MERGE_BUCKETS; b++)
+	{
+		std::copy(outputs[b]->points.begin(), outputs[b]->points.end(), cloud->points.begin() + k);
+		k += outputs[b]->points.size();
+	}
+
+	cloud->width = size;
+	cloud->height = 1;
+}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Types.h"
+#include "Utility.h"
+#include "DepthLookup.h"
+
+namespace ofxPCL
+{
+
+//
+// multi sensor front end
+//
+// turns the frames of several depth cameras into one cloud in the rig's
+// space. every camera's pixels are back projected through its DepthLookup,
+// so undistorted and with their color registered, and transformed by its
+// extrinsics in one pass, in row bands spread over the thread pool, and
+// written straight into that camera's slice of the merged cloud. with a
+// merge voxel size, voxels seen by more than one camera are averaged into
+// a single point, which thins out the overlaps without touching the parts
+// only one camera sees.
+//
+class MultiSensor
+{
+public:
+
+	MultiSensor();
+
+	// `extrinsics` takes the camera's points into the rig's space. returns
+	// the sensor index
+	int addSensor(const CameraIntrinsics &intrinsics, const ofMatrix4x4 &extrinsics);
+	int getNumSensors() const { return sensors.size(); }
+
+	void setIntrinsics(int sensor, const CameraIntrinsics &intrinsics);
+	void setExtrinsics(int sensor, const ofMatrix4x4 &extrinsics);
+
+	// for color images that aren't registered to the depth images,
+	// `depth_to_color` takes points from the depth camera's space into the
+	// color camera's
+	void setColorCamera(int sensor, const CameraIntrinsics &color, const ofMatrix4x4 &depth_to_color);
+
+	const CameraIntrinsics& getIntrinsics(int sensor) const { return sensors[sensor].intrinsics; }
+	const ofMatrix4x4& getExtrinsics(int sensor) const { return sensors[sensor].extrinsics; }
+
+	// every `skip`-th pixel in both directions
+	void setSkip(int skip);
+	int getSkip() const { return skip; }
+
+	// 0 keeps the overlaps as they are
+	void setMergeVoxelSize(float size) { merge_voxel_size = size; }
+	float getMergeVoxelSize() const { return merge_voxel_size; }
+
+	// the frames are only referenced and have to stay alive until process()
+	// returns, which forgets them, so set them again before every call.
+	// `color` may be unallocated, the points are white then. sensors
+	// without a frame are left out of process()
+	void setFrame(int sensor, const ofPixels &color, const ofShortPixels &depth);
+
+	// only the pixels `mask` marks become points, e.g. the foreground of a
+	// DepthBackground
+	void setFrame(int sensor, const ofPixels &color, const ofShortPixels &depth, const ofPixels &mask);
+
+	void clearFrames();
+
+	// merges the current frames into `cloud`, without invalid points
+	void process(ColorPointCloud &cloud);
+
+	// points each sensor contributed to the last cloud before merging
+	int getNumPoints(int sensor) const { return sensors[sensor].num_points; }
+
+	float getElapsedMs() const { return elapsed_ms; }
+
+protected:
+
+	struct Sensor
+	{
+		CameraIntrinsics intrinsics;
+		ofMatrix4x4 extrinsics;
+
+		bool has_color_camera;
+		CameraIntrinsics color_intrinsics;
+		ofMatrix4x4 depth_to_color;
+
+		// rebuilt by process() after a calibration change
+		DepthLookup lookup;
+		bool lookup_dirty;
+
+		const ofPixels *color;
+		const ofShortPixels *depth;
+		const ofPixels *mask;
+
+		int num_points;
+	};
+
+	vector<Sensor> sensors;
+
+	int skip;
+	float merge_voxel_size;
+	float elapsed_ms;
+
+	void mergeOverlaps(ColorPointCloud &cloud, const vector<int> &sensor_ids);
+};
+
+}
@@ -0,0 +1,478 @@
+#include "Odometry.h"
+
+#include "ofxPCL.h"
+
+#include <Poco/Timestamp.h>
+
+namespace ofxPCL
+{
+
+typedef RGBDOdometry::Level Level;
+
+template <typename T>
+class OdometryInput
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	OdometryInput(const T &cloud, Level &level) : cloud(cloud), level(level) {}
+
+	void operator()(int begin, int end)
+	{
+		const float inv_byte = 1. / (255. * 3.);
+
+		for (int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < level.width; x++)
+			{
+				const int i = y * level.width + x;
+				const PointType &p = cloud->points[i];
+
+				level.intensity[i] = (p.r + p.g + p.b) * inv_byte;
+
+				if (!pcl_isfinite(p.z) || p.z <= 0)
+				{
+					level.vertices[i].setZero();
+					level.normals[i].setZero();
+					continue;
+				}
+
+				level.vertices[i] = p.getVector3fMap();
+
+				// facing the camera, like the computed ones
+				Eigen::Vector3f n = PointNormalAccess<PointType>::get(p);
+				if (!pcl_isfinite(n.x())) n.setZero();
+				if (n.dot(level.vertices[i]) > 0) n = -n;
+				level.normals[i] = n;
+			}
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	Level &level;
+};
+
+// 2x2 average, points across a depth discontinuity are left out
+class OdometryDownsample
+{
+public:
+
+	OdometryDownsample(const Level &src, Level &dst, float max_distance)
+		: src(src), dst(dst), max_distance(max_distance) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < dst.width; x++)
+			{
+				const int i = y * dst.width + x;
+				const int j = (y * 2) * src.width + x * 2;
+				const int samples[4] = { j, j + 1, j + src.width, j + src.width + 1 };
+
+				dst.intensity[i] = (src.intensity[samples[0]] + src.intensity[samples[1]]
+									+ src.intensity[samples[2]] + src.intensity[samples[3]]) * 0.25f;
+
+				const Eigen::Vector3f *reference = NULL;
+				for (int k = 0; k < 4 && !reference; k++)
+					if (src.vertices[samples[k]].z() > 0) reference = &src.vertices[samples[k]];
+
+				Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+				int count = 0;
+
+				if (reference)
+				{
+					for (int k = 0; k < 4; k++)
+					{
+						const Eigen::Vector3f &v = src.vertices[samples[k]];
+						if (v.z() > 0 && fabsf(v.z() - reference->z()) < max_distance)
+						{
+							sum += v;
+							count++;
+						}
+					}
+				}
+
+				dst.vertices[i] = count > 0 ? Eigen::Vector3f(sum / count) : Eigen::Vector3f::Zero();
+			}
+		}
+	}
+
+protected:
+
+	const Level &src;
+	Level &dst;
+	float max_distance;
+};
+
+class OdometryNormals
+{
+public:
+
+	OdometryNormals(Level &level, bool compute_normals, bool compute_gradients)
+		: level(level), compute_normals(compute_normals), compute_gradients(compute_gradients) {}
+
+	void operator()(int begin, int end)
+	{
+		const int w = level.width;
+		const int h = level.height;
+
+		for (int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				const int i = y * w + x;
+				const bool inside = x > 0 && y > 0 && x + 1 < w && y + 1 < h;
+
+				if (compute_gradients)
+				{
+					level.gradient_x[i] = inside ? (level.intensity[i + 1] - level.intensity[i - 1]) * 0.5f : 0;
+					level.gradient_y[i] = inside ? (level.intensity[i + w] - level.intensity[i - w]) * 0.5f : 0;
+				}
+
+				if (!compute_normals) continue;
+
+				Eigen::Vector3f &n = level.normals[i];
+				n.setZero();
+
+				if (!inside || level.vertices[i].z() <= 0) continue;
+
+				const Eigen::Vector3f &l = level.vertices[i - 1];
+				const Eigen::Vector3f &r = level.vertices[i + 1];
+				const Eigen::Vector3f &u = level.vertices[i - w];
+				const Eigen::Vector3f &d = level.vertices[i + w];
+
+				if (l.z() <= 0 || r.z() <= 0 || u.z() <= 0 || d.z() <= 0) continue;
+
+				n = (r - l).cross(d - u);
+
+				const float length = n.norm();
+				if (length <= 0) continue;
+
+				n /= length;
+				if (n.dot(level.vertices[i]) > 0) n = -n;
+			}
+		}
+	}
+
+protected:
+
+	Level &level;
+	bool compute_normals, compute_gradients;
+};
+
+struct OdometryAccumulator
+{
+	Eigen::Matrix<double, 6, 6> AtA;
+	Eigen::Matrix<double, 6, 1> Atb;
+	double error;
+	int count;
+
+	OdometryAccumulator() { clear(); }
+
+	void clear()
+	{
+		AtA.setZero();
+		Atb.setZero();
+		error = 0;
+		count = 0;
+	}
+
+	void add(const OdometryAccumulator &o)
+	{
+		AtA += o.AtA;
+		Atb += o.Atb;
+		error += o.error;
+		count += o.count;
+	}
+};
+
+static inline float bilinear(const vector<float> &image, int width, float u, float v)
+{
+	const int x = u, y = v;
+	const float a = u - x, b = v - y;
+	const float *p = &image[y * width + x];
+	return (p[0] * (1 - a) + p[1] * a) * (1 - b) + (p[width] * (1 - a) + p[width + 1] * a) * b;
+}
+
+//
+// projective association and the normal equations, summed per row range
+//
+class OdometryReduction
+{
+public:
+
+	OdometryReduction(const Level &current, const Level &previous, const Eigen::Affine3f &transform,
+					  const CameraIntrinsics &intrinsics, const OdometryParams &params)
+		: current(current), previous(previous), transform(transform), intrinsics(intrinsics), params(params) {}
+
+	void operator()(int begin, int end, OdometryAccumulator &local)
+	{
+		const float max_distance = params.max_distance * params.max_distance;
+		const float min_cos = cosf(ofDegToRad(params.max_normal_angle));
+		const float photometric_weight = params.photometric_weight;
+
+		const Eigen::Matrix3f R = transform.linear();
+		const Eigen::Vector3f t = transform.translation();
+
+		const bool distortion = intrinsics.hasDistortion();
+
+		Eigen::Matrix<double, 6, 1> J;
+
+		for (int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < current.width; x++)
+			{
+				const int i = y * current.width + x;
+
+				const Eigen::Vector3f &v = current.vertices[i];
+				const Eigen::Vector3f &vn = current.normals[i];
+				if (v.z() <= 0 || vn.squaredNorm() == 0) continue;
+
+				const Eigen::Vector3f p = R * v + t;
+				if (p.z() <= 0) continue;
+
+				const float inv_z = 1. / p.z();
+				float px = p.x() * inv_z;
+				float py = p.y() * inv_z;
+
+				// the organized clouds of a DepthLookup are undistorted, their
+				// grid is still the one of the distorted image
+				if (distortion) intrinsics.distort(px, py);
+
+				const float uf = px * previous.fx + previous.cx;
+				const float vf = py * previous.fy + previous.cy;
+
+				const int u = uf + 0.5f;
+				const int w = vf + 0.5f;
+				if (uf < 0 || vf < 0 || u >= previous.width - 1 || w >= previous.height - 1) continue;
+
+				const int j = w * previous.width + u;
+				const Eigen::Vector3f &q = previous.vertices[j];
+				const Eigen::Vector3f &n = previous.normals[j];
+				if (q.z() <= 0 || n.squaredNorm() == 0) continue;
+
+				if ((p - q).squaredNorm() > max_distance) continue;
+				if ((R * vn).dot(n) < min_cos) continue;
+
+				// point to plane, residual (p - q).n with jacobian [p x n, n]
+				const Eigen::Vector3d pd = p.cast<double>();
+				const Eigen::Vector3d nd = n.cast<double>();
+				const double r = (pd - q.cast<double>()).dot(nd);
+
+				J.head<3>() = pd.cross(nd);
+				J.tail<3>() = nd;
+
+				local.AtA += J * J.transpose();
+				local.Atb -= J * r;
+				local.error += r * r;
+				local.count++;
+
+				if (photometric_weight <= 0) continue;
+
+				// intensity difference at the projection, chained through the
+				// pinhole projection to the motion. the lens distortion is left
+				// out of the jacobian
+				const float residual = bilinear(previous.intensity, previous.width, uf, vf) - current.intensity[i];
+				const float gx = bilinear(previous.gradient_x, previous.width, uf, vf) * previous.fx;
+				const float gy = bilinear(previous.gradient_y, previous.width, uf, vf) * previous.fy;
+
+				const Eigen::Vector3d g(gx * inv_z, gy * inv_z, -(gx * p.x() + gy * p.y()) * inv_z * inv_z);
+
+				J.head<3>() = pd.cross(g);
+				J.tail<3>() = g;
+
+				local.AtA += photometric_weight * J * J.transpose();
+				local.Atb -= photometric_weight * J * residual;
+			}
+		}
+	}
+
+	void join(OdometryAccumulator &result, const OdometryAccumulator &partial)
+	{
+		result.add(partial);
+	}
+
+protected:
+
+	const Level &current;
+	const Level &previous;
+	const Eigen::Affine3f &transform;
+	const CameraIntrinsics &intrinsics;
+	const OdometryParams &params;
+};
+
+RGBDOdometry::RGBDOdometry(const OdometryParams &params)
+	: params(params)
+	, pose(Eigen::Affine3f::Identity())
+	, has_previous(false)
+{
+}
+
+void RGBDOdometry::reset()
+{
+	pose = Eigen::Affine3f::Identity();
+	has_previous = false;
+}
+
+ofMatrix4x4 RGBDOdometry::getPose() const
+{
+	return toOF(pose.matrix());
+}
+
+void RGBDOdometry::setPose(const ofMatrix4x4 &m)
+{
+	pose = Eigen::Affine3f(toEigen(m));
+}
+
+OdometryResult RGBDOdometry::update(const ColorPointCloud &frame, int skip)
+{
+	return track(frame, skip);
+}
+
+OdometryResult RGBDOdometry::update(const ColorNormalPointCloud &frame, int skip)
+{
+	return track(frame, skip);
+}
+
+void RGBDOdometry::buildPyramid(vector<Level> &pyramid, bool has_normals)
+{
+	const bool photometric = params.photometric_weight > 0;
+
+	for (int l = 0; l < pyramid.size(); l++)
+	{
+		Level &level = pyramid[l];
+
+		if (l > 0)
+		{
+			OdometryDownsample downsample(pyramid[l - 1], level, params.max_distance);
+			parallelFor(0, level.height, downsample, 8);
+		}
+
+		const bool compute_normals = l > 0 || !has_normals;
+
+		if (photometric)
+		{
+			level.gradient_x.resize(level.vertices.size());
+			level.gradient_y.resize(level.vertices.size());
+		}
+
+		if (compute_normals || photometric)
+		{
+			OdometryNormals normals(level, compute_normals, photometric);
+			parallelFor(0, level.height, normals, 8);
+		}
+	}
+}
+
+template <typename T>
+OdometryResult RGBDOdometry::track(const T &frame, int skip)
+{
+	assert(frame);
+	assert(frame->isOrganized());
+
+	typedef typename T::value_type::PointType PointType;
+
+	Poco::Timestamp timer;
+	OdometryResult result;
+
+	const int num_levels = std::max<int>(1, params.iterations.size());
+
+	// intrinsics of the organized cloud, halved per level with pixel
+	// centers at the middle of each 2x2 block
+	current.resize(num_levels);
+
+	for (int l = 0; l < num_levels; l++)
+	{
+		Level &level = current[l];
+		const float scale = 1. / (1 << l);
+
+		level.width = std::max(1, (int)(frame->width >> l));
+		level.height = std::max(1, (int)(frame->height >> l));
+		level.fx = intrinsics.fx * scale / skip;
+		level.fy = intrinsics.fy * scale / skip;
+		level.cx = (intrinsics.cx / skip + 0.5f) * scale - 0.5f;
+		level.cy = (intrinsics.cy / skip + 0.5f) * scale - 0.5f;
+
+		const int size = level.width * level.height;
+		level.vertices.resize(size);
+		level.normals.resize(size);
+		level.intensity.resize(size);
+	}
+
+	OdometryInput<T> input(frame, current[0]);
+	parallelFor(0, current[0].height, input, 8);
+
+	buildPyramid(current, PointNormalAccess<PointType>::enabled);
+
+	if (!has_previous || previous.size() != current.size()
+		|| previous[0].width != current[0].width || previous[0].height != current[0].height)
+	{
+		previous.swap(current);
+		has_previous = true;
+		result.valid = true;
+		result.elapsed_ms = timer.elapsed() * 0.001;
+		return result;
+	}
+
+	Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+	OdometryAccumulator sums;
+	bool valid = true;
+
+	for (int l = num_levels - 1; l >= 0 && valid; l--)
+	{
+		for (int iteration = 0; iteration < params.iterations[l]; iteration++)
+		{
+			OdometryReduction reduction(current[l], previous[l], transform, intrinsics, params);
+			sums = parallelReduce(0, current[l].height, OdometryAccumulator(), reduction, 4);
+
+			if (sums.count < 6)
+			{
+				valid = l > 0;
+				break;
+			}
+
+			// slight damping, directions the first association barely
+			// constrains would otherwise take huge steps
+			Eigen::Matrix<double, 6, 6> A = sums.AtA;
+			A.diagonal().array() += A.trace() * 1e-4;
+
+			const Eigen::Matrix<double, 6, 1> x = A.ldlt().solve(sums.Atb);
+			if (!pcl_isfinite(x[0]))
+			{
+				valid = false;
+				break;
+			}
+
+			Eigen::Affine3f delta = Eigen::Affine3f::Identity();
+			delta.linear() = (Eigen::AngleAxisf(x[2], Eigen::Vector3f::UnitZ())
+							  * Eigen::AngleAxisf(x[1], Eigen::Vector3f::UnitY())
+							  * Eigen::AngleAxisf(x[0], Eigen::Vector3f::UnitX())).toRotationMatrix();
+			delta.translation() = x.tail<3>().cast<float>();
+
+			transform = delta * transform;
+
+			if (x.norm() < 1e-6) break;
+		}
+	}
+
+	result.valid = valid;
+	result.num_correspondences = sums.count;
+	result.residual = sums.count > 0 ? sqrt(sums.error / sums.count) : 0;
+
+	if (valid)
+	{
+		result.transform = toOF(transform.matrix());
+		pose = pose * transform;
+	}
+
+	previous.swap(current);
+
+	result.elapsed_ms = timer.elapsed() * 0.001;
+	return result;
+}
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Types.h"
+#include "Utility.h"
+
+namespace ofxPCL
+{
+
+//
+// rgb-d odometry
+//
+// frame to frame camera tracking on the organized clouds convert() or a
+// DepthLookup make from depth images. points are associated by projecting them into the
+// previous frame instead of searching a kd-tree, and the point to plane
+// error is minimized coarse to fine over an image pyramid. an optional
+// photometric term also pulls the colors into alignment, which helps on
+// flat geometry.
+//
+struct OdometryParams
+{
+	// gauss-newton iterations per pyramid level, finest level first
+	vector<int> iterations;
+
+	// associated points farther apart are rejected, in meters
+	float max_distance;
+
+	// degrees, associated points whose normals differ more are rejected
+	float max_normal_angle;
+
+	// weight of the intensity residuals (0 to 1 per channel) against the
+	// point to plane ones (meters), 0 disables the photometric term
+	float photometric_weight;
+
+	OdometryParams()
+		: max_distance(0.1)
+		, max_normal_angle(30)
+		, photometric_weight(0)
+	{
+		iterations.push_back(4);
+		iterations.push_back(5);
+		iterations.push_back(10);
+	}
+};
+
+struct OdometryResult
+{
+	// camera motion, maps the new frame into the previous one
+	ofMatrix4x4 transform;
+
+	bool valid;
+	int num_correspondences;
+
+	// rms point to plane distance at the finest level
+	float residual;
+
+	float elapsed_ms;
+
+	OdometryResult() : valid(false), num_correspondences(0), residual(0), elapsed_ms(0) {}
+};
+
+class RGBDOdometry
+{
+public:
+
+	// `pose` is a fixed size eigen type, heap allocated instances need it
+	// aligned
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	// one pyramid level of a frame, invalid vertices and normals are zero
+	struct Level
+	{
+		int width, height;
+		float fx, fy, cx, cy;
+
+		vector<Eigen::Vector3f> vertices;
+		vector<Eigen::Vector3f> normals;
+		vector<float> intensity;
+		vector<float> gradient_x, gradient_y;
+	};
+
+	RGBDOdometry(const OdometryParams &params = OdometryParams());
+
+	void setParams(const OdometryParams &p) { params = p; }
+	const OdometryParams& getParams() const { return params; }
+
+	// the ones the clouds were converted with, the default is the kinect's
+	void setIntrinsics(const CameraIntrinsics &intrinsics) { this->intrinsics = intrinsics; }
+	const CameraIntrinsics& getIntrinsics() const { return intrinsics; }
+
+	// forgets the previous frame and resets the pose
+	void reset();
+
+	// tracks `frame` against the previous one. `skip` must be the one the
+	// cloud was converted with. the first frame only initializes.
+	OdometryResult update(const ColorPointCloud &frame, int skip = 1);
+	OdometryResult update(const ColorNormalPointCloud &frame, int skip = 1);
+
+	// accumulated camera to world transform
+	ofMatrix4x4 getPose() const;
+	void setPose(const ofMatrix4x4 &pose);
+
+	bool hasPreviousFrame() const { return has_previous; }
+
+protected:
+
+	OdometryParams params;
+	CameraIntrinsics intrinsics;
+
+	Eigen::Affine3f pose;
+
+	bool has_previous;
+	vector<Level> previous, current;
+
+	template <typename T>
+	OdometryResult track(const T &frame, int skip);
+
+	void buildPyramid(vector<Level> &pyramid, bool has_normals);
+};
+
+}
@@ -0,0 +1,410 @@
+#include "Parallel.h"
+
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+#include "Poco/Condition.h"
+#include "Poco/Environment.h"
+
+#if defined(TARGET_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(TARGET_OSX)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#elif defined(TARGET_WIN32)
+#include <windows.h>
+#endif
+
+namespace ofxPCL
+{
+
+// ranges of one parallelFor call
+struct ParallelJob
+{
+	int pending;
+	ofMutex mutex;
+	Poco::Condition done;
+};
+
+struct ParallelTask
+{
+	ParallelBody *body;
+	int begin, end;
+	ParallelJob *job;
+};
+
+class ParallelDeque
+{
+public:
+
+	void push(const ParallelTask &task)
+	{
+		ofMutex::ScopedLock lock(mutex);
+		tasks.push_back(task);
+	}
+
+	// the owner takes the newest range, its data is most likely still cached
+	bool pop(ParallelTask &task)
+	{
+		ofMutex::ScopedLock lock(mutex);
+		if (tasks.empty()) return false;
+
+		task = tasks.back();
+		tasks.pop_back();
+		return true;
+	}
+
+	// thieves take the oldest
+	bool steal(ParallelTask &task)
+	{
+		ofMutex::ScopedLock lock(mutex);
+		if (tasks.empty()) return false;
+
+		task = tasks.front();
+		tasks.pop_front();
+		return true;
+	}
+
+protected:
+
+	std::deque<ParallelTask> tasks;
+	ofMutex mutex;
+};
+
+static void pinThread(int core)
+{
+	const int num_cores = std::max<int>(1, Poco::Environment::processorCount());
+	core %= num_cores;
+
+#if defined(TARGET_LINUX)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(TARGET_OSX)
+	thread_affinity_policy_data_t policy = { core + 1 };
+	thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+#elif defined(TARGET_WIN32)
+	SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#endif
+}
+
+class ParallelPool
+{
+public:
+
+	ParallelPool() : num_threads(0), affinity(false), workers_pinned(false), stopping(false), epoch(0), active_jobs(0) {}
+	~ParallelPool() { stopWorkers(); }
+
+	int getNumThreads()
+	{
+		ofMutex::ScopedLock lock(config_mutex);
+		return resolvedNumThreads();
+	}
+
+	void setNumThreads(int n)
+	{
+		ofMutex::ScopedLock lock(config_mutex);
+		num_threads = n;
+	}
+
+	void setAffinity(bool enabled)
+	{
+		ofMutex::ScopedLock lock(config_mutex);
+		affinity = enabled;
+	}
+
+	bool getAffinity()
+	{
+		ofMutex::ScopedLock lock(config_mutex);
+		return affinity;
+	}
+
+	void run(int begin, int end, ParallelBody &body, int grain_size)
+	{
+		const int count = end - begin;
+		if (count <= 0) return;
+
+		grain_size = std::max(1, grain_size);
+
+		const int threads = prepare();
+
+		// a few ranges per thread so stealing can even out uneven ranges
+		const int num_ranges = std::min(threads * 4, (count + grain_size - 1) / grain_size);
+		if (threads <= 1 || num_ranges <= 1)
+		{
+			finish();
+			body(begin, end);
+			return;
+		}
+
+		const int step = (count + num_ranges - 1) / num_ranges;
+
+		ParallelJob job;
+		job.pending = (count + step - 1) / step;
+
+		// workers push to their own deque, other threads to the shared one
+		const int self = currentWorker();
+		ParallelDeque &deque = self >= 0 ? *deques[self] : *deques.back();
+
+		for (int b = begin; b < end; b += step)
+		{
+			ParallelTask task;
+			task.body = &body;
+			task.begin = b;
+			task.end = std::min(end, b + step);
+			task.job = &job;
+			deque.push(task);
+		}
+
+		notify();
+
+		// help until all ranges of this job are done
+		while (true)
+		{
+			{
+				ofMutex::ScopedLock lock(job.mutex);
+				if (job.pending == 0) break;
+			}
+
+			ParallelTask task;
+			if (deque.pop(task) || steal(self, task))
+			{
+				execute(task);
+				continue;
+			}
+
+			ofMutex::ScopedLock lock(job.mutex);
+			if (job.pending > 0) job.done.tryWait(job.mutex, 1);
+		}
+
+		finish();
+	}
+
+	void work(int index)
+	{
+		if (getAffinity()) pinThread(index + 1);
+
+		while (true)
+		{
+			int seen;
+			{
+				ofMutex::ScopedLock lock(sleep_mutex);
+				if (stopping) return;
+				seen = epoch;
+			}
+
+			ParallelTask task;
+			if (deques[index]->pop(task) || steal(index, task))
+			{
+				execute(task);
+				continue;
+			}
+
+			// nothing was pushed since the deques were checked, sleep until
+			// something is
+			ofMutex::ScopedLock lock(sleep_mutex);
+			if (!stopping && epoch == seen) wake.tryWait(sleep_mutex, 100);
+		}
+	}
+
+protected:
+
+	class Worker : public Poco::Runnable
+	{
+	public:
+		Worker(ParallelPool &pool, int index) : pool(pool), index(index) {}
+		void run() { pool.work(index); }
+
+	protected:
+		ParallelPool &pool;
+		int index;
+	};
+
+	int num_threads;
+	bool affinity;
+	ofMutex config_mutex;
+
+	// one per worker, then the shared one
+	vector<ParallelDeque*> deques;
+	vector<Worker*> workers;
+	vector<Poco::Thread*> threads;
+	bool workers_pinned;
+
+	bool stopping;
+	int epoch;
+	ofMutex sleep_mutex;
+	Poco::Condition wake;
+
+	int active_jobs;
+	ofMutex jobs_mutex;
+
+	int resolvedNumThreads() const
+	{
+		return num_threads > 0 ? num_threads : std::max<int>(1, Poco::Environment::processorCount());
+	}
+
+	// starts or resizes the workers when no job is running, returns the
+	// number of threads to split for
+	int prepare()
+	{
+		int wanted;
+		bool pin;
+		{
+			ofMutex::ScopedLock lock(config_mutex);
+			wanted = resolvedNumThreads();
+			pin = affinity;
+		}
+
+		ofMutex::ScopedLock lock(jobs_mutex);
+
+		if ((wanted - 1 != threads.size() || (pin && !workers_pinned)) && active_jobs == 0)
+		{
+			stopWorkers();
+			startWorkers(wanted - 1, pin);
+		}
+
+		active_jobs++;
+		return threads.size() + 1;
+	}
+
+	void finish()
+	{
+		ofMutex::ScopedLock lock(jobs_mutex);
+		active_jobs--;
+	}
+
+	void startWorkers(int n, bool pin)
+	{
+		stopping = false;
+		workers_pinned = pin;
+
+		for (int i = 0; i < n; i++)
+			deques.push_back(new ParallelDeque);
+		deques.push_back(new ParallelDeque);
+
+		for (int i = 0; i < n; i++)
+		{
+			workers.push_back(new Worker(*this, i));
+			threads.push_back(new Poco::Thread);
+			threads.back()->start(*workers.back());
+		}
+	}
+
+	void stopWorkers()
+	{
+		{
+			ofMutex::ScopedLock lock(sleep_mutex);
+			stopping = true;
+			wake.broadcast();
+		}
+
+		for (int i = 0; i < threads.size(); i++)
+		{
+			threads[i]->join();
+			delete threads[i];
+			delete workers[i];
+		}
+
+		for (int i = 0; i < deques.size(); i++)
+			delete deques[i];
+
+		threads.clear();
+		workers.clear();
+		deques.clear();
+	}
+
+	int currentWorker() const
+	{
+		Poco::Thread *current = Poco::Thread::current();
+		if (!current) return -1;
+
+		for (int i = 0; i < threads.size(); i++)
+			if (threads[i] == current) return i;
+
+		return -1;
+	}
+
+	bool steal(int self, ParallelTask &task)
+	{
+		const int n = deques.size();
+		const int start = self >= 0 ? self + 1 : 0;
+
+		for (int i = 0; i < n; i++)
+		{
+			const int victim = (start + i) % n;
+			if (victim == self) continue;
+			if (deques[victim]->steal(task)) return true;
+		}
+
+		return false;
+	}
+
+	void notify()
+	{
+		ofMutex::ScopedLock lock(sleep_mutex);
+		epoch++;
+		wake.broadcast();
+	}
+
+	static void execute(const ParallelTask &task)
+	{
+		(*task.body)(task.begin, task.end);
+
+		ofMutex::ScopedLock lock(task.job->mutex);
+		if (--task.job->pending == 0) task.job->done.broadcast();
+	}
+};
+
+static ParallelPool& getPool()
+{
+	static ParallelPool pool;
+	return pool;
+}
+
+int getNumThreads()
+{
+	return getPool().getNumThreads();
+}
+
+void setNumThreads(int n)
+{
+	getPool().setNumThreads(n);
+}
+
+void setThreadAffinity(bool enabled)
+{
+	getPool().setAffinity(enabled);
+}
+
+bool getThreadAffinity()
+{
+	return getPool().getAffinity();
+}
+
+void parallelFor(int begin, int end, ParallelBody &body, int grain_size)
+{
+	getPool().run(begin, end, body, grain_size);
+}
+
+//
+// deadline
+//
+Deadline::Deadline(float budget_ms) : budget_ms(budget_ms), cancelled(false)
+{
+}
+
+bool Deadline::expired() const
+{
+	if (cancelled) return true;
+	return budget_ms > 0 && start.elapsed() * 0.001 >= budget_ms;
+}
+
+void Deadline::reset()
+{
+	start.update();
+	cancelled = false;
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <Poco/Timestamp.h>
+
+namespace ofxPCL
+{
+
+//
+// parallel
+//
+// all parallel work of the addon goes through one pool of worker threads,
+// so algorithms that run at the same time (e.g. on pipeline stages) share
+// the cores instead of each starting their own threads. every worker has a
+// deque of ranges, takes the newest of its own and steals the oldest of the
+// others when it runs dry. a thread that waits for its ranges runs queued
+// ones meanwhile, so nested parallel calls don't deadlock.
+//
+class ParallelBody
+{
+public:
+	virtual ~ParallelBody() {}
+	virtual void operator()(int begin, int end) = 0;
+};
+
+// the calling thread counts as one, so the pool has one worker less
+int getNumThreads();
+
+// 0 for one per core. resizing waits until no parallel work is running
+void setNumThreads(int num_threads);
+
+// pins worker i to core i + 1, the calling thread keeps core 0. it is only
+// a hint on osx
+void setThreadAffinity(bool enabled);
+bool getThreadAffinity();
+
+// splits [begin, end) into ranges of at least `grain_size` and runs them on
+// the pool. the calling thread works too and returns when all are done.
+void parallelFor(int begin, int end, ParallelBody &body, int grain_size = 1);
+
+template <typename F>
+class ParallelBodyAdapter : public ParallelBody
+{
+public:
+	ParallelBodyAdapter(F &func) : func(func) {}
+	void operator()(int begin, int end) { func(begin, end); }
+
+protected:
+	F &func;
+};
+
+// F must provide `void operator()(int begin, int end)`
+template <typename F>
+inline void parallelFor(int begin, int end, F &func, int grain_size = 1)
+{
+	ParallelBodyAdapter<F> body(func);
+	parallelFor(begin, end, static_cast<ParallelBody&>(body), grain_size);
+}
+
+template <typename R, typename F>
+class ParallelReduceBody : public ParallelBody
+{
+public:
+	ParallelReduceBody(F &func, const R &identity, R &result) : func(func), identity(identity), result(result) {}
+
+	void operator()(int begin, int end)
+	{
+		R local = identity;
+		func(begin, end, local);
+
+		ofMutex::ScopedLock lock(mutex);
+		func.join(result, local);
+	}
+
+protected:
+	F &func;
+	const R &identity;
+	R &result;
+	ofMutex mutex;
+};
+
+// F must provide `void operator()(int begin, int end, R &partial)`, which
+// accumulates into a partial result starting from `identity`, and
+// `void join(R &result, const R &partial)`. partials are joined in no
+// particular order.
+template <typename R, typename F>
+inline R parallelReduce(int begin, int end, const R &identity, F &func, int grain_size = 1)
+{
+	R result = identity;
+
+	ParallelReduceBody<R, F> body(func, identity, result);
+	parallelFor(begin, end, static_cast<ParallelBody&>(body), grain_size);
+
+	return result;
+}
+
+//
+// deadline
+//
+// a time budget and cancellation flag for anytime operations. they stop
+// at the next check once it has expired and return what they have so far.
+// cancel() may be called from any thread.
+//
+class Deadline
+{
+public:
+
+	// 0 is no time limit, only cancel() stops
+	Deadline(float budget_ms = 0);
+
+	void cancel() { cancelled = true; }
+	bool isCancelled() const { return cancelled; }
+
+	bool expired() const;
+
+	float getElapsedMs() const { return start.elapsed() * 0.001; }
+	float getBudgetMs() const { return budget_ms; }
+
+	// restarts the clock and clears the cancellation
+	void reset();
+
+protected:
+
+	Poco::Timestamp start;
+	float budget_ms;
+	volatile bool cancelled;
+};
+
+}
@@ -0,0 +1,253 @@
+#include "Pipeline.h"
+
+namespace ofxPCL
+{
+
+//
+// queue
+//
+PipelineQueue::PipelineQueue(int capacity) : capacity(std::max(1, capacity)), closed(false)
+{
+}
+
+void PipelineQueue::setCapacity(int c)
+{
+	ofMutex::ScopedLock lock(mutex);
+	capacity = std::max(1, c);
+}
+
+bool PipelineQueue::push(const PipelineFramePtr &frame)
+{
+	ofMutex::ScopedLock lock(mutex);
+
+	if (closed) return true;
+
+	bool dropped = false;
+	while (frames.size() >= capacity)
+	{
+		frames.pop_front();
+		dropped = true;
+	}
+
+	frames.push_back(frame);
+	condition.signal();
+
+	return !dropped;
+}
+
+PipelineFramePtr PipelineQueue::pop(long timeout_ms)
+{
+	ofMutex::ScopedLock lock(mutex);
+
+	if (frames.empty() && !closed)
+		condition.tryWait(mutex, timeout_ms);
+
+	if (frames.empty() || closed) return PipelineFramePtr();
+
+	PipelineFramePtr frame = frames.front();
+	frames.pop_front();
+	return frame;
+}
+
+void PipelineQueue::close()
+{
+	ofMutex::ScopedLock lock(mutex);
+	closed = true;
+	frames.clear();
+	condition.broadcast();
+}
+
+void PipelineQueue::open()
+{
+	ofMutex::ScopedLock lock(mutex);
+	closed = false;
+	frames.clear();
+}
+
+int PipelineQueue::size()
+{
+	ofMutex::ScopedLock lock(mutex);
+	return frames.size();
+}
+
+//
+// pipeline
+//
+Pipeline::Pipeline(int queue_capacity)
+	: queue_capacity(queue_capacity)
+	, running(false)
+	, next_id(0)
+	, has_new(false)
+	, num_completed(0)
+	, total_latency_ms(0)
+{
+}
+
+Pipeline::~Pipeline()
+{
+	stop();
+
+	for (int i = 0; i < slots.size(); i++)
+	{
+		delete slots[i].input;
+		delete slots[i].worker;
+		delete slots[i].stage;
+	}
+}
+
+void Pipeline::addStage(PipelineStage *stage)
+{
+	if (running)
+	{
+		ofLogError("ofxPCL::Pipeline") << "stages can't be added while running";
+		return;
+	}
+
+	Slot slot;
+	slot.stage = stage;
+	slot.input = new PipelineQueue(queue_capacity);
+	slot.worker = new Worker(*this, slots.size());
+	slot.thread = NULL;
+	slot.stats.name = stage->getName();
+
+	slots.push_back(slot);
+}
+
+void Pipeline::start()
+{
+	if (running || slots.empty()) return;
+
+	running = true;
+
+	for (int i = 0; i < slots.size(); i++)
+	{
+		slots[i].input->open();
+		slots[i].thread = new Poco::Thread;
+		slots[i].thread->start(*slots[i].worker);
+	}
+}
+
+void Pipeline::stop()
+{
+	if (!running) return;
+
+	running = false;
+
+	for (int i = 0; i < slots.size(); i++)
+		slots[i].input->close();
+
+	for (int i = 0; i < slots.size(); i++)
+	{
+		slots[i].thread->join();
+		delete slots[i].thread;
+		slots[i].thread = NULL;
+	}
+}
+
+void Pipeline::push(const PipelineFramePtr &frame)
+{
+	if (!running) return;
+
+	{
+		ofMutex::ScopedLock lock(mutex);
+		frame->id = next_id++;
+		frame->created.update();
+
+		if (!slots[0].input->push(frame))
+			slots[0].stats.dropped++;
+	}
+}
+
+void Pipeline::push(const ofPixels &color, const ofShortPixels &depth)
+{
+	PipelineFramePtr frame(new PipelineFrame);
+	frame->color = color;
+	frame->depth = depth;
+	push(frame);
+}
+
+bool Pipeline::getLatest(PipelineFramePtr &frame)
+{
+	ofMutex::ScopedLock lock(mutex);
+
+	if (!has_new) return false;
+
+	frame = latest;
+	has_new = false;
+	return true;
+}
+
+vector<PipelineStageStats> Pipeline::getStats()
+{
+	ofMutex::ScopedLock lock(mutex);
+
+	vector<PipelineStageStats> stats(slots.size());
+	for (int i = 0; i < slots.size(); i++)
+	{
+		stats[i] = slots[i].stats;
+		stats[i].queue_size = slots[i].input->size();
+	}
+
+	return stats;
+}
+
+float Pipeline::getAverageLatency()
+{
+	ofMutex::ScopedLock lock(mutex);
+	return num_completed > 0 ? total_latency_ms / num_completed : 0;
+}
+
+int Pipeline::getNumCompleted()
+{
+	ofMutex::ScopedLock lock(mutex);
+	return num_completed;
+}
+
+void Pipeline::complete(const PipelineFramePtr &frame)
+{
+	ofMutex::ScopedLock lock(mutex);
+
+	latest = frame;
+	has_new = true;
+
+	num_completed++;
+	total_latency_ms += frame->created.elapsed() * 0.001;
+}
+
+void Pipeline::Worker::run()
+{
+	Slot &slot = pipeline.slots[index];
+	const bool last = index + 1 == pipeline.slots.size();
+
+	while (pipeline.running)
+	{
+		PipelineFramePtr frame = slot.input->pop(100);
+		if (!frame) continue;
+
+		Poco::Timestamp timer;
+		const bool accepted = slot.stage->process(*frame);
+		const float ms = timer.elapsed() * 0.001;
+
+		bool dropped = false;
+
+		if (accepted)
+		{
+			if (last)
+				pipeline.complete(frame);
+			else
+				dropped = !pipeline.slots[index + 1].input->push(frame);
+		}
+
+		ofMutex::ScopedLock lock(pipeline.mutex);
+
+		PipelineStageStats &stats = slot.stats;
+		stats.processed++;
+		stats.last_ms = ms;
+		stats.average_ms += (ms - stats.average_ms) / stats.processed;
+
+		if (!accepted) stats.rejected++;
+		if (dropped) pipeline.slots[index + 1].stats.dropped++;
+	}
+}
+
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include "ofxPCL.h"
+
+#include <Poco/Condition.h>
+#include <Poco/Runnable.h>
+#include <Poco/Thread.h>
+#include <Poco/Timestamp.h>
+
+namespace ofxPCL
+{
+
+//
+// pipeline
+//
+// runs a chain of stages on their own threads so update() only pushes the
+// newest sensor frame and picks up the newest finished one. queues between
+// the stages are short and drop their oldest frame when full, so a slow
+// stage skips frames instead of building up latency, and nothing upstream
+// ever waits for it.
+//
+
+// everything the stages read and write. a frame belongs to one stage at a
+// time, and once published it is only read.
+struct PipelineFrame
+{
+	unsigned long id;
+	Poco::Timestamp created;
+
+	ofPixels color;
+	ofShortPixels depth;
+
+	ColorPointCloud cloud;
+	ColorNormalPointCloud cloud_with_normals;
+	vector<ColorPointCloud> segments;
+
+	ofMesh mesh;
+
+	PipelineFrame() : id(0) {}
+};
+
+typedef boost::shared_ptr<PipelineFrame> PipelineFramePtr;
+
+class PipelineStage
+{
+public:
+
+	virtual ~PipelineStage() {}
+
+	virtual string getName() const = 0;
+
+	// returning false drops the frame
+	virtual bool process(PipelineFrame &frame) = 0;
+};
+
+struct PipelineStageStats
+{
+	string name;
+
+	int processed;
+
+	// frames dropped from the full input queue, and frames process() rejected
+	int dropped, rejected;
+
+	int queue_size;
+
+	float last_ms, average_ms;
+
+	PipelineStageStats() : processed(0), dropped(0), rejected(0), queue_size(0), last_ms(0), average_ms(0) {}
+};
+
+// bounded queue, a push into a full queue drops the oldest frame
+class PipelineQueue
+{
+public:
+
+	PipelineQueue(int capacity = 1);
+
+	void setCapacity(int capacity);
+
+	// false when a frame had to be dropped
+	bool push(const PipelineFramePtr &frame);
+
+	// waits up to `timeout_ms`, empty on timeout or once closed
+	PipelineFramePtr pop(long timeout_ms);
+
+	void close();
+	void open();
+
+	int size();
+
+protected:
+
+	int capacity;
+	bool closed;
+	std::deque<PipelineFramePtr> frames;
+
+	ofMutex mutex;
+	Poco::Condition condition;
+};
+
+class Pipeline
+{
+public:
+
+	// `queue_capacity` frames may wait in front of each stage
+	Pipeline(int queue_capacity = 1);
+	~Pipeline();
+
+	// takes ownership. stages run in the order they were added
+	void addStage(PipelineStage *stage);
+
+	void start();
+	void stop();
+	bool isRunning() const { return running; }
+
+	// never blocks, fills in the frame id and creation time
+	void push(const PipelineFramePtr &frame);
+	void push(const ofPixels &color, const ofShortPixels &depth);
+
+	// the newest frame that went through all stages, if there is one the
+	// caller hasn't seen yet
+	bool getLatest(PipelineFramePtr &frame);
+
+	vector<PipelineStageStats> getStats();
+
+	// from push() to the end of the last stage
+	float getAverageLatency();
+	int getNumCompleted();
+
+protected:
+
+	class Worker : public Poco::Runnable
+	{
+	public:
+		Worker(Pipeline &pipeline, int index) : pipeline(pipeline), index(index) {}
+		void run();
+
+	protected:
+		Pipeline &pipeline;
+		int index;
+	};
+
+	struct Slot
+	{
+		PipelineStage *stage;
+		PipelineQueue *input;
+		Worker *worker;
+		Poco::Thread *thread;
+		PipelineStageStats stats;
+	};
+
+	vector<Slot> slots;
+	int queue_capacity;
+	volatile bool running;
+
+	unsigned long next_id;
+
+	PipelineFramePtr latest;
+	bool has_new;
+	int num_completed;
+	double total_latency_ms;
+
+	ofMutex mutex;
+
+	void complete(const PipelineFramePtr &frame);
+};
+
+//
+// stages for the usual kinect chain
+//
+class ConvertStage : public PipelineStage
+{
+public:
+
+	ConvertStage(int skip = 1, bool with_normals = false) : skip(skip), with_normals(with_normals) {}
+
+	string getName() const { return "convert"; }
+
+	bool process(PipelineFrame &frame)
+	{
+		if (!frame.color.isAllocated() || !frame.depth.isAllocated()) return false;
+
+		if (with_normals)
+		{
+			if (!frame.cloud_with_normals) frame.cloud_with_normals = New<ColorNormalPointCloud>();
+			convert(frame.color, frame.depth, frame.cloud_with_normals, skip);
+		}
+		else
+		{
+			if (!frame.cloud) frame.cloud = New<ColorPointCloud>();
+			convert(frame.color, frame.depth, frame.cloud, skip);
+		}
+
+		return true;
+	}
+
+protected:
+
+	int skip;
+	bool with_normals;
+};
+
+class ThresholdStage : public PipelineStage
+{
+public:
+
+	ThresholdStage(const string &dimension = "z", float min = 0, float max = 100) : dimension(dimension), min(min), max(max) {}
+
+	string getName() const { return "threshold"; }
+
+	bool process(PipelineFrame &frame)
+	{
+		if (frame.cloud) threshold(frame.cloud, dimension.c_str(), min, max);
+		if (frame.cloud_with_normals) threshold(frame.cloud_with_normals, dimension.c_str(), min, max);
+		return true;
+	}
+
+protected:
+
+	string dimension;
+	float min, max;
+};
+
+class DownsampleStage : public PipelineStage
+{
+public:
+
+	DownsampleStage(const ofVec3f &resolution) : resolution(resolution) {}
+
+	string getName() const { return "downsample"; }
+
+	bool process(PipelineFrame &frame)
+	{
+		if (frame.cloud) downsample(frame.cloud, resolution);
+		if (frame.cloud_with_normals) downsample(frame.cloud_with_normals, resolution);
+		return true;
+	}
+
+protected:
+
+	ofVec3f resolution;
+};
+
+class SegmentationStage : public PipelineStage
+{
+public:
+
+	// with a `budget_ms` the stage keeps the models found when it runs out
+	// of time instead of holding up the frame
+	SegmentationStage(const SegmentationParams &params = SegmentationParams(pcl::SACMODEL_PLANE, 0.01), float budget_ms = 0)
+		: params(params), budget_ms(budget_ms) {}
+
+	string getName() const { return "segmentation"; }
+
+	bool process(PipelineFrame &frame)
+	{
+		if (!frame.cloud || frame.cloud->points.empty()) return false;
+
+		frame.segments = segmentation(frame.cloud, params, Deadline(budget_ms)).segments;
+		return true;
+	}
+
+protected:
+
+	SegmentationParams params;
+	float budget_ms;
+};
+
+// the mesh the render thread draws, from the normals cloud if there is one
+class MeshStage : public PipelineStage
+{
+public:
+
+	string getName() const { return "mesh"; }
+
+	bool process(PipelineFrame &frame)
+	{
+		if (frame.cloud_with_normals)
+			frame.mesh = toOF(frame.cloud_with_normals);
+		else if (frame.cloud)
+			frame.mesh = toOF(frame.cloud);
+		else
+			return false;
+
+		return true;
+	}
+};
+
+// wraps a plain function as a stage
+class FunctionStage : public PipelineStage
+{
+public:
+
+	typedef bool (*Function)(PipelineFrame &frame);
+
+	FunctionStage(const string &name, Function function) : name(name), function(function) {}
+
+	string getName() const { return name; }
+	bool process(PipelineFrame &frame) { return function(frame); }
+
+protected:
+
+	string name;
+	Function function;
+};
+
+}
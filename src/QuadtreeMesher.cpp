@@ -0,0 +1,492 @@
+#include "QuadtreeMesher.h"
+
+#include "ofxPCL.h"
+
+namespace ofxPCL
+{
+
+typedef QuadtreeMesher::Cell Cell;
+typedef QuadtreeMesher::Moments Moments;
+
+//
+// points and the row sums of their moments
+//
+class QuadtreeRows
+{
+public:
+
+	QuadtreeRows(const ofShortPixels &depth, const CameraIntrinsics &intrinsics, vector<ofVec3f> &points, vector<Moments> &integral, unsigned short near_mm, unsigned short far_mm)
+		: depth(depth), intrinsics(intrinsics), points(points), integral(integral), near_mm(near_mm), far_mm(far_mm) {}
+
+	void operator()(int begin, int end)
+	{
+		const int width = depth.getWidth();
+		const int stride = width + 1;
+
+		const float inv_fx = 1. / intrinsics.fx;
+		const float inv_fy = 1. / intrinsics.fy;
+
+		for (int y = begin; y < end; y++)
+		{
+			const unsigned short *depth_ptr = depth.getPixels() + width * y;
+			const float row_factor = (y - intrinsics.cy) * inv_fy;
+
+			ofVec3f *p = &points[y * width];
+			Moments *m = &integral[(y + 1) * stride];
+			Moments sum;
+
+			m[0] = sum;
+
+			for (int x = 0; x < width; x++)
+			{
+				const unsigned short d = depth_ptr[x];
+
+				if (d >= near_mm && d <= far_mm)
+				{
+					const float z = d * 0.001f;
+					p[x].set((x - intrinsics.cx) * inv_fx * z, row_factor * z, z);
+
+					const double px = p[x].x, py = p[x].y, pz = p[x].z;
+					sum.n += 1;
+					sum.x += px; sum.y += py; sum.z += pz;
+					sum.xx += px * px; sum.xy += px * py; sum.xz += px * pz;
+					sum.yy += py * py; sum.yz += py * pz;
+					sum.zz += pz * pz;
+				}
+				else
+				{
+					p[x].set(0, 0, 0);
+				}
+
+				m[x + 1] = sum;
+			}
+		}
+	}
+
+protected:
+
+	const ofShortPixels &depth;
+	const CameraIntrinsics &intrinsics;
+	vector<ofVec3f> &points;
+	vector<Moments> &integral;
+	unsigned short near_mm, far_mm;
+};
+
+//
+// accumulates the row sums down each column
+//
+class QuadtreeColumns
+{
+public:
+
+	QuadtreeColumns(vector<Moments> &integral, int width, int height)
+		: integral(integral), width(width), height(height) {}
+
+	void operator()(int begin, int end)
+	{
+		const int stride = width + 1;
+
+		for (int y = 1; y < height; y++)
+		{
+			Moments *m = &integral[(y + 1) * stride];
+			const Moments *above = &integral[y * stride];
+
+			for (int x = begin; x < end; x++)
+			{
+				Moments &a = m[x];
+				const Moments &b = above[x];
+				a.n += b.n;
+				a.x += b.x; a.y += b.y; a.z += b.z;
+				a.xx += b.xx; a.xy += b.xy; a.xz += b.xz;
+				a.yy += b.yy; a.yz += b.yz;
+				a.zz += b.zz;
+			}
+		}
+	}
+
+protected:
+
+	vector<Moments> &integral;
+	int width, height;
+};
+
+//
+// recursive split of each top level cell
+//
+class QuadtreeSubdivision
+{
+public:
+
+	QuadtreeSubdivision(const vector<Moments> &integral, vector<vector<Cell> > &cells, int width, int height,
+						int cells_x, int min_cell_size, int max_cell_size, float max_plane_error)
+		: integral(integral), cells(cells), width(width), height(height), cells_x(cells_x)
+		, min_cell_size(min_cell_size), max_cell_size(max_cell_size), max_plane_error(max_plane_error)
+	{}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			cells[i].clear();
+			subdivide((i % cells_x) * max_cell_size, (i / cells_x) * max_cell_size, max_cell_size, cells[i]);
+		}
+	}
+
+protected:
+
+	const vector<Moments> &integral;
+	vector<vector<Cell> > &cells;
+	int width, height, cells_x;
+	int min_cell_size, max_cell_size;
+	float max_plane_error;
+
+	// cells cover the pixels [x, x + size] so neighbors share their edges
+	void subdivide(int x, int y, int size, vector<Cell> &leaves) const
+	{
+		if (x >= width - 1 || y >= height - 1) return;
+
+		const bool inside = x + size < width && y + size < height;
+
+		if (size <= min_cell_size)
+		{
+			if (inside) leaves.push_back(Cell(x, y, size));
+			return;
+		}
+
+		if (inside && planar(x, y, size))
+		{
+			leaves.push_back(Cell(x, y, size));
+			return;
+		}
+
+		const int half = size / 2;
+		subdivide(x, y, half, leaves);
+		subdivide(x + half, y, half, leaves);
+		subdivide(x, y + half, half, leaves);
+		subdivide(x + half, y + half, half, leaves);
+	}
+
+	bool planar(int x, int y, int size) const
+	{
+		const int stride = width + 1;
+		const Moments &a = integral[y * stride + x];
+		const Moments &b = integral[y * stride + x + size + 1];
+		const Moments &c = integral[(y + size + 1) * stride + x];
+		const Moments &d = integral[(y + size + 1) * stride + x + size + 1];
+
+		const double n = d.n - b.n - c.n + a.n;
+
+		// holes are never flat
+		if (n < (size + 1) * (size + 1)) return false;
+
+		const double inv_n = 1. / n;
+		const double mx = (d.x - b.x - c.x + a.x) * inv_n;
+		const double my = (d.y - b.y - c.y + a.y) * inv_n;
+		const double mz = (d.z - b.z - c.z + a.z) * inv_n;
+
+		Eigen::Matrix3d covariance;
+		covariance(0, 0) = (d.xx - b.xx - c.xx + a.xx) * inv_n - mx * mx;
+		covariance(0, 1) = (d.xy - b.xy - c.xy + a.xy) * inv_n - mx * my;
+		covariance(0, 2) = (d.xz - b.xz - c.xz + a.xz) * inv_n - mx * mz;
+		covariance(1, 1) = (d.yy - b.yy - c.yy + a.yy) * inv_n - my * my;
+		covariance(1, 2) = (d.yz - b.yz - c.yz + a.yz) * inv_n - my * mz;
+		covariance(2, 2) = (d.zz - b.zz - c.zz + a.zz) * inv_n - mz * mz;
+		covariance(1, 0) = covariance(0, 1);
+		covariance(2, 0) = covariance(0, 2);
+		covariance(2, 1) = covariance(1, 2);
+
+		// the smallest eigenvalue is the mean squared distance to the plane
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance, Eigen::EigenvaluesOnly);
+		const double variance = std::max(0., solver.eigenvalues()[0]);
+		const double limit = max_plane_error * mz;
+
+		return variance <= limit * limit;
+	}
+};
+
+//
+// cells with vertices of smaller neighbors on their edges get a center
+// vertex to fan around
+//
+class QuadtreeFans
+{
+public:
+
+	QuadtreeFans(vector<vector<Cell> > &cells, vector<char> &marks, int width, int min_cell_size)
+		: cells(cells), marks(marks), width(width), min_cell_size(min_cell_size) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			vector<Cell> &leaves = cells[i];
+
+			for (int j = 0; j < leaves.size(); j++)
+			{
+				Cell &cell = leaves[j];
+				if (cell.size <= min_cell_size) continue;
+
+				cell.fan = false;
+
+				for (int k = 1; k < cell.size && !cell.fan; k++)
+				{
+					cell.fan = marks[cell.y * width + cell.x + k]
+						|| marks[(cell.y + cell.size) * width + cell.x + k]
+						|| marks[(cell.y + k) * width + cell.x]
+						|| marks[(cell.y + k) * width + cell.x + cell.size];
+				}
+
+				// only this cell covers its center pixel
+				if (cell.fan)
+					marks[(cell.y + cell.size / 2) * width + cell.x + cell.size / 2] = 1;
+			}
+		}
+	}
+
+protected:
+
+	vector<vector<Cell> > &cells;
+	vector<char> &marks;
+	int width, min_cell_size;
+};
+
+class QuadtreeTriangles
+{
+public:
+
+	QuadtreeTriangles(const vector<vector<Cell> > &cells, const vector<ofVec3f> &points, const vector<char> &marks,
+					  const vector<ofIndexType> &vertex_index, vector<vector<ofIndexType> > &cell_indices,
+					  int width, int min_cell_size, float max_depth_jump)
+		: cells(cells), points(points), marks(marks), vertex_index(vertex_index), cell_indices(cell_indices)
+		, width(width), min_cell_size(min_cell_size), max_depth_jump(max_depth_jump)
+	{}
+
+	inline bool connected(int a, int b) const
+	{
+		const float za = points[a].z, zb = points[b].z;
+		return za > 0 && zb > 0 && fabsf(za - zb) <= max_depth_jump * std::min(za, zb);
+	}
+
+	inline void triangle(vector<ofIndexType> &indices, int a, int b, int c) const
+	{
+		indices.push_back(vertex_index[a]);
+		indices.push_back(vertex_index[b]);
+		indices.push_back(vertex_index[c]);
+	}
+
+	void operator()(int begin, int end)
+	{
+		vector<int> ring;
+
+		for (int i = begin; i < end; i++)
+		{
+			const vector<Cell> &leaves = cells[i];
+			vector<ofIndexType> &indices = cell_indices[i];
+			indices.clear();
+
+			for (int j = 0; j < leaves.size(); j++)
+			{
+				const Cell &cell = leaves[j];
+				const int s = cell.size;
+
+				const int tl = cell.y * width + cell.x;
+				const int tr = tl + s;
+				const int bl = tl + s * width;
+				const int br = bl + s;
+
+				if (!cell.fan)
+				{
+					// same winding and diagonal as DepthMesher, so it faces the viewer
+					const bool diagonal = s > min_cell_size || connected(tr, bl);
+
+					if (diagonal && (s > min_cell_size || (connected(tl, tr) && connected(tl, bl))))
+						triangle(indices, tl, bl, tr);
+
+					if (diagonal && (s > min_cell_size || (connected(br, tr) && connected(br, bl))))
+						triangle(indices, tr, bl, br);
+
+					continue;
+				}
+
+				// boundary walked down the left edge, along the bottom, up the
+				// right and back along the top
+				ring.clear();
+				for (int k = 0; k < s; k++) if (marks[tl + k * width]) ring.push_back(tl + k * width);
+				for (int k = 0; k < s; k++) if (marks[bl + k]) ring.push_back(bl + k);
+				for (int k = 0; k < s; k++) if (marks[br - k * width]) ring.push_back(br - k * width);
+				for (int k = 0; k < s; k++) if (marks[tr - k]) ring.push_back(tr - k);
+
+				const int center = tl + (s / 2) * width + s / 2;
+
+				for (int k = 0; k < ring.size(); k++)
+					triangle(indices, center, ring[k], ring[(k + 1) % ring.size()]);
+			}
+		}
+	}
+
+protected:
+
+	const vector<vector<Cell> > &cells;
+	const vector<ofVec3f> &points;
+	const vector<char> &marks;
+	const vector<ofIndexType> &vertex_index;
+	vector<vector<ofIndexType> > &cell_indices;
+	int width, min_cell_size;
+	float max_depth_jump;
+};
+
+QuadtreeMesher::QuadtreeMesher()
+	: min_cell_size(2)
+	, max_cell_size(64)
+	, max_plane_error(0.005)
+	, near_mm(1)
+	, far_mm(std::numeric_limits<unsigned short>::max())
+	, max_depth_jump(0.05)
+	, num_cells(0)
+{
+}
+
+void QuadtreeMesher::setCellSize(int min_size, int max_size)
+{
+	min_cell_size = std::max(1, min_size);
+	max_cell_size = min_cell_size;
+	while (max_cell_size < max_size) max_cell_size *= 2;
+}
+
+void QuadtreeMesher::setMaxPlaneError(float ratio)
+{
+	max_plane_error = ratio;
+}
+
+void QuadtreeMesher::setDepthRange(unsigned short near_mm_, unsigned short far_mm_)
+{
+	near_mm = std::max<unsigned short>(1, near_mm_);
+	far_mm = far_mm_;
+}
+
+void QuadtreeMesher::setMaxDepthJump(float ratio)
+{
+	max_depth_jump = ratio;
+}
+
+void QuadtreeMesher::update(const ofPixels& color, const ofShortPixels& depth, ofMesh &mesh)
+{
+	const int width = depth.getWidth();
+	const int height = depth.getHeight();
+
+	// the buffers are resized in place, not cleared, so a mesh updated every
+	// frame keeps its storage
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+	num_cells = 0;
+
+	if (width < 2 || height < 2)
+	{
+		mesh.getVertices().resize(0);
+		mesh.getColors().resize(0);
+		mesh.getNormals().resize(0);
+		mesh.getIndices().resize(0);
+		return;
+	}
+
+	points.resize(width * height);
+	integral.resize((width + 1) * (height + 1));
+	std::fill(integral.begin(), integral.begin() + width + 1, Moments());
+
+	QuadtreeRows rows(depth, intrinsics, points, integral, near_mm, far_mm);
+	parallelFor(0, height, rows, 8);
+
+	QuadtreeColumns columns(integral, width, height);
+	parallelFor(0, width + 1, columns, 64);
+
+	const int cells_x = (width - 1 + max_cell_size - 1) / max_cell_size;
+	const int cells_y = (height - 1 + max_cell_size - 1) / max_cell_size;
+	const int num_top_cells = cells_x * cells_y;
+
+	cells.resize(num_top_cells);
+
+	QuadtreeSubdivision subdivision(integral, cells, width, height, cells_x, min_cell_size, max_cell_size, max_plane_error);
+	parallelFor(0, num_top_cells, subdivision);
+
+	// every valid cell corner becomes a vertex
+	marks.assign(width * height, 0);
+
+	for (int i = 0; i < num_top_cells; i++)
+	{
+		const vector<Cell> &leaves = cells[i];
+		num_cells += leaves.size();
+
+		for (int j = 0; j < leaves.size(); j++)
+		{
+			const Cell &cell = leaves[j];
+			const int tl = cell.y * width + cell.x;
+			const int corners[4] = { tl, tl + cell.size, tl + cell.size * width, tl + cell.size * width + cell.size };
+
+			for (int k = 0; k < 4; k++)
+				if (points[corners[k]].z > 0) marks[corners[k]] = 1;
+		}
+	}
+
+	QuadtreeFans fans(cells, marks, width, min_cell_size);
+	parallelFor(0, num_top_cells, fans);
+
+	vertex_index.resize(width * height);
+
+	int num_vertices = 0;
+	for (int i = 0; i < width * height; i++)
+		if (marks[i]) vertex_index[i] = num_vertices++;
+
+	vector<ofVec3f> &vertices = mesh.getVertices();
+	vector<ofFloatColor> &colors = mesh.getColors();
+
+	vertices.resize(num_vertices);
+	colors.resize(num_vertices);
+
+	// without a registered color image of the same size the mesh is white
+	const bool has_color = color.isAllocated() && color.getNumChannels() >= 3
+		&& color.getWidth() == width && color.getHeight() == height;
+
+	const int bytes_per_pixel = color.getBytesPerPixel();
+	const unsigned char *color_ptr = has_color ? color.getPixels() : NULL;
+	const float inv_byte = 1. / 255.;
+
+	for (int i = 0; i < width * height; i++)
+	{
+		if (!marks[i]) continue;
+
+		const int v = vertex_index[i];
+		vertices[v] = points[i];
+
+		if (has_color)
+		{
+			const unsigned char *p = color_ptr + i * bytes_per_pixel;
+			colors[v].set(p[0] * inv_byte, p[1] * inv_byte, p[2] * inv_byte);
+		}
+		else
+		{
+			colors[v].set(1, 1, 1);
+		}
+	}
+
+	cell_indices.resize(num_top_cells);
+
+	QuadtreeTriangles triangles(cells, points, marks, vertex_index, cell_indices, width, min_cell_size, max_depth_jump);
+	parallelFor(0, num_top_cells, triangles);
+
+	cell_offsets.resize(num_top_cells);
+	size_t num_indices = 0;
+	for (int i = 0; i < num_top_cells; i++)
+	{
+		cell_offsets[i] = num_indices;
+		num_indices += cell_indices[i].size();
+	}
+
+	vector<ofIndexType> &indices = mesh.getIndices();
+	indices.resize(num_indices);
+
+	IndexBufferCopy copy(cell_indices, cell_offsets, indices);
+	parallelFor(0, num_top_cells, copy);
+
+	computeNormals(mesh);
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Utility.h"
+
+namespace ofxPCL
+{
+
+//
+// quadtree mesher
+//
+// planarity adaptive meshing of a depth image. the image is cut into a
+// quadtree whose cells are split until the points inside fit a plane,
+// found from integral images of the point moments. flat cells become a
+// couple of large triangles, edges and clutter keep the fine ones. cells
+// next to smaller neighbors are fanned from their center so the mesh has
+// no t-junction cracks.
+//
+class QuadtreeMesher
+{
+public:
+
+	QuadtreeMesher();
+
+	// of the depth camera, the default is the kinect's
+	void setIntrinsics(const CameraIntrinsics &intrinsics) { this->intrinsics = intrinsics; }
+	const CameraIntrinsics& getIntrinsics() const { return intrinsics; }
+
+	// cell sizes in pixels, max is rounded to min times a power of two
+	void setCellSize(int min_size, int max_size);
+	int getMinCellSize() const { return min_cell_size; }
+	int getMaxCellSize() const { return max_cell_size; }
+
+	// rms distance to the fitted plane allowed in a cell, as a ratio of the
+	// cell's mean depth
+	void setMaxPlaneError(float ratio);
+	float getMaxPlaneError() const { return max_plane_error; }
+
+	// depth range in millimeters, pixels outside are treated as holes
+	void setDepthRange(unsigned short near_mm, unsigned short far_mm);
+
+	// smallest cells drop triangles where neighboring depths differ by more
+	// than `ratio` times their depth
+	void setMaxDepthJump(float ratio);
+	float getMaxDepthJump() const { return max_depth_jump; }
+
+	// color may be unallocated, the vertices are white then
+	void update(const ofPixels& color, const ofShortPixels& depth, ofMesh &mesh);
+
+	size_t getNumCells() const { return num_cells; }
+
+	struct Cell
+	{
+		int x, y, size;
+		bool fan;
+
+		Cell(int x = 0, int y = 0, int size = 0) : x(x), y(y), size(size), fan(false) {}
+	};
+
+	// sums over the points of a pixel region
+	struct Moments
+	{
+		double n, x, y, z, xx, xy, xz, yy, yz, zz;
+
+		Moments() : n(0), x(0), y(0), z(0), xx(0), xy(0), xz(0), yy(0), yz(0), zz(0) {}
+	};
+
+protected:
+
+	CameraIntrinsics intrinsics;
+
+	int min_cell_size, max_cell_size;
+	float max_plane_error;
+	unsigned short near_mm, far_mm;
+	float max_depth_jump;
+
+	size_t num_cells;
+
+	vector<ofVec3f> points;
+	vector<Moments> integral;
+	vector<char> marks;
+	vector<ofIndexType> vertex_index;
+
+	vector<vector<Cell> > cells;
+	vector<vector<ofIndexType> > cell_indices;
+	vector<size_t> cell_offsets;
+};
+
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "ofxPCL.h"
+
+#include <Poco/Timestamp.h>
+
+namespace ofxPCL
+{
+
+//
+// icp
+//
+struct ICPParams
+{
+	int max_iterations;
+
+	// correspondences farther apart are rejected
+	float max_correspondence_distance;
+
+	// degrees, correspondences whose normals differ more are rejected. only
+	// used when the point type has normals
+	float max_normal_angle;
+
+	// stop when an iteration moves less than this, in meters and radians
+	float transformation_epsilon;
+
+	// minimizes the distance to the target's tangent planes, needs normals
+	bool point_to_plane;
+
+	ICPParams(float max_correspondence_distance = 0.05)
+		: max_iterations(30)
+		, max_correspondence_distance(max_correspondence_distance)
+		, max_normal_angle(45)
+		, transformation_epsilon(1e-5)
+		, point_to_plane(false)
+	{}
+};
+
+struct ICPResult
+{
+	// maps the source onto the target, ready for transform()
+	ofMatrix4x4 transform;
+
+	bool converged;
+	int iterations;
+	int num_correspondences;
+
+	// mean squared distance of the accepted correspondences
+	float fitness;
+
+	// accepted correspondences over valid source points
+	float inlier_ratio;
+
+	float elapsed_ms;
+
+	ICPResult() : converged(false), iterations(0), num_correspondences(0), fitness(0), inlier_ratio(0), elapsed_ms(0) {}
+};
+
+template <typename P>
+struct PointNormalAccess
+{
+	static const bool enabled = false;
+	static inline Eigen::Vector3f get(const P &p) { return Eigen::Vector3f::Zero(); }
+};
+
+template <>
+struct PointNormalAccess<PointNormalType>
+{
+	static const bool enabled = true;
+	static inline Eigen::Vector3f get(const PointNormalType &p) { return p.getNormalVector3fMap(); }
+};
+
+template <>
+struct PointNormalAccess<ColorNormalPointType>
+{
+	static const bool enabled = true;
+	static inline Eigen::Vector3f get(const ColorNormalPointType &p) { return p.getNormalVector3fMap(); }
+};
+
+// sums for both the closed form point to point and the linearized point to
+// plane solution
+struct ICPAccumulator
+{
+	Eigen::Matrix<double, 6, 6> AtA;
+	Eigen::Matrix<double, 6, 1> Atb;
+	Eigen::Vector3d sum_source, sum_target;
+	Eigen::Matrix3d sum_cross;
+	double sum_squared_distance;
+	int count, valid;
+
+	ICPAccumulator() { clear(); }
+
+	void clear()
+	{
+		AtA.setZero();
+		Atb.setZero();
+		sum_source.setZero();
+		sum_target.setZero();
+		sum_cross.setZero();
+		sum_squared_distance = 0;
+		count = valid = 0;
+	}
+
+	void add(const ICPAccumulator &o)
+	{
+		AtA += o.AtA;
+		Atb += o.Atb;
+		sum_source += o.sum_source;
+		sum_target += o.sum_target;
+		sum_cross += o.sum_cross;
+		sum_squared_distance += o.sum_squared_distance;
+		count += o.count;
+		valid += o.valid;
+	}
+};
+
+template <typename T>
+class ICPCorrespondences
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	ICPCorrespondences(const T &source, const T &target, const KdTree<PointType> &kdtree, const Eigen::Affine3f &transform,
+					   const ICPParams &params, bool point_to_plane)
+		: source(source), target(target), kdtree(kdtree), transform(transform)
+		, params(params), point_to_plane(point_to_plane)
+	{}
+
+	void operator()(int begin, int end, ICPAccumulator &local)
+	{
+		vector<int> indices(1);
+		vector<float> distances(1);
+
+		const float max_distance = params.max_correspondence_distance * params.max_correspondence_distance;
+		const float min_cos = cosf(ofDegToRad(params.max_normal_angle));
+		const bool use_normals = PointNormalAccess<PointType>::enabled;
+
+		for (int i = begin; i < end; i++)
+		{
+			const PointType &p = source->points[i];
+			if (!pcl_isfinite(p.x)) continue;
+
+			local.valid++;
+
+			const Eigen::Vector3f s = transform * p.getVector3fMap();
+
+			PointType query = p;
+			query.x = s.x();
+			query.y = s.y();
+			query.z = s.z();
+
+			if (kdtree.kdtree->nearestKSearch(query, 1, indices, distances) < 1) continue;
+			if (distances[0] > max_distance) continue;
+
+			const PointType &q = target->points[indices[0]];
+			const Eigen::Vector3f n = PointNormalAccess<PointType>::get(q);
+
+			if (use_normals)
+			{
+				const Eigen::Vector3f m = transform.linear() * PointNormalAccess<PointType>::get(p);
+				if (!pcl_isfinite(n.x()) || !pcl_isfinite(m.x())) continue;
+				if (m.dot(n) < min_cos) continue;
+			}
+
+			const Eigen::Vector3d sd = s.cast<double>();
+			const Eigen::Vector3d td = q.getVector3fMap().template cast<double>();
+
+			local.sum_source += sd;
+			local.sum_target += td;
+			local.sum_cross += sd * td.transpose();
+			local.sum_squared_distance += distances[0];
+			local.count++;
+
+			if (point_to_plane)
+			{
+				// residual (s - t).n, jacobian [s x n, n] for a small rotation
+				// and translation
+				const Eigen::Vector3d nd = n.cast<double>();
+				Eigen::Matrix<double, 6, 1> J;
+				J.head<3>() = sd.cross(nd);
+				J.tail<3>() = nd;
+
+				const double r = (sd - td).dot(nd);
+				local.AtA += J * J.transpose();
+				local.Atb -= J * r;
+			}
+		}
+	}
+
+	void join(ICPAccumulator &result, const ICPAccumulator &partial)
+	{
+		result.add(partial);
+	}
+
+protected:
+
+	const T &source;
+	const T &target;
+	const KdTree<PointType> &kdtree;
+	const Eigen::Affine3f &transform;
+	const ICPParams &params;
+	bool point_to_plane;
+};
+
+//
+// the target kd-tree is built once in setTarget() and reused by every
+// align(), so aligning a stream of frames to a fixed model or keyframe
+// only pays for the searches
+//
+template <typename T>
+class ICP
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	ICP(const ICPParams &params = ICPParams()) : params(params) {}
+
+	void setParams(const ICPParams &p) { params = p; }
+	const ICPParams& getParams() const { return params; }
+
+	void setTarget(const T &cloud)
+	{
+		assert(cloud);
+
+		target = cloud;
+		kdtree = KdTree<PointType>(cloud);
+	}
+
+	const T& getTarget() const { return target; }
+	bool hasTarget() const { return target.get() != NULL; }
+
+	ICPResult align(const T &source, const ofMatrix4x4 &initial_guess = ofMatrix4x4())
+	{
+		assert(source);
+		assert(target);
+
+		Poco::Timestamp timer;
+		ICPResult result;
+
+		bool point_to_plane = params.point_to_plane;
+		if (point_to_plane && !PointNormalAccess<PointType>::enabled)
+		{
+			ofLogWarning("ofxPCL::ICP") << "point to plane needs normals, falling back to point to point";
+			point_to_plane = false;
+		}
+
+		Eigen::Affine3f transform(toEigen(initial_guess));
+		ICPAccumulator sums;
+
+		for (int iteration = 0; iteration < params.max_iterations; iteration++)
+		{
+			ICPCorrespondences<T> correspondences(source, target, kdtree, transform, params, point_to_plane);
+			sums = parallelReduce(0, source->points.size(), ICPAccumulator(), correspondences, 256);
+
+			result.iterations = iteration + 1;
+			if (sums.count < (point_to_plane ? 6 : 3)) break;
+
+			Eigen::Affine3d delta = point_to_plane ? solvePointToPlane(sums) : solvePointToPoint(sums);
+			transform = delta.cast<float>() * transform;
+
+			const double angle = Eigen::AngleAxisd(delta.linear()).angle();
+			if (delta.translation().norm() < params.transformation_epsilon && angle < params.transformation_epsilon)
+			{
+				result.converged = true;
+				break;
+			}
+		}
+
+		result.transform = toOF(transform.matrix());
+		result.num_correspondences = sums.count;
+		result.fitness = sums.count > 0 ? sums.sum_squared_distance / sums.count : std::numeric_limits<float>::max();
+		result.inlier_ratio = sums.valid > 0 ? (float)sums.count / sums.valid : 0;
+		result.elapsed_ms = timer.elapsed() * 0.001;
+
+		return result;
+	}
+
+protected:
+
+	ICPParams params;
+
+	T target;
+	KdTree<PointType> kdtree;
+
+	static Eigen::Affine3d solvePointToPoint(const ICPAccumulator &sums)
+	{
+		const double inv_n = 1. / sums.count;
+		const Eigen::Vector3d mean_source = sums.sum_source * inv_n;
+		const Eigen::Vector3d mean_target = sums.sum_target * inv_n;
+
+		const Eigen::Matrix3d H = sums.sum_cross * inv_n - mean_source * mean_target.transpose();
+
+		Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU | Eigen::ComputeFullV);
+		Eigen::Matrix3d V = svd.matrixV();
+		Eigen::Matrix3d R = V * svd.matrixU().transpose();
+
+		// no reflections
+		if (R.determinant() < 0)
+		{
+			V.col(2) *= -1;
+			R = V * svd.matrixU().transpose();
+		}
+
+		Eigen::Affine3d delta = Eigen::Affine3d::Identity();
+		delta.linear() = R;
+		delta.translation() = mean_target - R * mean_source;
+		return delta;
+	}
+
+	static Eigen::Affine3d solvePointToPlane(const ICPAccumulator &sums)
+	{
+		const Eigen::Matrix<double, 6, 1> x = sums.AtA.ldlt().solve(sums.Atb);
+
+		Eigen::Affine3d delta = Eigen::Affine3d::Identity();
+		delta.linear() = (Eigen::AngleAxisd(x[2], Eigen::Vector3d::UnitZ())
+						  * Eigen::AngleAxisd(x[1], Eigen::Vector3d::UnitY())
+						  * Eigen::AngleAxisd(x[0], Eigen::Vector3d::UnitX())).toRotationMatrix();
+		delta.translation() = x.tail<3>();
+		return delta;
+	}
+};
+
+// one shot version, builds the target kd-tree on every call
+template <typename T>
+ICPResult icp(const T &source, const T &target, const ICPParams &params = ICPParams(), const ofMatrix4x4 &initial_guess = ofMatrix4x4())
+{
+	ICP<T> icp(params);
+	icp.setTarget(target);
+	return icp.align(source, initial_guess);
+}
+
+}
@@ -0,0 +1,519 @@
+#include "SoACloud.h"
+
+#include "Utility.h"
+#include "Parallel.h"
+
+#include <Eigen/LU>
+
+namespace ofxPCL
+{
+
+// points per parallel range, large enough that the eigen expressions run
+// long stretches of packets
+static const int SOA_GRAIN = 16384;
+
+void SoACloud::resize(int n, bool with_normals, bool with_colors)
+{
+	x.resize(n);
+	y.resize(n);
+	z.resize(n);
+
+	const int nn = with_normals ? n : 0;
+	normal_x.resize(nn);
+	normal_y.resize(nn);
+	normal_z.resize(nn);
+
+	rgba.resize(with_colors ? n : 0);
+}
+
+void SoACloud::move(int from, int to)
+{
+	x[to] = x[from];
+	y[to] = y[from];
+	z[to] = z[from];
+
+	if (hasNormals())
+	{
+		normal_x[to] = normal_x[from];
+		normal_y[to] = normal_y[from];
+		normal_z[to] = normal_z[from];
+	}
+
+	if (hasColors()) rgba[to] = rgba[from];
+}
+
+//
+// adapters
+//
+static inline void gatherFields(const PointType &p, SoACloud &soa, int i) {}
+
+static inline void gatherFields(const ColorPointType &p, SoACloud &soa, int i)
+{
+	soa.rgba[i] = p.rgba;
+}
+
+static inline void gatherFields(const PointNormalType &p, SoACloud &soa, int i)
+{
+	soa.normal_x[i] = p.normal_x;
+	soa.normal_y[i] = p.normal_y;
+	soa.normal_z[i] = p.normal_z;
+}
+
+static inline void gatherFields(const ColorNormalPointType &p, SoACloud &soa, int i)
+{
+	soa.normal_x[i] = p.normal_x;
+	soa.normal_y[i] = p.normal_y;
+	soa.normal_z[i] = p.normal_z;
+	soa.rgba[i] = p.rgba;
+}
+
+static inline void scatterFields(const SoACloud &soa, int i, PointType &p) {}
+
+static inline void scatterFields(const SoACloud &soa, int i, ColorPointType &p)
+{
+	if (soa.hasColors()) p.rgba = soa.rgba[i];
+}
+
+static inline void scatterFields(const SoACloud &soa, int i, PointNormalType &p)
+{
+	if (!soa.hasNormals()) return;
+
+	p.normal_x = soa.normal_x[i];
+	p.normal_y = soa.normal_y[i];
+	p.normal_z = soa.normal_z[i];
+}
+
+static inline void scatterFields(const SoACloud &soa, int i, ColorNormalPointType &p)
+{
+	if (soa.hasNormals())
+	{
+		p.normal_x = soa.normal_x[i];
+		p.normal_y = soa.normal_y[i];
+		p.normal_z = soa.normal_z[i];
+	}
+
+	if (soa.hasColors()) p.rgba = soa.rgba[i];
+}
+
+template <typename P>
+class SoAGather
+{
+public:
+
+	SoAGather(const pcl::PointCloud<P> &cloud, SoACloud &soa) : cloud(cloud), soa(soa) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const P &p = cloud.points[i];
+			soa.x[i] = p.x;
+			soa.y[i] = p.y;
+			soa.z[i] = p.z;
+			gatherFields(p, soa, i);
+		}
+	}
+
+protected:
+
+	const pcl::PointCloud<P> &cloud;
+	SoACloud &soa;
+};
+
+template <typename P>
+class SoAScatter
+{
+public:
+
+	SoAScatter(const SoACloud &soa, pcl::PointCloud<P> &cloud) : soa(soa), cloud(cloud) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			P &p = cloud.points[i];
+			p.x = soa.x[i];
+			p.y = soa.y[i];
+			p.z = soa.z[i];
+			scatterFields(soa, i, p);
+		}
+	}
+
+protected:
+
+	const SoACloud &soa;
+	pcl::PointCloud<P> &cloud;
+};
+
+template <typename T>
+static void gather(const T &cloud, SoACloud &soa, bool with_normals, bool with_colors)
+{
+	assert(cloud);
+
+	const int n = cloud->points.size();
+	soa.resize(n, with_normals, with_colors);
+
+	SoAGather<typename T::value_type::PointType> body(*cloud, soa);
+	parallelFor(0, n, body, SOA_GRAIN);
+}
+
+template <typename T>
+static void scatter(const SoACloud &soa, T &cloud)
+{
+	if (!cloud) cloud = New<T>();
+
+	const int n = soa.size();
+
+	// keeps the organization when the size didn't change
+	if (cloud->points.size() != n)
+	{
+		cloud->points.resize(n);
+		cloud->width = n;
+		cloud->height = 1;
+	}
+
+	SoAScatter<typename T::value_type::PointType> body(soa, *cloud);
+	parallelFor(0, n, body, SOA_GRAIN);
+}
+
+void convert(const PointCloud &cloud, SoACloud &soa) { gather(cloud, soa, false, false); }
+void convert(const ColorPointCloud &cloud, SoACloud &soa) { gather(cloud, soa, false, true); }
+void convert(const PointNormalPointCloud &cloud, SoACloud &soa) { gather(cloud, soa, true, false); }
+void convert(const ColorNormalPointCloud &cloud, SoACloud &soa) { gather(cloud, soa, true, true); }
+
+void convert(const SoACloud &soa, PointCloud &cloud) { scatter(soa, cloud); }
+void convert(const SoACloud &soa, ColorPointCloud &cloud) { scatter(soa, cloud); }
+void convert(const SoACloud &soa, PointNormalPointCloud &cloud) { scatter(soa, cloud); }
+void convert(const SoACloud &soa, ColorNormalPointCloud &cloud) { scatter(soa, cloud); }
+
+class SoAMesh
+{
+public:
+
+	SoAMesh(const SoACloud &soa, ofVec3f *vertices, ofVec3f *normals, ofFloatColor *colors)
+		: soa(soa), vertices(vertices), normals(normals), colors(colors) {}
+
+	void operator()(int begin, int end)
+	{
+		const float inv_byte = 1. / 255.;
+
+		for (int i = begin; i < end; i++)
+			vertices[i].set(soa.x[i], soa.y[i], soa.z[i]);
+
+		if (normals)
+		{
+			for (int i = begin; i < end; i++)
+				normals[i].set(soa.normal_x[i], soa.normal_y[i], soa.normal_z[i]);
+		}
+
+		if (colors)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				const unsigned int c = soa.rgba[i];
+				colors[i].set(((c >> 16) & 0xff) * inv_byte, ((c >> 8) & 0xff) * inv_byte, (c & 0xff) * inv_byte);
+			}
+		}
+	}
+
+protected:
+
+	const SoACloud &soa;
+	ofVec3f *vertices;
+	ofVec3f *normals;
+	ofFloatColor *colors;
+};
+
+void convert(const SoACloud &soa, ofMesh &mesh)
+{
+	const int n = soa.size();
+
+	mesh.getVertices().resize(n);
+	mesh.getNormals().resize(soa.hasNormals() ? n : 0);
+	mesh.getColors().resize(soa.hasColors() ? n : 0);
+
+	if (n == 0) return;
+
+	SoAMesh body(soa, &mesh.getVertices()[0],
+				 soa.hasNormals() ? &mesh.getNormals()[0] : NULL,
+				 soa.hasColors() ? &mesh.getColors()[0] : NULL);
+	parallelFor(0, n, body, SOA_GRAIN);
+}
+
+ofMesh toOF(const SoACloud &soa)
+{
+	ofMesh mesh;
+	convert(soa, mesh);
+	return mesh;
+}
+
+//
+// transform
+//
+class SoATransform
+{
+public:
+
+	SoATransform(SoACloud &soa, const Eigen::Matrix4f &m, const Eigen::Matrix3f &n, bool renormalize)
+		: soa(soa), m(m), n(n), renormalize(renormalize) {}
+
+	void operator()(int begin, int end)
+	{
+		const int count = end - begin;
+
+		rotate(soa.x.segment(begin, count), soa.y.segment(begin, count), soa.z.segment(begin, count),
+			   m.topLeftCorner<3, 3>(), m.topRightCorner<3, 1>());
+
+		if (soa.hasNormals())
+		{
+			SoACloud::Channel::SegmentReturnType nx = soa.normal_x.segment(begin, count);
+			SoACloud::Channel::SegmentReturnType ny = soa.normal_y.segment(begin, count);
+			SoACloud::Channel::SegmentReturnType nz = soa.normal_z.segment(begin, count);
+
+			rotate(nx, ny, nz, n, Eigen::Vector3f::Zero());
+
+			if (renormalize)
+			{
+				// zero normals are left alone
+				const SoACloud::Channel length = (nx.square() + ny.square() + nz.square()).sqrt();
+				const SoACloud::Channel scale = (length > 0).select(length.inverse(), 1);
+
+				nx *= scale;
+				ny *= scale;
+				nz *= scale;
+			}
+		}
+	}
+
+protected:
+
+	SoACloud &soa;
+	const Eigen::Matrix4f &m;
+	const Eigen::Matrix3f &n;
+	bool renormalize;
+
+	template <typename S, typename R, typename V>
+	void rotate(S x, S y, S z, const R &r, const V &t)
+	{
+		// the inputs are overwritten, so x and y are kept aside
+		const SoACloud::Channel px = x;
+		const SoACloud::Channel py = y;
+
+		x = px * r(0, 0) + py * r(0, 1) + z * r(0, 2) + t(0);
+		y = px * r(1, 0) + py * r(1, 1) + z * r(1, 2) + t(1);
+		z = px * r(2, 0) + py * r(2, 1) + z * r(2, 2) + t(2);
+	}
+};
+
+void transform(SoACloud &soa, const ofMatrix4x4 &matrix)
+{
+	const Eigen::Matrix4f m = toEigen(matrix);
+
+	// normals get the inverse transpose, the rotation itself unless the
+	// matrix scales or shears, like PointTransform in ofxPCL.h
+	const Eigen::Matrix3f r = m.topLeftCorner<3, 3>();
+	const Eigen::Matrix3f n = r.inverse().transpose();
+	const bool renormalize = !(n - r).isZero(1e-5);
+
+	SoATransform body(soa, m, n, renormalize);
+	parallelFor(0, soa.size(), body, SOA_GRAIN);
+}
+
+//
+// threshold
+//
+static const SoACloud::Channel& getChannel(const SoACloud &soa, const char *dimension)
+{
+	switch (dimension[0])
+	{
+	case 'y': case 'Y': return soa.y;
+	case 'z': case 'Z': return soa.z;
+	default: return soa.x;
+	}
+}
+
+class SoAThreshold
+{
+public:
+
+	SoAThreshold(const SoACloud::Channel &c, float min, float max, vector<vector<int> > &partitions)
+		: c(c), min(min), max(max), partitions(partitions) {}
+
+	// over partitions, not points. the pool's ranges don't start on grain
+	// boundaries, so every partition is a slot of its own
+	void operator()(int begin, int end)
+	{
+		const int size = c.size();
+
+		for (int p = begin; p < end; p++)
+		{
+			const int first = p * SOA_GRAIN;
+			const int n = std::min(size, first + SOA_GRAIN) - first;
+
+			// nan fails both tests, like in pcl's PassThrough
+			const Eigen::Array<bool, Eigen::Dynamic, 1> inside = (c.segment(first, n) >= min) && (c.segment(first, n) <= max);
+
+			vector<int> &indices = partitions[p];
+			indices.clear();
+			indices.reserve(inside.count());
+
+			for (int i = 0; i < n; i++)
+				if (inside[i]) indices.push_back(first + i);
+		}
+	}
+
+protected:
+
+	const SoACloud::Channel &c;
+	float min, max;
+	vector<vector<int> > &partitions;
+};
+
+void threshold(const SoACloud &soa, vector<int> &indices, const char *dimension, float min, float max)
+{
+	const int n = soa.size();
+	const int num_partitions = (n + SOA_GRAIN - 1) / SOA_GRAIN;
+
+	vector<vector<int> > partitions(num_partitions);
+
+	SoAThreshold body(getChannel(soa, dimension), min, max, partitions);
+	parallelFor(0, num_partitions, body, 1);
+
+	size_t num_indices = 0;
+	for (int i = 0; i < num_partitions; i++)
+		num_indices += partitions[i].size();
+
+	indices.clear();
+	indices.reserve(num_indices);
+
+	for (int i = 0; i < num_partitions; i++)
+		indices.insert(indices.end(), partitions[i].begin(), partitions[i].end());
+}
+
+template <typename C>
+static void compact(C &channel, const vector<int> &indices)
+{
+	if (channel.size() == 0) return;
+
+	// indices are increasing, so the target never overtakes the source
+	for (int i = 0; i < indices.size(); i++)
+		channel[i] = channel[indices[i]];
+
+	channel.conservativeResize(indices.size());
+}
+
+void threshold(SoACloud &soa, const char *dimension, float min, float max)
+{
+	vector<int> indices;
+	threshold(soa, indices, dimension, min, max);
+
+	if (indices.size() == soa.size()) return;
+
+	compact(soa.x, indices);
+	compact(soa.y, indices);
+	compact(soa.z, indices);
+	compact(soa.normal_x, indices);
+	compact(soa.normal_y, indices);
+	compact(soa.normal_z, indices);
+	compact(soa.rgba, indices);
+}
+
+//
+// bounding box
+//
+class SoABounds
+{
+public:
+
+	SoABounds(const SoACloud &soa) : soa(soa), min(Eigen::Vector3f::Constant(std::numeric_limits<float>::max())), max(Eigen::Vector3f::Constant(-std::numeric_limits<float>::max())), count(0) {}
+
+	void operator()(int begin, int end)
+	{
+		const int n = end - begin;
+
+		const SoACloud::Channel::ConstSegmentReturnType x = soa.x.segment(begin, n);
+		const SoACloud::Channel::ConstSegmentReturnType y = soa.y.segment(begin, n);
+		const SoACloud::Channel::ConstSegmentReturnType z = soa.z.segment(begin, n);
+
+		// nan != nan, invalid points are replaced by values that lose
+		const Eigen::Array<bool, Eigen::Dynamic, 1> valid = (x == x) && (y == y) && (z == z);
+		const int local_count = valid.count();
+		if (local_count == 0) return;
+
+		const Eigen::Vector3f local_min(valid.select(x, std::numeric_limits<float>::max()).minCoeff(), valid.select(y, std::numeric_limits<float>::max()).minCoeff(), valid.select(z, std::numeric_limits<float>::max()).minCoeff());
+		const Eigen::Vector3f local_max(valid.select(x, -std::numeric_limits<float>::max()).maxCoeff(), valid.select(y, -std::numeric_limits<float>::max()).maxCoeff(), valid.select(z, -std::numeric_limits<float>::max()).maxCoeff());
+
+		ofMutex::ScopedLock lock(mutex);
+		min = min.cwiseMin(local_min);
+		max = max.cwiseMax(local_max);
+		count += local_count;
+	}
+
+	const SoACloud &soa;
+	Eigen::Vector3f min, max;
+	int count;
+	ofMutex mutex;
+};
+
+bool getBoundingBox(const SoACloud &soa, ofVec3f &min, ofVec3f &max)
+{
+	SoABounds body(soa);
+	parallelFor(0, soa.size(), body, SOA_GRAIN);
+
+	if (body.count == 0) return false;
+
+	min.set(body.min.x(), body.min.y(), body.min.z());
+	max.set(body.max.x(), body.max.y(), body.max.z());
+	return true;
+}
+
+//
+// voxel keys
+//
+class SoAVoxelKeys
+{
+public:
+
+	SoAVoxelKeys(const SoACloud &soa, float voxel_size, const ofVec3f &origin, int dims_x, int dims_y, int dims_z, vector<long long> &keys)
+		: soa(soa), inv_size(1.f / voxel_size), origin(origin), dims_x(dims_x), dims_y(dims_y), dims_z(dims_z), keys(keys) {}
+
+	void operator()(int begin, int end)
+	{
+		const int n = end - begin;
+
+		// grid coordinates, still fractional
+		const SoACloud::Channel gx = (soa.x.segment(begin, n) - origin.x) * inv_size;
+		const SoACloud::Channel gy = (soa.y.segment(begin, n) - origin.y) * inv_size;
+		const SoACloud::Channel gz = (soa.z.segment(begin, n) - origin.z) * inv_size;
+
+		for (int i = 0; i < n; i++)
+		{
+			// written so nan fails
+			if (!(gx[i] >= 0 && gx[i] < dims_x && gy[i] >= 0 && gy[i] < dims_y && gz[i] >= 0 && gz[i] < dims_z))
+			{
+				keys[begin + i] = -1;
+				continue;
+			}
+
+			keys[begin + i] = ((long long)gz[i] * dims_y + (int)gy[i]) * dims_x + (int)gx[i];
+		}
+	}
+
+protected:
+
+	const SoACloud &soa;
+	float inv_size;
+	ofVec3f origin;
+	int dims_x, dims_y, dims_z;
+	vector<long long> &keys;
+};
+
+void computeVoxelKeys(const SoACloud &soa, float voxel_size, const ofVec3f &origin, int dims_x, int dims_y, int dims_z, vector<long long> &keys)
+{
+	keys.resize(soa.size());
+
+	SoAVoxelKeys body(soa, voxel_size, origin, dims_x, dims_y, dims_z, keys);
+	parallelFor(0, soa.size(), body, SOA_GRAIN);
+}
+
+}
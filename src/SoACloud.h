@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Types.h"
+
+#include <Eigen/Core>
+
+namespace ofxPCL
+{
+
+//
+// structure of arrays cloud
+//
+// the pcl point types interleave everything a point has (PointXYZRGBNormal
+// is 48 bytes), so a pass that only reads positions still pulls colors
+// and normals through the cache. here every field is its own aligned
+// array, and the kernels below are eigen array expressions, which eigen
+// compiles to sse / neon packets. invalid points keep nan positions like
+// in the pcl clouds.
+//
+class SoACloud
+{
+public:
+
+	typedef Eigen::Array<float, Eigen::Dynamic, 1> Channel;
+	typedef Eigen::Array<unsigned int, Eigen::Dynamic, 1> ColorChannel;
+
+	Channel x, y, z;
+
+	// empty when the cloud has no normals or colors
+	Channel normal_x, normal_y, normal_z;
+
+	// packed like pcl's rgba, 0xAARRGGBB
+	ColorChannel rgba;
+
+	SoACloud() {}
+
+	void resize(int n, bool with_normals = false, bool with_colors = false);
+	void clear() { resize(0); }
+
+	int size() const { return x.size(); }
+	bool empty() const { return x.size() == 0; }
+
+	bool hasNormals() const { return normal_x.size() == x.size() && !empty(); }
+	bool hasColors() const { return rgba.size() == x.size() && !empty(); }
+
+	// moves point `from` to `to`, for compaction
+	void move(int from, int to);
+};
+
+//
+// adapters, one pass each way
+//
+void convert(const PointCloud &cloud, SoACloud &soa);
+void convert(const ColorPointCloud &cloud, SoACloud &soa);
+void convert(const PointNormalPointCloud &cloud, SoACloud &soa);
+void convert(const ColorNormalPointCloud &cloud, SoACloud &soa);
+
+// missing fields are left as they were
+void convert(const SoACloud &soa, PointCloud &cloud);
+void convert(const SoACloud &soa, ColorPointCloud &cloud);
+void convert(const SoACloud &soa, PointNormalPointCloud &cloud);
+void convert(const SoACloud &soa, ColorNormalPointCloud &cloud);
+
+void convert(const SoACloud &soa, ofMesh &mesh);
+ofMesh toOF(const SoACloud &soa);
+
+//
+// kernels
+//
+
+// rotates the normals too
+void transform(SoACloud &soa, const ofMatrix4x4 &matrix);
+
+// keeps the points whose `dimension` ("x", "y" or "z") is in [min, max],
+// like threshold() on a pcl cloud
+void threshold(SoACloud &soa, const char *dimension = "X", float min = 0, float max = 100);
+
+// the same test, only the indices of the passing points
+void threshold(const SoACloud &soa, vector<int> &indices, const char *dimension = "X", float min = 0, float max = 100);
+
+// false when there is no valid point
+bool getBoundingBox(const SoACloud &soa, ofVec3f &min, ofVec3f &max);
+
+// linear voxel index (x fastest) of every point in a grid of `voxel_size`
+// starting at `origin` with `dims_x` * `dims_y` * `dims_z` voxels, -1 for
+// invalid points and points outside the grid
+void computeVoxelKeys(const SoACloud &soa, float voxel_size, const ofVec3f &origin, int dims_x, int dims_y, int dims_z, vector<long long> &keys);
+
+}
@@ -0,0 +1,650 @@
+#include "SparseVolume.h"
+
+#include "Parallel.h"
+
+namespace ofxPCL
+{
+
+//
+// marching cubes tables
+//
+// corner i sits at corner_offsets[i], edge i connects edge_corners[i][0]
+// and edge_corners[i][1]. edge_table has bit i set when edge i is crossed.
+//
+static const int corner_offsets[8][3] =
+{
+	{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+	{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}
+};
+
+static const int edge_corners[12][2] =
+{
+	{0, 1}, {1, 2}, {2, 3}, {3, 0},
+	{4, 5}, {5, 6}, {6, 7}, {7, 4},
+	{0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
+static const int edge_table[256] =
+{
+	0x000, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c,
+	0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
+	0x190, 0x099, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c,
+	0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
+	0x230, 0x339, 0x033, 0x13a, 0x636, 0x73f, 0x435, 0x53c,
+	0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
+	0x3a0, 0x2a9, 0x1a3, 0x0aa, 0x7a6, 0x6af, 0x5a5, 0x4ac,
+	0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
+	0x460, 0x569, 0x663, 0x76a, 0x066, 0x16f, 0x265, 0x36c,
+	0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
+	0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0x0ff, 0x3f5, 0x2fc,
+	0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
+	0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x055, 0x15c,
+	0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
+	0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0x0cc,
+	0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
+	0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc,
+	0x0cc, 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
+	0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c,
+	0x15c, 0x055, 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
+	0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc,
+	0x2fc, 0x3f5, 0x0ff, 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
+	0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c,
+	0x36c, 0x265, 0x16f, 0x066, 0x76a, 0x663, 0x569, 0x460,
+	0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac,
+	0x4ac, 0x5a5, 0x6af, 0x7a6, 0x0aa, 0x1a3, 0x2a9, 0x3a0,
+	0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c,
+	0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x033, 0x339, 0x230,
+	0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c,
+	0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x099, 0x190,
+	0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c,
+	0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x000
+};
+
+// triangles per cube configuration as edge indices, -1 terminated.
+// a corner is inside when its sdf is negative, triangles wind
+// counter-clockwise seen from outside.
+static const int triangle_table[256][16] =
+{
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 3, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 10, 2, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 0, 9, 10, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 10, 2, 8, 9, 2, 3, 8, 2, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 2, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 11, 3, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 11, 8, 1, 2, 11, 1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 1, 10, 11, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 10, 11, 0, 1, 10, 0, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 0, 10, 11, 0, 9, 10, 0, -1, -1, -1, -1, -1, -1, -1},
+	{10, 11, 8, 9, 10, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 3, 7, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 1, 7, 4, 1, 3, 7, 1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 1, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 3, 7, 0, 10, 2, 1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 0, 9, 10, 0, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1},
+	{9, 10, 2, 4, 9, 2, 7, 4, 2, 3, 7, 2, -1, -1, -1, -1},
+	{11, 3, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 11, 7, 0, 2, 11, 0, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 11, 3, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 1, 7, 4, 1, 11, 7, 1, 2, 11, 1, -1, -1, -1, -1},
+	{11, 3, 1, 10, 11, 1, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 11, 7, 0, 10, 11, 0, 1, 10, 0, -1, -1, -1, -1},
+	{11, 3, 0, 10, 11, 0, 9, 10, 0, 8, 7, 4, -1, -1, -1, -1},
+	{11, 7, 4, 10, 11, 4, 9, 10, 4, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{5, 1, 0, 4, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 5, 1, 8, 4, 1, 3, 8, 1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 1, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 10, 2, 1, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 0, 5, 10, 0, 4, 5, 0, -1, -1, -1, -1, -1, -1, -1},
+	{5, 10, 2, 4, 5, 2, 8, 4, 2, 3, 8, 2, -1, -1, -1, -1},
+	{11, 3, 2, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 2, 11, 0, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1},
+	{5, 1, 0, 4, 5, 0, 11, 3, 2, -1, -1, -1, -1, -1, -1, -1},
+	{4, 5, 1, 8, 4, 1, 11, 8, 1, 2, 11, 1, -1, -1, -1, -1},
+	{11, 3, 1, 10, 11, 1, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 10, 11, 0, 1, 10, 0, 5, 9, 4, -1, -1, -1, -1},
+	{11, 3, 0, 10, 11, 0, 5, 10, 0, 4, 5, 0, -1, -1, -1, -1},
+	{11, 8, 4, 10, 11, 4, 5, 10, 4, -1, -1, -1, -1, -1, -1, -1},
+	{8, 7, 5, 9, 8, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 0, 7, 5, 0, 3, 7, 0, -1, -1, -1, -1, -1, -1, -1},
+	{5, 1, 0, 7, 5, 0, 8, 7, 0, -1, -1, -1, -1, -1, -1, -1},
+	{7, 5, 1, 3, 7, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 1, 8, 7, 5, 9, 8, 5, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 0, 7, 5, 0, 3, 7, 0, 10, 2, 1, -1, -1, -1, -1},
+	{10, 2, 0, 5, 10, 0, 7, 5, 0, 8, 7, 0, -1, -1, -1, -1},
+	{5, 10, 2, 7, 5, 2, 3, 7, 2, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 2, 8, 7, 5, 9, 8, 5, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 0, 7, 5, 0, 11, 7, 0, 2, 11, 0, -1, -1, -1, -1},
+	{5, 1, 0, 7, 5, 0, 8, 7, 0, 11, 3, 2, -1, -1, -1, -1},
+	{7, 5, 1, 11, 7, 1, 2, 11, 1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 1, 10, 11, 1, 8, 7, 5, 9, 8, 5, -1, -1, -1, -1},
+	{5, 9, 0, 7, 5, 0, 11, 7, 0, 10, 11, 0, 1, 10, 0, -1},
+	{11, 3, 0, 10, 11, 0, 5, 10, 0, 7, 5, 0, 8, 7, 0, -1},
+	{11, 7, 5, 10, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{6, 10, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 3, 8, 1, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1},
+	{6, 2, 1, 5, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 6, 2, 1, 5, 6, 1, -1, -1, -1, -1, -1, -1, -1},
+	{6, 2, 0, 5, 6, 0, 9, 5, 0, -1, -1, -1, -1, -1, -1, -1},
+	{5, 6, 2, 9, 5, 2, 8, 9, 2, 3, 8, 2, -1, -1, -1, -1},
+	{11, 3, 2, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 2, 11, 0, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 11, 3, 2, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 11, 8, 1, 2, 11, 1, 6, 10, 5, -1, -1, -1, -1},
+	{11, 3, 1, 6, 11, 1, 5, 6, 1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 6, 11, 0, 5, 6, 0, 1, 5, 0, -1, -1, -1, -1},
+	{11, 3, 0, 6, 11, 0, 5, 6, 0, 9, 5, 0, -1, -1, -1, -1},
+	{8, 9, 5, 11, 8, 5, 6, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+	{8, 7, 4, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 3, 7, 0, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 8, 7, 4, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 1, 7, 4, 1, 3, 7, 1, 6, 10, 5, -1, -1, -1, -1},
+	{6, 2, 1, 5, 6, 1, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 3, 7, 0, 6, 2, 1, 5, 6, 1, -1, -1, -1, -1},
+	{6, 2, 0, 5, 6, 0, 9, 5, 0, 8, 7, 4, -1, -1, -1, -1},
+	{5, 6, 2, 9, 5, 2, 4, 9, 2, 7, 4, 2, 3, 7, 2, -1},
+	{11, 3, 2, 8, 7, 4, 6, 10, 5, -1, -1, -1, -1, -1, -1, -1},
+	{7, 4, 0, 11, 7, 0, 2, 11, 0, 6, 10, 5, -1, -1, -1, -1},
+	{9, 1, 0, 11, 3, 2, 8, 7, 4, 6, 10, 5, -1, -1, -1, -1},
+	{4, 9, 1, 7, 4, 1, 11, 7, 1, 2, 11, 1, 6, 10, 5, -1},
+	{11, 3, 1, 6, 11, 1, 5, 6, 1, 8, 7, 4, -1, -1, -1, -1},
+	{7, 4, 0, 11, 7, 0, 6, 11, 0, 5, 6, 0, 1, 5, 0, -1},
+	{11, 3, 0, 6, 11, 0, 5, 6, 0, 9, 5, 0, 8, 7, 4, -1},
+	{11, 7, 4, 6, 11, 4, 5, 6, 4, 9, 5, 4, -1, -1, -1, -1},
+	{10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1},
+	{10, 1, 0, 6, 10, 0, 4, 6, 0, -1, -1, -1, -1, -1, -1, -1},
+	{6, 10, 1, 4, 6, 1, 8, 4, 1, 3, 8, 1, -1, -1, -1, -1},
+	{6, 2, 1, 4, 6, 1, 9, 4, 1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 6, 2, 1, 4, 6, 1, 9, 4, 1, -1, -1, -1, -1},
+	{6, 2, 0, 4, 6, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 6, 2, 8, 4, 2, 3, 8, 2, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 2, 10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 0, 2, 11, 0, 10, 9, 4, 6, 10, 4, -1, -1, -1, -1},
+	{10, 1, 0, 6, 10, 0, 4, 6, 0, 11, 3, 2, -1, -1, -1, -1},
+	{6, 10, 1, 4, 6, 1, 8, 4, 1, 11, 8, 1, 2, 11, 1, -1},
+	{11, 3, 1, 6, 11, 1, 4, 6, 1, 9, 4, 1, -1, -1, -1, -1},
+	{11, 8, 0, 6, 11, 0, 4, 6, 0, 9, 4, 0, 1, 9, 0, -1},
+	{11, 3, 0, 6, 11, 0, 4, 6, 0, -1, -1, -1, -1, -1, -1, -1},
+	{11, 8, 4, 6, 11, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 7, 6, 9, 8, 6, 10, 9, 6, -1, -1, -1, -1, -1, -1, -1},
+	{10, 9, 0, 6, 10, 0, 7, 6, 0, 3, 7, 0, -1, -1, -1, -1},
+	{10, 1, 0, 6, 10, 0, 7, 6, 0, 8, 7, 0, -1, -1, -1, -1},
+	{6, 10, 1, 7, 6, 1, 3, 7, 1, -1, -1, -1, -1, -1, -1, -1},
+	{6, 2, 1, 7, 6, 1, 8, 7, 1, 9, 8, 1, -1, -1, -1, -1},
+	{1, 9, 0, 2, 1, 0, 6, 2, 0, 7, 6, 0, 3, 7, 0, -1},
+	{6, 2, 0, 7, 6, 0, 8, 7, 0, -1, -1, -1, -1, -1, -1, -1},
+	{7, 6, 2, 3, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 2, 8, 7, 6, 9, 8, 6, 10, 9, 6, -1, -1, -1, -1},
+	{10, 9, 0, 6, 10, 0, 7, 6, 0, 11, 7, 0, 2, 11, 0, -1},
+	{10, 1, 0, 6, 10, 0, 7, 6, 0, 8, 7, 0, 11, 3, 2, -1},
+	{6, 10, 1, 7, 6, 1, 11, 7, 1, 2, 11, 1, -1, -1, -1, -1},
+	{11, 3, 1, 6, 11, 1, 7, 6, 1, 8, 7, 1, 9, 8, 1, -1},
+	{1, 9, 0, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 3, 0, 6, 11, 0, 7, 6, 0, 8, 7, 0, -1, -1, -1, -1},
+	{11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 3, 8, 1, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 1, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 10, 2, 1, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 0, 9, 10, 0, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1},
+	{9, 10, 2, 8, 9, 2, 3, 8, 2, 7, 11, 6, -1, -1, -1, -1},
+	{7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 6, 7, 0, 2, 6, 0, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 7, 8, 1, 6, 7, 1, 2, 6, 1, -1, -1, -1, -1},
+	{7, 3, 1, 6, 7, 1, 10, 6, 1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 6, 7, 0, 10, 6, 0, 1, 10, 0, -1, -1, -1, -1},
+	{7, 3, 0, 6, 7, 0, 10, 6, 0, 9, 10, 0, -1, -1, -1, -1},
+	{9, 10, 6, 8, 9, 6, 7, 8, 6, -1, -1, -1, -1, -1, -1, -1},
+	{11, 6, 4, 8, 11, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{6, 4, 0, 11, 6, 0, 3, 11, 0, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 11, 6, 4, 8, 11, 4, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 1, 6, 4, 1, 11, 6, 1, 3, 11, 1, -1, -1, -1, -1},
+	{10, 2, 1, 11, 6, 4, 8, 11, 4, -1, -1, -1, -1, -1, -1, -1},
+	{6, 4, 0, 11, 6, 0, 3, 11, 0, 10, 2, 1, -1, -1, -1, -1},
+	{10, 2, 0, 9, 10, 0, 11, 6, 4, 8, 11, 4, -1, -1, -1, -1},
+	{9, 10, 2, 4, 9, 2, 6, 4, 2, 11, 6, 2, 3, 11, 2, -1},
+	{8, 3, 2, 4, 8, 2, 6, 4, 2, -1, -1, -1, -1, -1, -1, -1},
+	{6, 4, 0, 2, 6, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 8, 3, 2, 4, 8, 2, 6, 4, 2, -1, -1, -1, -1},
+	{4, 9, 1, 6, 4, 1, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 1, 4, 8, 1, 6, 4, 1, 10, 6, 1, -1, -1, -1, -1},
+	{6, 4, 0, 10, 6, 0, 1, 10, 0, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 0, 4, 8, 0, 6, 4, 0, 10, 6, 0, 9, 10, 0, -1},
+	{10, 6, 4, 9, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 4, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 5, 9, 4, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1},
+	{5, 1, 0, 4, 5, 0, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1},
+	{4, 5, 1, 8, 4, 1, 3, 8, 1, 7, 11, 6, -1, -1, -1, -1},
+	{10, 2, 1, 5, 9, 4, 7, 11, 6, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 10, 2, 1, 5, 9, 4, 7, 11, 6, -1, -1, -1, -1},
+	{10, 2, 0, 5, 10, 0, 4, 5, 0, 7, 11, 6, -1, -1, -1, -1},
+	{5, 10, 2, 4, 5, 2, 8, 4, 2, 3, 8, 2, 7, 11, 6, -1},
+	{7, 3, 2, 6, 7, 2, 5, 9, 4, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 6, 7, 0, 2, 6, 0, 5, 9, 4, -1, -1, -1, -1},
+	{5, 1, 0, 4, 5, 0, 7, 3, 2, 6, 7, 2, -1, -1, -1, -1},
+	{4, 5, 1, 8, 4, 1, 7, 8, 1, 6, 7, 1, 2, 6, 1, -1},
+	{7, 3, 1, 6, 7, 1, 10, 6, 1, 5, 9, 4, -1, -1, -1, -1},
+	{7, 8, 0, 6, 7, 0, 10, 6, 0, 1, 10, 0, 5, 9, 4, -1},
+	{7, 3, 0, 6, 7, 0, 10, 6, 0, 5, 10, 0, 4, 5, 0, -1},
+	{7, 8, 4, 6, 7, 4, 10, 6, 4, 5, 10, 4, -1, -1, -1, -1},
+	{11, 6, 5, 8, 11, 5, 9, 8, 5, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 0, 6, 5, 0, 11, 6, 0, 3, 11, 0, -1, -1, -1, -1},
+	{5, 1, 0, 6, 5, 0, 11, 6, 0, 8, 11, 0, -1, -1, -1, -1},
+	{6, 5, 1, 11, 6, 1, 3, 11, 1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 2, 1, 11, 6, 5, 8, 11, 5, 9, 8, 5, -1, -1, -1, -1},
+	{5, 9, 0, 6, 5, 0, 11, 6, 0, 3, 11, 0, 10, 2, 1, -1},
+	{10, 2, 0, 5, 10, 0, 6, 5, 0, 11, 6, 0, 8, 11, 0, -1},
+	{5, 10, 2, 6, 5, 2, 11, 6, 2, 3, 11, 2, -1, -1, -1, -1},
+	{8, 3, 2, 9, 8, 2, 5, 9, 2, 6, 5, 2, -1, -1, -1, -1},
+	{5, 9, 0, 6, 5, 0, 2, 6, 0, -1, -1, -1, -1, -1, -1, -1},
+	{5, 1, 0, 6, 5, 0, 2, 6, 0, 3, 2, 0, 8, 3, 0, -1},
+	{6, 5, 1, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 1, 9, 8, 1, 5, 9, 1, 6, 5, 1, 10, 6, 1, -1},
+	{5, 9, 0, 6, 5, 0, 10, 6, 0, 1, 10, 0, -1, -1, -1, -1},
+	{8, 3, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 1, 3, 8, 1, 11, 10, 5, 7, 11, 5, -1, -1, -1, -1},
+	{11, 2, 1, 7, 11, 1, 5, 7, 1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 11, 2, 1, 7, 11, 1, 5, 7, 1, -1, -1, -1, -1},
+	{11, 2, 0, 7, 11, 0, 5, 7, 0, 9, 5, 0, -1, -1, -1, -1},
+	{7, 11, 2, 5, 7, 2, 9, 5, 2, 8, 9, 2, 3, 8, 2, -1},
+	{7, 3, 2, 5, 7, 2, 10, 5, 2, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 5, 7, 0, 10, 5, 0, 2, 10, 0, -1, -1, -1, -1},
+	{9, 1, 0, 7, 3, 2, 5, 7, 2, 10, 5, 2, -1, -1, -1, -1},
+	{8, 9, 1, 7, 8, 1, 5, 7, 1, 10, 5, 1, 2, 10, 1, -1},
+	{7, 3, 1, 5, 7, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 5, 7, 0, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1},
+	{7, 3, 0, 5, 7, 0, 9, 5, 0, -1, -1, -1, -1, -1, -1, -1},
+	{8, 9, 5, 7, 8, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 5, 4, 11, 10, 4, 8, 11, 4, -1, -1, -1, -1, -1, -1, -1},
+	{5, 4, 0, 10, 5, 0, 11, 10, 0, 3, 11, 0, -1, -1, -1, -1},
+	{9, 1, 0, 10, 5, 4, 11, 10, 4, 8, 11, 4, -1, -1, -1, -1},
+	{4, 9, 1, 5, 4, 1, 10, 5, 1, 11, 10, 1, 3, 11, 1, -1},
+	{11, 2, 1, 8, 11, 1, 4, 8, 1, 5, 4, 1, -1, -1, -1, -1},
+	{5, 4, 0, 1, 5, 0, 2, 1, 0, 11, 2, 0, 3, 11, 0, -1},
+	{11, 2, 0, 8, 11, 0, 4, 8, 0, 5, 4, 0, 9, 5, 0, -1},
+	{3, 11, 2, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 2, 4, 8, 2, 5, 4, 2, 10, 5, 2, -1, -1, -1, -1},
+	{5, 4, 0, 10, 5, 0, 2, 10, 0, -1, -1, -1, -1, -1, -1, -1},
+	{9, 1, 0, 8, 3, 2, 4, 8, 2, 5, 4, 2, 10, 5, 2, -1},
+	{4, 9, 1, 5, 4, 1, 10, 5, 1, 2, 10, 1, -1, -1, -1, -1},
+	{8, 3, 1, 4, 8, 1, 5, 4, 1, -1, -1, -1, -1, -1, -1, -1},
+	{5, 4, 0, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 0, 4, 8, 0, 5, 4, 0, 9, 5, 0, -1, -1, -1, -1},
+	{9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 9, 4, 11, 10, 4, 7, 11, 4, -1, -1, -1, -1, -1, -1, -1},
+	{3, 8, 0, 10, 9, 4, 11, 10, 4, 7, 11, 4, -1, -1, -1, -1},
+	{10, 1, 0, 11, 10, 0, 7, 11, 0, 4, 7, 0, -1, -1, -1, -1},
+	{11, 10, 1, 7, 11, 1, 4, 7, 1, 8, 4, 1, 3, 8, 1, -1},
+	{11, 2, 1, 7, 11, 1, 4, 7, 1, 9, 4, 1, -1, -1, -1, -1},
+	{3, 8, 0, 11, 2, 1, 7, 11, 1, 4, 7, 1, 9, 4, 1, -1},
+	{11, 2, 0, 7, 11, 0, 4, 7, 0, -1, -1, -1, -1, -1, -1, -1},
+	{7, 11, 2, 4, 7, 2, 8, 4, 2, 3, 8, 2, -1, -1, -1, -1},
+	{7, 3, 2, 4, 7, 2, 9, 4, 2, 10, 9, 2, -1, -1, -1, -1},
+	{7, 8, 0, 4, 7, 0, 9, 4, 0, 10, 9, 0, 2, 10, 0, -1},
+	{10, 1, 0, 2, 10, 0, 3, 2, 0, 7, 3, 0, 4, 7, 0, -1},
+	{2, 10, 1, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 3, 1, 4, 7, 1, 9, 4, 1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 4, 7, 0, 9, 4, 0, 1, 9, 0, -1, -1, -1, -1},
+	{7, 3, 0, 4, 7, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 9, 8, 11, 10, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 9, 0, 11, 10, 0, 3, 11, 0, -1, -1, -1, -1, -1, -1, -1},
+	{10, 1, 0, 11, 10, 0, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1},
+	{11, 10, 1, 3, 11, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 2, 1, 8, 11, 1, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 9, 0, 2, 1, 0, 11, 2, 0, 3, 11, 0, -1, -1, -1, -1},
+	{11, 2, 0, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 2, 9, 8, 2, 10, 9, 2, -1, -1, -1, -1, -1, -1, -1},
+	{10, 9, 0, 2, 10, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 1, 0, 2, 10, 0, 3, 2, 0, 8, 3, 0, -1, -1, -1, -1},
+	{2, 10, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 1, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 9, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}
+};
+
+static inline unsigned long long edgeKey(int gx, int gy, int gz, int axis)
+{
+	const unsigned long long mask = (1ULL << 20) - 1;
+	return ((unsigned long long)(gx & mask) << 42)
+		| ((unsigned long long)(gy & mask) << 22)
+		| ((unsigned long long)(gz & mask) << 2)
+		| (unsigned long long)axis;
+}
+
+//
+// sparse volume
+//
+SparseVolume::SparseVolume(float voxel_size) : voxel_size(voxel_size), has_color(false)
+{
+}
+
+SparseVolume::~SparseVolume()
+{
+	clear();
+}
+
+void SparseVolume::clear()
+{
+	for (int i = 0; i < blocks.size(); i++)
+		delete blocks[i];
+
+	blocks.clear();
+	block_map.clear();
+	vertex_map.clear();
+}
+
+void SparseVolume::setVoxelSize(float size)
+{
+	if (size == voxel_size) return;
+
+	clear();
+	voxel_size = size;
+}
+
+SparseVolume::Block* SparseVolume::getBlock(int bx, int by, int bz)
+{
+	const unsigned long long key = blockKey(bx, by, bz);
+
+	boost::unordered_map<unsigned long long, Block*>::iterator it = block_map.find(key);
+	if (it != block_map.end()) return it->second;
+
+	Block *block = new Block;
+	block->x = bx;
+	block->y = by;
+	block->z = bz;
+	block->dirty = true;
+
+	for (int i = 0; i < BLOCK_VOXELS; i++)
+	{
+		Voxel &v = block->voxels[i];
+		v.sdf = 1;
+		v.weight = 0;
+		v.r = v.g = v.b = 0;
+	}
+
+	block_map[key] = block;
+	blocks.push_back(block);
+
+	return block;
+}
+
+SparseVolume::Block* SparseVolume::findBlock(int bx, int by, int bz) const
+{
+	boost::unordered_map<unsigned long long, Block*>::const_iterator it = block_map.find(blockKey(bx, by, bz));
+	return it == block_map.end() ? NULL : it->second;
+}
+
+const SparseVolume::Voxel* SparseVolume::findVoxel(int gx, int gy, int gz) const
+{
+	const int bx = blockCoord(gx);
+	const int by = blockCoord(gy);
+	const int bz = blockCoord(gz);
+
+	const Block *block = findBlock(bx, by, bz);
+	if (!block) return NULL;
+
+	return &block->voxels[voxelIndex(gx - bx * BLOCK_SIZE, gy - by * BLOCK_SIZE, gz - bz * BLOCK_SIZE)];
+}
+
+//
+// extraction
+//
+class BlockSampler
+{
+public:
+
+	BlockSampler(const SparseVolume &volume, const SparseVolume::Block &block, float min_weight)
+		: volume(volume), block(block), min_weight(min_weight)
+		, ox(block.x * SparseVolume::BLOCK_SIZE)
+		, oy(block.y * SparseVolume::BLOCK_SIZE)
+		, oz(block.z * SparseVolume::BLOCK_SIZE)
+	{}
+
+	inline const SparseVolume::Voxel* get(int gx, int gy, int gz) const
+	{
+		const int lx = gx - ox, ly = gy - oy, lz = gz - oz;
+
+		const SparseVolume::Voxel *v;
+		if (lx >= 0 && ly >= 0 && lz >= 0 && lx < SparseVolume::BLOCK_SIZE && ly < SparseVolume::BLOCK_SIZE && lz < SparseVolume::BLOCK_SIZE)
+			v = &block.voxels[SparseVolume::voxelIndex(lx, ly, lz)];
+		else
+			v = volume.findVoxel(gx, gy, gz);
+
+		return (v && v->weight > min_weight) ? v : NULL;
+	}
+
+	inline float sdf(int gx, int gy, int gz, float fallback) const
+	{
+		const SparseVolume::Voxel *v = get(gx, gy, gz);
+		return v ? v->sdf : fallback;
+	}
+
+	// central differences, one sided next to unobserved voxels
+	ofVec3f gradient(int gx, int gy, int gz, float center) const
+	{
+		return ofVec3f(sdf(gx + 1, gy, gz, center) - sdf(gx - 1, gy, gz, center),
+					   sdf(gx, gy + 1, gz, center) - sdf(gx, gy - 1, gz, center),
+					   sdf(gx, gy, gz + 1, center) - sdf(gx, gy, gz - 1, center));
+	}
+
+	const SparseVolume &volume;
+	const SparseVolume::Block &block;
+	float min_weight;
+	int ox, oy, oz;
+};
+
+void SparseVolume::extractBlock(Block &block, float min_weight) const
+{
+	const int S = BLOCK_SIZE;
+	const int E = BLOCK_SIZE + 1;
+
+	MeshPiece &piece = block.piece;
+	piece.clear();
+
+	BlockSampler sampler(*this, block, min_weight);
+
+	// local vertex per (lower corner, axis), corners range over 0..BLOCK_SIZE
+	int local_edges[E * E * E * 3];
+	std::fill(local_edges, local_edges + E * E * E * 3, -1);
+
+	const float inv_byte = 1. / 255.;
+
+	for (int lz = 0; lz < S; lz++)
+	for (int ly = 0; ly < S; ly++)
+	for (int lx = 0; lx < S; lx++)
+	{
+		const int gx = sampler.ox + lx;
+		const int gy = sampler.oy + ly;
+		const int gz = sampler.oz + lz;
+
+		const Voxel *corners[8];
+		int cube_index = 0;
+		bool valid = true;
+
+		for (int c = 0; c < 8; c++)
+		{
+			corners[c] = sampler.get(gx + corner_offsets[c][0], gy + corner_offsets[c][1], gz + corner_offsets[c][2]);
+			if (!corners[c])
+			{
+				valid = false;
+				break;
+			}
+
+			if (corners[c]->sdf < 0) cube_index |= 1 << c;
+		}
+
+		if (!valid || edge_table[cube_index] == 0) continue;
+
+		for (int t = 0; triangle_table[cube_index][t] != -1; t++)
+		{
+			const int e = triangle_table[cube_index][t];
+
+			int a = edge_corners[e][0];
+			int b = edge_corners[e][1];
+
+			int axis = 0;
+			while (corner_offsets[a][axis] == corner_offsets[b][axis]) axis++;
+
+			if (corner_offsets[a][axis] > corner_offsets[b][axis]) std::swap(a, b);
+
+			const int ax = lx + corner_offsets[a][0];
+			const int ay = ly + corner_offsets[a][1];
+			const int az = lz + corner_offsets[a][2];
+
+			int &index = local_edges[((az * E + ay) * E + ax) * 3 + axis];
+
+			if (index < 0)
+			{
+				const Voxel &va = *corners[a];
+				const Voxel &vb = *corners[b];
+
+				const float s = va.sdf / (va.sdf - vb.sdf);
+
+				ofVec3f ga(gx + corner_offsets[a][0], gy + corner_offsets[a][1], gz + corner_offsets[a][2]);
+				ofVec3f gb(gx + corner_offsets[b][0], gy + corner_offsets[b][1], gz + corner_offsets[b][2]);
+
+				ofVec3f n = sampler.gradient(ga.x, ga.y, ga.z, va.sdf) * (1 - s) + sampler.gradient(gb.x, gb.y, gb.z, vb.sdf) * s;
+				const float length = n.length();
+				if (length > 0) n /= length;
+
+				index = piece.vertices.size();
+				piece.edge_ids.push_back(edgeKey(ga.x, ga.y, ga.z, axis));
+				piece.vertices.push_back((ga + (gb - ga) * s) * voxel_size);
+				piece.normals.push_back(n);
+
+				if (has_color)
+				{
+					piece.colors.push_back(ofFloatColor((va.r + (vb.r - va.r) * s) * inv_byte,
+														(va.g + (vb.g - va.g) * s) * inv_byte,
+														(va.b + (vb.b - va.b) * s) * inv_byte));
+				}
+			}
+
+			piece.indices.push_back(index);
+		}
+	}
+}
+
+class SparseVolumeExtractor
+{
+public:
+
+	SparseVolumeExtractor(const SparseVolume &volume, const vector<SparseVolume::Block*> &blocks, float min_weight)
+		: volume(volume), blocks(blocks), min_weight(min_weight) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			volume.extractBlock(*blocks[i], min_weight);
+	}
+
+protected:
+
+	const SparseVolume &volume;
+	const vector<SparseVolume::Block*> &blocks;
+	float min_weight;
+};
+
+void SparseVolume::extract(ofMesh &mesh, float min_weight, bool incremental)
+{
+	vector<Block*> targets;
+
+	if (!incremental)
+	{
+		targets = blocks;
+	}
+	else
+	{
+		// cubes of a block reach one voxel into the +x/+y/+z neighbors, so a
+		// dirty block also invalidates its -x/-y/-z neighbors
+		std::set<Block*> updated;
+
+		for (int i = 0; i < blocks.size(); i++)
+		{
+			const Block *b = blocks[i];
+			if (!b->dirty) continue;
+
+			for (int z = -1; z <= 0; z++)
+			for (int y = -1; y <= 0; y++)
+			for (int x = -1; x <= 0; x++)
+			{
+				Block *n = findBlock(b->x + x, b->y + y, b->z + z);
+				if (n) updated.insert(n);
+			}
+		}
+
+		targets.assign(updated.begin(), updated.end());
+	}
+
+	SparseVolumeExtractor extractor(*this, targets, min_weight);
+	parallelFor(0, targets.size(), extractor);
+
+	for (int i = 0; i < blocks.size(); i++)
+		blocks[i]->dirty = false;
+
+	// weld the pieces, a vertex on a block border is shared through its edge id
+	vector<ofVec3f> &vertices = mesh.getVertices();
+	vector<ofVec3f> &normals = mesh.getNormals();
+	vector<ofFloatColor> &colors = mesh.getColors();
+	vector<ofIndexType> &indices = mesh.getIndices();
+
+	vertices.clear();
+	normals.clear();
+	colors.clear();
+	indices.clear();
+
+	vertex_map.clear();
+
+	vector<ofIndexType> remap;
+
+	for (int i = 0; i < blocks.size(); i++)
+	{
+		const MeshPiece &piece = blocks[i]->piece;
+		if (piece.indices.empty()) continue;
+
+		remap.resize(piece.vertices.size());
+
+		for (int k = 0; k < piece.vertices.size(); k++)
+		{
+			std::pair<boost::unordered_map<unsigned long long, ofIndexType>::iterator, bool> r
+				= vertex_map.insert(std::make_pair(piece.edge_ids[k], (ofIndexType)vertices.size()));
+
+			remap[k] = r.first->second;
+
+			if (r.second)
+			{
+				vertices.push_back(piece.vertices[k]);
+				normals.push_back(piece.normals[k]);
+				if (has_color) colors.push_back(piece.colors[k]);
+			}
+		}
+
+		for (int k = 0; k < piece.indices.size(); k++)
+			indices.push_back(remap[piece.indices[k]]);
+	}
+
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+}
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <boost/unordered_map.hpp>
+
+namespace ofxPCL
+{
+
+//
+// sparse volume
+//
+// signed distance samples stored in 8x8x8 voxel blocks, allocated only
+// near the surface and looked up through a hash table, so memory grows
+// with the surface area instead of the bounding volume.
+//
+class SparseVolume
+{
+public:
+
+	enum
+	{
+		BLOCK_SIZE = 8,
+		BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE
+	};
+
+	// sdf is negative inside, weight 0 marks an unobserved voxel
+	struct Voxel
+	{
+		float sdf;
+		float weight;
+		unsigned char r, g, b;
+	};
+
+	// triangles of one block, vertices are keyed by the id of the grid
+	// edge they lie on so the pieces can be welded together
+	struct MeshPiece
+	{
+		vector<unsigned long long> edge_ids;
+		vector<ofVec3f> vertices;
+		vector<ofVec3f> normals;
+		vector<ofFloatColor> colors;
+		vector<ofIndexType> indices;
+
+		void clear()
+		{
+			edge_ids.clear();
+			vertices.clear();
+			normals.clear();
+			colors.clear();
+			indices.clear();
+		}
+	};
+
+	struct Block
+	{
+		int x, y, z;
+		Voxel voxels[BLOCK_VOXELS];
+
+		// set when voxels changed since the last extract()
+		bool dirty;
+
+		MeshPiece piece;
+	};
+
+	SparseVolume(float voxel_size = 1);
+	~SparseVolume();
+
+	void clear();
+
+	void setVoxelSize(float size);
+	float getVoxelSize() const { return voxel_size; }
+
+	void setHasColor(bool v) { has_color = v; }
+	bool getHasColor() const { return has_color; }
+
+	// not thread safe, allocate every block before filling them in parallel
+	Block* getBlock(int bx, int by, int bz);
+	Block* findBlock(int bx, int by, int bz) const;
+
+	const Voxel* findVoxel(int gx, int gy, int gz) const;
+
+	vector<Block*>& getBlocks() { return blocks; }
+	const vector<Block*>& getBlocks() const { return blocks; }
+
+	size_t getNumBlocks() const { return blocks.size(); }
+
+	// parallel marching cubes over the blocks. with `incremental` only the
+	// dirty blocks and the neighbors sharing their cubes are re-extracted,
+	// the other blocks reuse their cached triangles.
+	void extract(ofMesh &mesh, float min_weight = 0, bool incremental = false);
+
+	static inline int blockCoord(int g)
+	{
+		return g >= 0 ? g / BLOCK_SIZE : (g + 1) / BLOCK_SIZE - 1;
+	}
+
+	static inline int voxelIndex(int lx, int ly, int lz)
+	{
+		return (lz * BLOCK_SIZE + ly) * BLOCK_SIZE + lx;
+	}
+
+	static inline unsigned long long blockKey(int bx, int by, int bz)
+	{
+		const unsigned long long mask = (1ULL << 21) - 1;
+		return ((unsigned long long)(bx & mask) << 42) | ((unsigned long long)(by & mask) << 21) | (unsigned long long)(bz & mask);
+	}
+
+	static inline void blockCoords(unsigned long long key, int &bx, int &by, int &bz)
+	{
+		const int mask = (1 << 21) - 1;
+		const int sign = 1 << 20;
+
+		bx = (int)((key >> 42) & mask);
+		by = (int)((key >> 21) & mask);
+		bz = (int)(key & mask);
+
+		if (bx & sign) bx -= 1 << 21;
+		if (by & sign) by -= 1 << 21;
+		if (bz & sign) bz -= 1 << 21;
+	}
+
+protected:
+
+	float voxel_size;
+	bool has_color;
+
+	boost::unordered_map<unsigned long long, Block*> block_map;
+	vector<Block*> blocks;
+
+	boost::unordered_map<unsigned long long, ofIndexType> vertex_map;
+
+	void extractBlock(Block &block, float min_weight) const;
+
+	friend class SparseVolumeExtractor;
+};
+
+}
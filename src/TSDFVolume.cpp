@@ -0,0 +1,220 @@
+#include "TSDFVolume.h"
+
+#include "ofxPCL.h"
+
+#include <boost/unordered_set.hpp>
+
+namespace ofxPCL
+{
+
+//
+// block allocation, every block crossed by the truncation band around a
+// measured point
+//
+class TSDFAllocation
+{
+public:
+
+	typedef boost::unordered_set<unsigned long long> Keys;
+
+	TSDFAllocation(const ColorPointCloud &cloud, const Eigen::Affine3f &pose, float voxel_size, float truncation)
+		: cloud(cloud), pose(pose), voxel_size(voxel_size), truncation(truncation) {}
+
+	void operator()(int begin, int end, Keys &local)
+	{
+		const float block_size = voxel_size * SparseVolume::BLOCK_SIZE;
+		const float step = block_size * 0.5;
+		const int num_steps = ceilf(2 * truncation / step);
+		const float inv_block_size = 1. / block_size;
+
+		for (int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < cloud->width; x++)
+			{
+				const ColorPointType &p = cloud->points[y * cloud->width + x];
+				if (!pcl_isfinite(p.z)) continue;
+
+				const Eigen::Vector3f point = p.getVector3fMap();
+				const Eigen::Vector3f ray = point.normalized();
+
+				for (int i = 0; i <= num_steps; i++)
+				{
+					const Eigen::Vector3f w = pose * (point + ray * (i * step - truncation));
+
+					local.insert(SparseVolume::blockKey(floorf(w.x() * inv_block_size),
+														floorf(w.y() * inv_block_size),
+														floorf(w.z() * inv_block_size)));
+				}
+			}
+		}
+
+	}
+
+	void join(Keys &keys, const Keys &partial)
+	{
+		keys.insert(partial.begin(), partial.end());
+	}
+
+protected:
+
+	const ColorPointCloud &cloud;
+	const Eigen::Affine3f &pose;
+	float voxel_size, truncation;
+};
+
+//
+// projective integration, each voxel of a visible block is projected into
+// the frame and blended with the distance measured along its ray
+//
+class TSDFIntegration
+{
+public:
+
+	TSDFIntegration(const ColorPointCloud &cloud, const Eigen::Affine3f &world_to_camera, const vector<SparseVolume::Block*> &blocks,
+					const CameraIntrinsics &intrinsics, float voxel_size, float truncation, float max_weight, int skip)
+		: cloud(cloud), world_to_camera(world_to_camera), blocks(blocks), intrinsics(intrinsics)
+		, voxel_size(voxel_size), truncation(truncation), max_weight(max_weight), skip(skip)
+	{}
+
+	void operator()(int begin, int end)
+	{
+		const int S = SparseVolume::BLOCK_SIZE;
+		const int width = cloud->width;
+		const int height = cloud->height;
+		const float inv_skip = 1. / skip;
+		const bool distortion = intrinsics.hasDistortion();
+		const float inv_truncation = 1. / truncation;
+
+		// stepping one voxel along x in camera space
+		const Eigen::Vector3f step_x = world_to_camera.linear().col(0) * voxel_size;
+
+		for (int i = begin; i < end; i++)
+		{
+			SparseVolume::Block &block = *blocks[i];
+			bool changed = false;
+
+			for (int lz = 0; lz < S; lz++)
+			for (int ly = 0; ly < S; ly++)
+			{
+				Eigen::Vector3f c = world_to_camera * Eigen::Vector3f(block.x * S * voxel_size,
+																	 (block.y * S + ly) * voxel_size,
+																	 (block.z * S + lz) * voxel_size);
+
+				SparseVolume::Voxel *voxel = &block.voxels[SparseVolume::voxelIndex(0, ly, lz)];
+
+				for (int lx = 0; lx < S; lx++, voxel++, c += step_x)
+				{
+					if (c.z() <= 0) continue;
+
+					const float inv_z = 1. / c.z();
+					float x = c.x() * inv_z;
+					float y = c.y() * inv_z;
+
+					// the grid of a DepthLookup cloud is the distorted image's
+					if (distortion) intrinsics.distort(x, y);
+
+					const int u = (x * intrinsics.fx + intrinsics.cx) * inv_skip + 0.5f;
+					const int v = (y * intrinsics.fy + intrinsics.cy) * inv_skip + 0.5f;
+
+					if (u < 0 || v < 0 || u >= width || v >= height) continue;
+
+					const ColorPointType &p = cloud->points[v * width + u];
+					if (!pcl_isfinite(p.z)) continue;
+
+					// distance along the ray, positive in front of the surface
+					const float sdf = (p.z - c.z()) * c.norm() * inv_z;
+					if (sdf < -truncation) continue;
+
+					const float tsdf = std::min(1.f, sdf * inv_truncation);
+					const float w = voxel->weight;
+					const float inv_w = 1. / (w + 1);
+
+					voxel->sdf = (voxel->sdf * w + tsdf) * inv_w;
+					voxel->r = (voxel->r * w + p.r) * inv_w;
+					voxel->g = (voxel->g * w + p.g) * inv_w;
+					voxel->b = (voxel->b * w + p.b) * inv_w;
+					voxel->weight = std::min(w + 1, max_weight);
+
+					changed = true;
+				}
+			}
+
+			if (changed) block.dirty = true;
+		}
+	}
+
+protected:
+
+	const ColorPointCloud &cloud;
+	const Eigen::Affine3f &world_to_camera;
+	const vector<SparseVolume::Block*> &blocks;
+	const CameraIntrinsics &intrinsics;
+	float voxel_size, truncation, max_weight;
+	int skip;
+};
+
+TSDFVolume::TSDFVolume(float voxel_size, float truncation)
+	: volume(voxel_size)
+	, truncation(truncation)
+	, max_weight(64)
+	, lookup_dirty(true)
+{
+	volume.setHasColor(true);
+	frame = New<ColorPointCloud>();
+}
+
+void TSDFVolume::reset()
+{
+	volume.clear();
+}
+
+void TSDFVolume::setVoxelSize(float size)
+{
+	volume.setVoxelSize(size);
+}
+
+void TSDFVolume::integrate(const ColorPointCloud &cloud, const ofMatrix4x4 &camera_pose, const int skip)
+{
+	assert(cloud);
+	assert(cloud->isOrganized());
+
+	if (cloud->points.empty()) return;
+
+	const Eigen::Affine3f pose(toEigen(camera_pose));
+	const Eigen::Affine3f world_to_camera = pose.inverse();
+
+	TSDFAllocation allocation(cloud, pose, volume.getVoxelSize(), truncation);
+	const TSDFAllocation::Keys keys = parallelReduce(0, cloud->height, TSDFAllocation::Keys(), allocation, 8);
+
+	visible_blocks.clear();
+	visible_blocks.reserve(keys.size());
+
+	for (boost::unordered_set<unsigned long long>::iterator it = keys.begin(); it != keys.end(); ++it)
+	{
+		int bx, by, bz;
+		SparseVolume::blockCoords(*it, bx, by, bz);
+		visible_blocks.push_back(volume.getBlock(bx, by, bz));
+	}
+
+	TSDFIntegration integration(cloud, world_to_camera, visible_blocks, intrinsics, volume.getVoxelSize(), truncation, max_weight, skip);
+	parallelFor(0, visible_blocks.size(), integration);
+}
+
+void TSDFVolume::integrate(const ofPixels& color, const ofShortPixels& depth, const ofMatrix4x4 &camera_pose, const int skip)
+{
+	if (lookup_dirty || lookup.getSkip() != skip)
+	{
+		lookup.setup(intrinsics, skip);
+		lookup_dirty = false;
+	}
+
+	convert(color, depth, frame, lookup);
+	integrate(frame, camera_pose, skip);
+}
+
+void TSDFVolume::extract(ofMesh &mesh, bool incremental)
+{
+	volume.extract(mesh, 0, incremental);
+}
+
+}
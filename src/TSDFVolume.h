@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Types.h"
+#include "Utility.h"
+#include "DepthLookup.h"
+#include "SparseVolume.h"
+
+namespace ofxPCL
+{
+
+//
+// tsdf volume
+//
+// fuses organized frames from convert() or a DepthLookup into a
+// truncated signed distance volume, kinect fusion style but on the cpu.
+// voxels live in the blocks of a SparseVolume, only blocks near an observed
+// surface are allocated, and extract() re-meshes just the blocks that
+// changed since the last call.
+//
+class TSDFVolume
+{
+public:
+
+	TSDFVolume(float voxel_size = 0.01, float truncation = 0.04);
+
+	void reset();
+
+	// clears the volume
+	void setVoxelSize(float size);
+	float getVoxelSize() const { return volume.getVoxelSize(); }
+
+	// distance in meters over which the signed distance is kept
+	void setTruncation(float v) { truncation = v; }
+	float getTruncation() const { return truncation; }
+
+	// caps the fusion weight so the volume keeps adapting to changes
+	void setMaxWeight(float v) { max_weight = v; }
+	float getMaxWeight() const { return max_weight; }
+
+	// the ones the clouds are converted with, the default is the kinect's
+	void setIntrinsics(const CameraIntrinsics &intrinsics) { this->intrinsics = intrinsics; lookup_dirty = true; }
+	const CameraIntrinsics& getIntrinsics() const { return intrinsics; }
+
+	// `camera_pose` maps camera to world coordinates, `skip` must be the
+	// one the cloud was converted with
+	void integrate(const ColorPointCloud &cloud, const ofMatrix4x4 &camera_pose, const int skip = 1);
+	void integrate(const ofPixels& color, const ofShortPixels& depth, const ofMatrix4x4 &camera_pose, const int skip = 1);
+
+	void extract(ofMesh &mesh, bool incremental = true);
+
+	SparseVolume& getVolume() { return volume; }
+	const SparseVolume& getVolume() const { return volume; }
+
+protected:
+
+	SparseVolume volume;
+
+	float truncation;
+	float max_weight;
+
+	CameraIntrinsics intrinsics;
+
+	// undistorts the images of the second integrate()
+	DepthLookup lookup;
+	bool lookup_dirty;
+
+	ColorPointCloud frame;
+	vector<SparseVolume::Block*> visible_blocks;
+};
+
+}
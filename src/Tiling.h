@@ -0,0 +1,726 @@
+#pragma once
+
+#include "ofxPCL.h"
+#include "Parallel.h"
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/ros/conversions.h>
+
+namespace ofxPCL
+{
+
+//
+// out-of-core tiling
+//
+// large clouds are split into axis aligned tiles on disk. every tile stores
+// its core region plus a halo of neighboring points, so operations that look
+// at a neighborhood (outlier removal, normals, mls, triangulation) give the
+// same result near tile borders as on the whole cloud.
+//
+struct Tile
+{
+	int x, y, z;
+
+	// core bounds, halo excluded
+	ofVec3f min, max;
+
+	string path;
+
+	// num_points counts the halo copies too, num_core_points only the
+	// points inside the core bounds
+	size_t num_points;
+	size_t num_core_points;
+
+	bool contains(float px, float py, float pz) const
+	{
+		return px >= min.x && px < max.x
+			&& py >= min.y && py < max.y
+			&& pz >= min.z && pz < max.z;
+	}
+};
+
+struct TileSet
+{
+	string directory;
+	ofVec3f tile_size;
+	float halo;
+
+	vector<Tile> tiles;
+
+	// every point once, halo copies excluded
+	size_t getNumPoints() const
+	{
+		size_t n = 0;
+		for (int i = 0; i < tiles.size(); i++)
+			n += tiles[i].num_core_points;
+		return n;
+	}
+};
+
+//
+// raw tile io
+//
+template <typename T>
+inline void appendTilePoints(const string &path, const typename T::value_type::VectorType &points, bool truncate = false)
+{
+	if (points.empty() && !truncate) return;
+
+	FILE *fp = fopen(path.c_str(), truncate ? "wb" : "ab");
+	if (!fp)
+	{
+		ofLogError("ofxPCL:appendTilePoints") << "can't open: " << path;
+		return;
+	}
+
+	if (!points.empty())
+		fwrite(&points[0], sizeof(typename T::value_type::PointType), points.size(), fp);
+
+	fclose(fp);
+}
+
+template <typename T>
+inline void loadTilePoints(const string &path, T &cloud)
+{
+	typedef typename T::value_type::PointType PointType;
+
+	if (!cloud)
+		cloud = New<T>();
+
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (!fp)
+	{
+		ofLogError("ofxPCL:loadTilePoints") << "file not found: " << path;
+		cloud->clear();
+		return;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	const size_t num_point = ftell(fp) / sizeof(PointType);
+	fseek(fp, 0, SEEK_SET);
+
+	cloud->width = num_point;
+	cloud->height = 1;
+	cloud->is_dense = true;
+	cloud->points.resize(num_point);
+
+	if (num_point > 0 && fread(&cloud->points[0], sizeof(PointType), num_point, fp) != num_point)
+		ofLogError("ofxPCL:loadTilePoints") << "short read: " << path;
+
+	fclose(fp);
+}
+
+//
+// chunked pcd reader
+//
+// binary pcd files are streamed `chunk_size` points at a time. ascii and
+// compressed files can't be seeked into, so they are loaded in one go.
+//
+template <typename T>
+class PCDChunkReader
+{
+public:
+
+	PCDChunkReader(const string &path, size_t chunk_size = 1000000)
+		: path(path), chunk_size(chunk_size), fp(NULL), remaining(0), done(false)
+	{
+		Eigen::Vector4f origin;
+		Eigen::Quaternionf orientation;
+		int version = 0;
+		int data_type = 0;
+		unsigned int data_idx = 0;
+
+		pcl::PCDReader reader;
+		if (reader.readHeader(path, header, origin, orientation, version, data_type, data_idx) < 0)
+		{
+			ofLogError("ofxPCL:PCDChunkReader") << "can't read header: " << path;
+			done = true;
+			return;
+		}
+
+		// only uncompressed binary data can be streamed
+		if (data_type != 1) return;
+
+		fp = fopen(path.c_str(), "rb");
+		if (!fp)
+		{
+			done = true;
+			return;
+		}
+
+		fseek(fp, data_idx, SEEK_SET);
+		remaining = header.width * header.height;
+	}
+
+	~PCDChunkReader()
+	{
+		if (fp) fclose(fp);
+	}
+
+	bool read(T &cloud)
+	{
+		if (!cloud)
+			cloud = New<T>();
+
+		if (done) return false;
+
+		if (!fp)
+		{
+			ofLogWarning("ofxPCL:PCDChunkReader") << "not a binary pcd, loading whole file: " << path;
+			pcl::io::loadPCDFile<typename T::value_type::PointType>(path, *cloud);
+			done = true;
+			return true;
+		}
+
+		const size_t n = std::min(chunk_size, remaining);
+		if (n == 0)
+		{
+			done = true;
+			return false;
+		}
+
+		sensor_msgs::PointCloud2 blob = header;
+		blob.width = n;
+		blob.height = 1;
+		blob.row_step = blob.point_step * n;
+		blob.data.resize(blob.row_step);
+
+		if (fread(&blob.data[0], blob.point_step, n, fp) != n)
+		{
+			ofLogError("ofxPCL:PCDChunkReader") << "short read: " << path;
+			done = true;
+			return false;
+		}
+
+		remaining -= n;
+		pcl::fromROSMsg(blob, *cloud);
+
+		return true;
+	}
+
+protected:
+
+	string path;
+	size_t chunk_size;
+	sensor_msgs::PointCloud2 header;
+	FILE *fp;
+	size_t remaining;
+	bool done;
+};
+
+//
+// streaming pcd writer
+//
+template <typename T>
+class PCDStreamWriter
+{
+public:
+
+	PCDStreamWriter(const string &path, size_t num_points) : num_written(0)
+	{
+		typedef typename T::value_type::PointType PointType;
+
+		fp = fopen(path.c_str(), "wb");
+		if (!fp)
+		{
+			ofLogError("ofxPCL:PCDStreamWriter") << "can't open: " << path;
+			return;
+		}
+
+		pcl::PointCloud<PointType> dummy;
+		dummy.width = num_points;
+		dummy.height = 1;
+
+		vector<sensor_msgs::PointField> all_fields;
+		pcl::getFields(dummy, all_fields);
+
+		for (int i = 0; i < all_fields.size(); i++)
+		{
+			if (all_fields[i].name == "_") continue;
+			fields.push_back(all_fields[i]);
+		}
+
+		packed_size = 0;
+		for (int i = 0; i < fields.size(); i++)
+			packed_size += pcl::getFieldSize(fields[i].datatype) * fields[i].count;
+
+		string header = pcl::PCDWriter().generateHeader(dummy, num_points) + "DATA binary\n";
+		fwrite(header.data(), 1, header.size(), fp);
+	}
+
+	~PCDStreamWriter()
+	{
+		if (fp) fclose(fp);
+	}
+
+	void write(const T &cloud)
+	{
+		if (!fp || cloud->points.empty()) return;
+
+		const size_t num_point = cloud->points.size();
+		buffer.resize(packed_size * num_point);
+
+		unsigned char *dst = &buffer[0];
+		for (int i = 0; i < num_point; i++)
+		{
+			const unsigned char *src = reinterpret_cast<const unsigned char*>(&cloud->points[i]);
+
+			for (int k = 0; k < fields.size(); k++)
+			{
+				const size_t size = pcl::getFieldSize(fields[k].datatype) * fields[k].count;
+				memcpy(dst, src + fields[k].offset, size);
+				dst += size;
+			}
+		}
+
+		fwrite(&buffer[0], 1, buffer.size(), fp);
+		num_written += num_point;
+	}
+
+	size_t getNumWritten() const { return num_written; }
+
+protected:
+
+	FILE *fp;
+	vector<sensor_msgs::PointField> fields;
+	size_t packed_size;
+	vector<unsigned char> buffer;
+	size_t num_written;
+};
+
+//
+// split
+//
+struct TileKey
+{
+	int x, y, z;
+
+	TileKey(int x, int y, int z) : x(x), y(y), z(z) {}
+
+	bool operator<(const TileKey &o) const
+	{
+		if (x != o.x) return x < o.x;
+		if (y != o.y) return y < o.y;
+		return z < o.z;
+	}
+};
+
+template <typename T>
+TileSet splitIntoTiles(const vector<string> &paths, const string &directory, ofVec3f tile_size, float halo, size_t chunk_size = 1000000)
+{
+	typedef typename T::value_type::PointType PointType;
+	typedef typename T::value_type::VectorType VectorType;
+
+	TileSet tileset;
+	tileset.directory = ofToDataPath(directory);
+	tileset.tile_size = tile_size;
+	tileset.halo = halo;
+
+	ofDirectory::createDirectory(tileset.directory, false, true);
+
+	std::map<TileKey, int> tile_index;
+	vector<VectorType> buffers;
+
+	T chunk = New<T>();
+
+	for (int n = 0; n < paths.size(); n++)
+	{
+		PCDChunkReader<T> reader(ofToDataPath(paths[n]), chunk_size);
+
+		while (reader.read(chunk))
+		{
+			for (int i = 0; i < chunk->points.size(); i++)
+			{
+				const PointType &p = chunk->points[i];
+				if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z)) continue;
+
+				// every tile whose halo-expanded box contains the point
+				const int x0 = floorf((p.x - halo) / tile_size.x), x1 = floorf((p.x + halo) / tile_size.x);
+				const int y0 = floorf((p.y - halo) / tile_size.y), y1 = floorf((p.y + halo) / tile_size.y);
+				const int z0 = floorf((p.z - halo) / tile_size.z), z1 = floorf((p.z + halo) / tile_size.z);
+
+				for (int z = z0; z <= z1; z++)
+				for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+				{
+					TileKey key(x, y, z);
+					std::map<TileKey, int>::iterator it = tile_index.find(key);
+
+					int index;
+					if (it == tile_index.end())
+					{
+						index = tileset.tiles.size();
+						tile_index[key] = index;
+
+						Tile tile;
+						tile.x = x;
+						tile.y = y;
+						tile.z = z;
+						tile.min = ofVec3f(x * tile_size.x, y * tile_size.y, z * tile_size.z);
+						tile.max = tile.min + tile_size;
+						tile.path = tileset.directory + "/tile_" + ofToString(x) + "_" + ofToString(y) + "_" + ofToString(z) + ".bin";
+						tile.num_points = 0;
+						tile.num_core_points = 0;
+						tileset.tiles.push_back(tile);
+
+						buffers.push_back(VectorType());
+						appendTilePoints<T>(tile.path, buffers.back(), true);
+					}
+					else index = it->second;
+
+					buffers[index].push_back(p);
+
+					Tile &tile = tileset.tiles[index];
+					if (tile.contains(p.x, p.y, p.z)) tile.num_core_points++;
+				}
+			}
+
+			for (int i = 0; i < buffers.size(); i++)
+			{
+				appendTilePoints<T>(tileset.tiles[i].path, buffers[i]);
+				tileset.tiles[i].num_points += buffers[i].size();
+				buffers[i].clear();
+			}
+		}
+	}
+
+	// tiles that only got halo points have nothing of their own to process
+	vector<Tile> tiles;
+	for (int i = 0; i < tileset.tiles.size(); i++)
+	{
+		const Tile &tile = tileset.tiles[i];
+
+		if (tile.num_core_points > 0)
+			tiles.push_back(tile);
+		else
+			ofFile::removeFile(tile.path, false);
+	}
+	tileset.tiles.swap(tiles);
+
+	return tileset;
+}
+
+template <typename T>
+inline TileSet splitIntoTiles(const string &path, const string &directory, ofVec3f tile_size, float halo, size_t chunk_size = 1000000)
+{
+	return splitIntoTiles<T>(vector<string>(1, path), directory, tile_size, halo, chunk_size);
+}
+
+//
+// process
+//
+// Op is called as `op(T1 input, T2 &output)` once per tile, from several
+// threads at once. the result keeps the halo so it can be processed again.
+//
+template <typename T1, typename T2, typename Op>
+class TileProcessor
+{
+public:
+
+	TileProcessor(const TileSet &input, TileSet &output, Op &op) : input(input), output(output), op(op) {}
+
+	void operator()(int begin, int end)
+	{
+		typedef typename T2::value_type::PointType PointType;
+
+		T1 cloud = New<T1>();
+
+		for (int i = begin; i < end; i++)
+		{
+			const Tile &src = input.tiles[i];
+			Tile &dst = output.tiles[i];
+
+			loadTilePoints(src.path, cloud);
+
+			T2 result = New<T2>();
+			if (!cloud->points.empty())
+				op(cloud, result);
+
+			appendTilePoints<T2>(dst.path, result->points, true);
+			dst.num_points = result->points.size();
+
+			dst.num_core_points = 0;
+			for (int k = 0; k < result->points.size(); k++)
+			{
+				const PointType &p = result->points[k];
+				if (dst.contains(p.x, p.y, p.z)) dst.num_core_points++;
+			}
+		}
+	}
+
+protected:
+
+	const TileSet &input;
+	TileSet &output;
+	Op &op;
+};
+
+template <typename T1, typename T2, typename Op>
+TileSet processTiles(const TileSet &input, Op op, const string &directory)
+{
+	TileSet output = input;
+	output.directory = ofToDataPath(directory);
+
+	ofDirectory::createDirectory(output.directory, false, true);
+
+	for (int i = 0; i < output.tiles.size(); i++)
+	{
+		Tile &tile = output.tiles[i];
+		tile.path = output.directory + "/tile_" + ofToString(tile.x) + "_" + ofToString(tile.y) + "_" + ofToString(tile.z) + ".bin";
+		tile.num_points = 0;
+		tile.num_core_points = 0;
+	}
+
+	TileProcessor<T1, T2, Op> processor(input, output, op);
+	parallelFor(0, input.tiles.size(), processor);
+
+	return output;
+}
+
+template <typename T, typename Op>
+inline TileSet processTiles(const TileSet &input, Op op, const string &directory)
+{
+	return processTiles<T, T, Op>(input, op, directory);
+}
+
+//
+// stitch
+//
+// writes the core region of every tile into a single binary pcd, one tile
+// in memory at a time.
+//
+template <typename T>
+size_t stitchTiles(const TileSet &tileset, const string &path)
+{
+	typedef typename T::value_type::PointType PointType;
+
+	T cloud = New<T>();
+	T core = New<T>();
+
+	// the pcd header needs the number of points up front
+	PCDStreamWriter<T> writer(ofToDataPath(path), tileset.getNumPoints());
+
+	for (int i = 0; i < tileset.tiles.size(); i++)
+	{
+		const Tile &tile = tileset.tiles[i];
+		loadTilePoints(tile.path, cloud);
+
+		core->points.clear();
+		for (int k = 0; k < cloud->points.size(); k++)
+		{
+			const PointType &p = cloud->points[k];
+			if (tile.contains(p.x, p.y, p.z)) core->points.push_back(p);
+		}
+
+		core->width = core->points.size();
+		core->height = 1;
+		writer.write(core);
+	}
+
+	return writer.getNumWritten();
+}
+
+//
+// tiled triangulation
+//
+// a triangle belongs to the tile containing its centroid. vertices close to
+// a tile border are welded by position, so seams stay connected.
+//
+template <typename T>
+class TileTriangulator
+{
+public:
+
+	TileTriangulator(const TileSet &tileset, vector<ofMesh> &meshes, float search_radius)
+		: tileset(tileset), meshes(meshes), search_radius(search_radius) {}
+
+	void operator()(int begin, int end)
+	{
+		T cloud = New<T>();
+
+		for (int i = begin; i < end; i++)
+		{
+			const Tile &tile = tileset.tiles[i];
+			loadTilePoints(tile.path, cloud);
+
+			ofMesh &result = meshes[i];
+			result.clear();
+
+			if (cloud->points.empty()) continue;
+
+			ofMesh mesh = triangulate(cloud, search_radius);
+
+			const vector<ofVec3f> &vertices = mesh.getVertices();
+			const vector<ofIndexType> &indices = mesh.getIndices();
+
+			vector<int> remap(vertices.size(), -1);
+
+			for (int k = 0; k + 2 < indices.size(); k += 3)
+			{
+				const ofVec3f c = (vertices[indices[k]] + vertices[indices[k + 1]] + vertices[indices[k + 2]]) / 3;
+				if (!tile.contains(c.x, c.y, c.z)) continue;
+
+				for (int j = 0; j < 3; j++)
+				{
+					const int v = indices[k + j];
+					if (remap[v] < 0)
+					{
+						remap[v] = result.getNumVertices();
+						result.addVertex(vertices[v]);
+						if (mesh.hasNormals()) result.addNormal(mesh.getNormals()[v]);
+						if (mesh.hasColors()) result.addColor(mesh.getColors()[v]);
+					}
+					result.addIndex(remap[v]);
+				}
+			}
+		}
+	}
+
+protected:
+
+	const TileSet &tileset;
+	vector<ofMesh> &meshes;
+	float search_radius;
+};
+
+template <typename T>
+ofMesh triangulateTiles(const TileSet &tileset, float search_radius = 30)
+{
+	vector<ofMesh> meshes(tileset.tiles.size());
+
+	TileTriangulator<T> triangulator(tileset, meshes, search_radius);
+	parallelFor(0, tileset.tiles.size(), triangulator);
+
+	ofMesh mesh;
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+	std::map<TileKey, vector<int> > buckets;
+	const float weld_cell = std::max(tileset.halo, 1e-6f);
+
+	for (int i = 0; i < meshes.size(); i++)
+	{
+		const Tile &tile = tileset.tiles[i];
+		const ofMesh &m = meshes[i];
+		const vector<ofVec3f> &vertices = m.getVertices();
+
+		// only vertices within the halo distance of a border are shared with neighbors
+		const ofVec3f inner_min = tile.min + ofVec3f(tileset.halo, tileset.halo, tileset.halo);
+		const ofVec3f inner_max = tile.max - ofVec3f(tileset.halo, tileset.halo, tileset.halo);
+
+		vector<int> remap(vertices.size());
+
+		for (int k = 0; k < vertices.size(); k++)
+		{
+			const ofVec3f &v = vertices[k];
+
+			const bool inner = v.x > inner_min.x && v.x < inner_max.x
+				&& v.y > inner_min.y && v.y < inner_max.y
+				&& v.z > inner_min.z && v.z < inner_max.z;
+
+			if (!inner)
+			{
+				vector<int> &bucket = buckets[TileKey(floorf(v.x / weld_cell), floorf(v.y / weld_cell), floorf(v.z / weld_cell))];
+
+				int found = -1;
+				for (int j = 0; j < bucket.size(); j++)
+				{
+					const ofVec3f &o = mesh.getVertices()[bucket[j]];
+					if (o.x == v.x && o.y == v.y && o.z == v.z)
+					{
+						found = bucket[j];
+						break;
+					}
+				}
+
+				if (found >= 0)
+				{
+					remap[k] = found;
+					continue;
+				}
+
+				bucket.push_back(mesh.getNumVertices());
+			}
+
+			remap[k] = mesh.getNumVertices();
+			mesh.addVertex(v);
+			if (m.hasNormals()) mesh.addNormal(m.getNormals()[k]);
+			if (m.hasColors()) mesh.addColor(m.getColors()[k]);
+		}
+
+		const vector<ofIndexType> &indices = m.getIndices();
+		for (int k = 0; k < indices.size(); k++)
+			mesh.addIndex(remap[indices[k]]);
+	}
+
+	return mesh;
+}
+
+//
+// tile operations
+//
+template <typename T>
+struct DownsampleOp
+{
+	ofVec3f resolution;
+
+	DownsampleOp(ofVec3f resolution = ofVec3f(1, 1, 1)) : resolution(resolution) {}
+
+	void operator()(T cloud, T &output)
+	{
+		downsample(cloud, resolution);
+		output = cloud;
+	}
+};
+
+template <typename T>
+struct StatisticalOutlierRemovalOp
+{
+	int nr_k;
+	double std_mul;
+
+	StatisticalOutlierRemovalOp(int nr_k = 50, double std_mul = 1.0) : nr_k(nr_k), std_mul(std_mul) {}
+
+	void operator()(T cloud, T &output)
+	{
+		statisticalOutlierRemoval(cloud, nr_k, std_mul);
+		output = cloud;
+	}
+};
+
+template <typename T>
+struct RadiusOutlierRemovalOp
+{
+	double radius;
+	int num_min_points;
+
+	RadiusOutlierRemovalOp(double radius, int num_min_points) : radius(radius), num_min_points(num_min_points) {}
+
+	void operator()(T cloud, T &output)
+	{
+		radiusOutlierRemoval(cloud, radius, num_min_points);
+		output = cloud;
+	}
+};
+
+template <typename T1, typename T2>
+struct NormalEstimationOp
+{
+	void operator()(T1 cloud, T2 &output)
+	{
+		normalEstimation(cloud, output);
+	}
+};
+
+template <typename T1, typename T2>
+struct MovingLeastSquaresOp
+{
+	float search_radius;
+
+	MovingLeastSquaresOp(float search_radius = 30) : search_radius(search_radius) {}
+
+	void operator()(T1 cloud, T2 &output)
+	{
+		movingLeastSquares(cloud, output, search_radius);
+	}
+};
+
+}
@@ -15,8 +15,13 @@ void convert(const ofPixels& color, const ofShortPixels& depth, ColorNormalPoint
 	convert(color, depth, temp, skip);
 	integralImageNormalEstimation<ColorPointCloud>(temp, normals);
 	
-	cloud->width = temp->points.size();
-	cloud->height = 1;		
+	// keep the depth image layout, invalid pixels stay NaN so the result
+	// can go to anything that needs an organized cloud
+	cloud->width = temp->width;
+	cloud->height = temp->height;
+	cloud->is_dense = temp->is_dense;
+	cloud->sensor_origin_ = temp->sensor_origin_;
+	cloud->sensor_orientation_ = temp->sensor_orientation_;
 	cloud->points.resize(cloud->width * cloud->height);
 	
 	for (int i = 0; i < cloud->points.size(); i++)
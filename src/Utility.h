@@ -3,16 +3,23 @@
 #include "ofMain.h"
 
 #include "Types.h"
+#include "CloudPool.h"
 
 #include <pcl/common/io.h>
+#include <pcl/PolygonMesh.h>
+#include <pcl/ros/conversions.h>
+#include <pcl/point_traits.h>
+
+#include <boost/mpl/contains.hpp>
 
 namespace ofxPCL
 {
 
+// an empty cloud from the CloudPool of its point type
 template <typename T>
 inline T New()
 {
-	return T(new pcl::PointCloud<typename T::value_type::PointType>);
+	return CloudPool<typename T::value_type::PointType>::instance().acquire();
 }
 
 
@@ -23,115 +30,170 @@ inline void copy(const T1& src, T2& dst)
 }
 
 //
-// mesh type conversion
+// matrix conversion
 //
+// ofMatrix4x4 is stored row major for row vectors, which has the same memory
+// layout as a column major Eigen matrix for column vectors
+//
+inline Eigen::Matrix4f toEigen(const ofMatrix4x4 &matrix)
+{
+	Eigen::Matrix4f mat;
+	memcpy(mat.data(), matrix.getPtr(), sizeof(float) * 16);
+	return mat;
+}
 
-template <class T1, class T2>
-void convert(const T1&, T2&);
+inline ofMatrix4x4 toOF(const Eigen::Matrix4f &mat)
+{
+	ofMatrix4x4 matrix;
+	memcpy(matrix.getPtr(), mat.data(), sizeof(float) * 16);
+	return matrix;
+}
 
-template <>
-inline void convert(const PointCloud& cloud, ofMesh& mesh)
+//
+//
+// point field traits
+//
+// what a point type carries, read at compile time from the field list pcl
+// registers for it. the conversions below are written once against these,
+// every field access goes through a small struct that is empty for the
+// fields a type lacks, so each point type gets its own straight loop and
+// any registered point type converts to and from ofMesh.
+//
+template <typename P>
+struct PointFields
 {
-	assert(cloud);
-	
-	const size_t num_point = cloud->points.size();
-	if (mesh.getNumVertices() != num_point) mesh.getVertices().resize(num_point);
+	typedef typename pcl::traits::fieldList<P>::type FieldList;
 
-	for (int i = 0; i < num_point; i++)
-	{
-		PointType &p = cloud->points[i];
-		mesh.setVertex(i, ofVec3f(p.x, p.y, p.z));
-	}
-}
+	static const bool has_xyz = boost::mpl::contains<FieldList, pcl::fields::x>::value;
+	static const bool has_color = boost::mpl::contains<FieldList, pcl::fields::rgb>::value
+		|| boost::mpl::contains<FieldList, pcl::fields::rgba>::value;
+	static const bool has_normal = boost::mpl::contains<FieldList, pcl::fields::normal_x>::value;
+	static const bool has_curvature = boost::mpl::contains<FieldList, pcl::fields::curvature>::value;
+};
 
-template <>
-inline void convert(const ColorPointCloud& cloud, ofMesh& mesh)
+template <typename P, bool enabled = PointFields<P>::has_xyz>
+struct PositionField
 {
-	assert(cloud);
-	
-	float inv_byte = 1. / 255.;
-	const size_t num_point = cloud->points.size();
-	
-	if (mesh.getNumVertices() != num_point) mesh.getVertices().resize(num_point);
-	if (mesh.getNumColors() != num_point) mesh.getColors().resize(num_point);
+	static void get(const P &p, ofVec3f *vertices, int i) {}
+	static void set(P &p, const ofVec3f &v) {}
+};
 
-	for (int i = 0; i < num_point; i++)
+template <typename P>
+struct PositionField<P, true>
+{
+	static void get(const P &p, ofVec3f *vertices, int i) { vertices[i].set(p.x, p.y, p.z); }
+	static void set(P &p, const ofVec3f &v) { p.x = v.x; p.y = v.y; p.z = v.z; }
+};
+
+template <typename P, bool enabled = PointFields<P>::has_color>
+struct ColorField
+{
+	static void get(const P &p, ofFloatColor *colors, int i) {}
+	static void set(P &p, const ofFloatColor &c) {}
+	static void set(P &p, const ofColor &c) {}
+};
+
+template <typename P>
+struct ColorField<P, true>
+{
+	static void get(const P &p, ofFloatColor *colors, int i)
 	{
-		ColorPointType &p = cloud->points[i];
-		mesh.setColor(i, ofFloatColor(p.r * inv_byte, p.g * inv_byte, p.b * inv_byte));
-		mesh.setVertex(i, ofVec3f(p.x, p.y, p.z));
+		const float inv_byte = 1. / 255.;
+		colors[i].set(p.r * inv_byte, p.g * inv_byte, p.b * inv_byte);
 	}
-}
-	
-template <>
-inline void convert(const PointNormalPointCloud& cloud, ofMesh& mesh)
-{
-	assert(cloud);
-	
-	const size_t num_point = cloud->points.size();
-	
-	if (mesh.getNumVertices() != num_point) mesh.getVertices().resize(num_point);
-	if (mesh.getNumNormals() != num_point) mesh.getNormals().resize(num_point);
-	
-	for (int i = 0; i < num_point; i++)
+
+	static void set(P &p, const ofFloatColor &c)
 	{
-		PointNormalType &p = cloud->points[i];
-		mesh.setNormal(i, ofVec3f(-p.normal_x, -p.normal_y, -p.normal_z));
-		mesh.setVertex(i, ofVec3f(p.x, p.y, p.z));
+		p.r = c.r * 255;
+		p.g = c.g * 255;
+		p.b = c.b * 255;
 	}
-}	
 
-template <>
-inline void convert(const ColorNormalPointCloud& cloud, ofMesh& mesh)
+	static void set(P &p, const ofColor &c)
+	{
+		p.r = c.r;
+		p.g = c.g;
+		p.b = c.b;
+	}
+};
+
+// normals keep pcl's sign for every point type
+template <typename P, bool enabled = PointFields<P>::has_normal>
+struct NormalField
+{
+	static void get(const P &p, ofVec3f *normals, int i) {}
+	static void set(P &p, const ofVec3f &n) {}
+};
+
+template <typename P>
+struct NormalField<P, true>
+{
+	static void get(const P &p, ofVec3f *normals, int i) { normals[i].set(p.normal_x, p.normal_y, p.normal_z); }
+	static void set(P &p, const ofVec3f &n) { p.normal_x = n.x; p.normal_y = n.y; p.normal_z = n.z; }
+};
+
+// ofMesh has no curvature, points made from a mesh get 0
+template <typename P, bool enabled = PointFields<P>::has_curvature>
+struct CurvatureField
+{
+	static void reset(P &p) {}
+};
+
+template <typename P>
+struct CurvatureField<P, true>
+{
+	static void reset(P &p) { p.curvature = 0; }
+};
+
+//
+// mesh type conversion
+//
+
+template <class T1, class T2>
+void convert(const T1&, T2&);
+
+// fills the mesh channels the point type has, the others are left as they
+// were
+template <typename P>
+inline void convert(const boost::shared_ptr<pcl::PointCloud<P> > &cloud, ofMesh &mesh)
 {
 	assert(cloud);
-	
-	float inv_byte = 1. / 255.;
+
+	typedef PointFields<P> Fields;
+
 	const size_t num_point = cloud->points.size();
-	
-	if (mesh.getNumVertices() != num_point) mesh.getVertices().resize(num_point);
-	if (mesh.getNumColors() != num_point) mesh.getColors().resize(num_point);
-	if (mesh.getNumNormals() != num_point) mesh.getNormals().resize(num_point);
 
-	for (int i = 0; i < num_point; i++)
-	{
-		ColorNormalPointType &p = cloud->points[i];
-		mesh.setNormal(i, ofVec3f(p.normal_x, p.normal_y, p.normal_z));
-		mesh.setColor(i, ofFloatColor(p.r * inv_byte, p.g * inv_byte, p.b * inv_byte));
-		mesh.setVertex(i, ofVec3f(p.x, p.y, p.z));
-	}
-}
+	if (Fields::has_xyz) mesh.getVertices().resize(num_point);
+	if (Fields::has_color) mesh.getColors().resize(num_point);
+	if (Fields::has_normal) mesh.getNormals().resize(num_point);
+
+	if (num_point == 0) return;
+
+	// the channels the type lacks stay NULL and are never touched
+	ofVec3f *vertices = Fields::has_xyz ? &mesh.getVertices()[0] : NULL;
+	ofFloatColor *colors = Fields::has_color ? &mesh.getColors()[0] : NULL;
+	ofVec3f *normals = Fields::has_normal ? &mesh.getNormals()[0] : NULL;
+
+	const P *points = &cloud->points[0];
 
-inline void convert(const vector<ofVec3f> &points, PointCloud& cloud)
-{
-	if (!cloud)
-		cloud = New<PointCloud>();
-	
-	const size_t num_point = points.size();
-	
-	cloud->width = num_point;
-	cloud->height = 1;
-	cloud->points.resize(cloud->width * cloud->height);
-	
-	if (points.empty()) return;
-	
 	for (int i = 0; i < num_point; i++)
 	{
-		PointType &p = cloud->points[i];
-		const ofVec3f &o = points[i];
-		p.x = o.x;
-		p.y = o.y;
-		p.z = o.z;
+		PositionField<P>::get(points[i], vertices, i);
+		ColorField<P>::get(points[i], colors, i);
+		NormalField<P>::get(points[i], normals, i);
 	}
 }
 
+// `colors` and `normals` are only used when they match `points` in size
+template <typename P, typename C>
 inline void convert(const vector<ofVec3f> &points,
-					const vector<ofFloatColor> &colors,
-					ColorPointCloud &cloud)
+					const vector<C> &colors,
+					const vector<ofVec3f> &normals,
+					boost::shared_ptr<pcl::PointCloud<P> > &cloud)
 {
 	if (!cloud)
-		cloud = New<ColorPointCloud>();
-	
+		cloud = New<boost::shared_ptr<pcl::PointCloud<P> > >();
+
 	const size_t num_point = points.size();
 
 	cloud->width = num_point;
@@ -139,131 +201,121 @@ inline void convert(const vector<ofVec3f> &points,
 	cloud->points.resize(cloud->width * cloud->height);
 
 	if (points.empty()) return;
-	if (colors.empty()) return;
-	
+
+	P *dst = &cloud->points[0];
+
 	for (int i = 0; i < num_point; i++)
 	{
-		ColorPointType &p = cloud->points[i];
-		const ofVec3f &o = points[i];
-		const ofFloatColor &c = colors[i];
-		p.x = o.x;
-		p.y = o.y;
-		p.z = o.z;
-		p.r = c.r * 255;
-		p.g = c.g * 255;
-		p.b = c.b * 255;
+		PositionField<P>::set(dst[i], points[i]);
+		CurvatureField<P>::reset(dst[i]);
 	}
-}
 
-inline void convert(const vector<ofVec3f> &points,
-					const vector<ofColor> &colors,
-					ColorPointCloud &cloud)
-{
-	if (!cloud)
-		cloud = New<ColorPointCloud>();
-	
-	const size_t num_point = points.size();
-
-	cloud->width = num_point;
-	cloud->height = 1;
-	cloud->points.resize(cloud->width * cloud->height);
+	if (colors.size() == num_point)
+	{
+		for (int i = 0; i < num_point; i++)
+			ColorField<P>::set(dst[i], colors[i]);
+	}
 
-	if (points.empty()) return;
-	if (colors.empty()) return;
-	
-	for (int i = 0; i < num_point; i++)
+	if (normals.size() == num_point)
 	{
-		ColorPointType &p = cloud->points[i];
-		const ofVec3f &o = points[i];
-		const ofColor &c = colors[i];
-		p.x = o.x;
-		p.y = o.y;
-		p.z = o.z;
-		p.r = c.r;
-		p.g = c.g;
-		p.b = c.b;
+		for (int i = 0; i < num_point; i++)
+			NormalField<P>::set(dst[i], normals[i]);
 	}
 }
 
+template <typename P, typename C>
 inline void convert(const vector<ofVec3f> &points,
-					const vector<ofFloatColor> &colors,
-					const vector<ofVec3f> &normals,
-					ColorNormalPointCloud &cloud)
+					const vector<C> &colors,
+					boost::shared_ptr<pcl::PointCloud<P> > &cloud)
 {
-	if (!cloud)
-		cloud = New<ColorNormalPointCloud>();
-	
-	const size_t num_point = points.size();
+	convert(points, colors, vector<ofVec3f>(), cloud);
+}
 
-	cloud->width = num_point;
-	cloud->height = 1;
-	cloud->points.resize(cloud->width * cloud->height);
+template <typename P>
+inline void convert(const vector<ofVec3f> &points, boost::shared_ptr<pcl::PointCloud<P> > &cloud)
+{
+	convert(points, vector<ofFloatColor>(), vector<ofVec3f>(), cloud);
+}
 
-	if (points.empty()) return;
-	if (colors.empty()) return;
-	if (normals.empty()) return;
-	
-	for (int i = 0; i < num_point; i++)
+//
+// depth camera
+//
+// pinhole intrinsics of a depth camera, in pixels of its depth image, with
+// brown-conrady distortion (k1, k2, k3 radial, p1, p2 tangential, zero for
+// none). the default is the kinect reference the depth conversions have
+// always used.
+//
+struct CameraIntrinsics
+{
+	int width, height;
+	float fx, fy, cx, cy;
+	float k1, k2, k3, p1, p2;
+
+	CameraIntrinsics()
+		: width(640), height(480)
+		, fx(1. / (0.104200 * (1. / 120.0) * 2.)), fy(fx)
+		, cx(640 / 2), cy(480 / 2)
+		, k1(0), k2(0), k3(0), p1(0), p2(0) {}
+
+	CameraIntrinsics(int width, int height, float fx, float fy, float cx, float cy)
+		: width(width), height(height), fx(fx), fy(fy), cx(cx), cy(cy)
+		, k1(0), k2(0), k3(0), p1(0), p2(0) {}
+
+	void setDistortion(float k1, float k2, float p1, float p2, float k3 = 0)
 	{
-		ColorNormalPointType &p = cloud->points[i];
-		const ofVec3f &o = points[i];
-		const ofFloatColor &c = colors[i];
-		const ofVec3f &n = normals[i];
-		p.x = o.x;
-		p.y = o.y;
-		p.z = o.z;
-		p.r = c.r * 255;
-		p.g = c.g * 255;
-		p.b = c.b * 255;
-		p.normal_x = n.x;
-		p.normal_y = n.y;
-		p.normal_z = n.z;
+		this->k1 = k1;
+		this->k2 = k2;
+		this->k3 = k3;
+		this->p1 = p1;
+		this->p2 = p2;
 	}
-}
 
-inline void convert(const vector<ofVec3f> &points,
-					const vector<ofColor> &colors,
-					const vector<ofVec3f> &normals,
-					ColorNormalPointCloud &cloud)
-{
-	if (!cloud)
-		cloud = New<ColorNormalPointCloud>();
-	
-	const size_t num_point = points.size();
+	bool hasDistortion() const { return k1 != 0 || k2 != 0 || k3 != 0 || p1 != 0 || p2 != 0; }
 
-	cloud->width = num_point;
-	cloud->height = 1;
-	cloud->points.resize(cloud->width * cloud->height);
+	// normalized image coordinates, undistorted to distorted
+	void distort(float &x, float &y) const
+	{
+		const float xx = x * x, yy = y * y, xy = x * y;
+		const float r2 = xx + yy;
+		const float radial = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
 
-	if (points.empty()) return;
-	if (colors.empty()) return;
-	if (normals.empty()) return;
+		const float dx = x * radial + 2 * p1 * xy + p2 * (r2 + 2 * xx);
+		const float dy = y * radial + p1 * (r2 + 2 * yy) + 2 * p2 * xy;
 
-	for (int i = 0; i < num_point; i++)
+		x = dx;
+		y = dy;
+	}
+
+	// the inverse, by fixed point iteration like opencv's undistortPoints
+	void undistort(float &x, float &y, int iterations = 10) const
 	{
-		ColorNormalPointType &p = cloud->points[i];
-		const ofVec3f &o = points[i];
-		const ofColor &c = colors[i];
-		const ofVec3f &n = normals[i];
-		p.x = o.x;
-		p.y = o.y;
-		p.z = o.z;
-		p.r = c.r;
-		p.g = c.g;
-		p.b = c.b;
-		p.normal_x = n.x;
-		p.normal_y = n.y;
-		p.normal_z = n.z;
+		const float x0 = x, y0 = y;
+
+		for (int i = 0; i < iterations; i++)
+		{
+			const float xx = x * x, yy = y * y, xy = x * y;
+			const float r2 = xx + yy;
+			const float inv_radial = 1. / (1 + r2 * (k1 + r2 * (k2 + r2 * k3)));
+
+			x = (x0 - 2 * p1 * xy - p2 * (r2 + 2 * xx)) * inv_radial;
+			y = (y0 - p1 * (r2 + 2 * yy) - 2 * p2 * xy) * inv_radial;
+		}
 	}
-}
+};
 
-inline void convert(const ofPixels& color, const ofShortPixels& depth, ColorPointCloud &cloud, const int skip = 1)
+// `depth` in millimeters, `color` registered to it. invalid pixels become
+// nan points so the cloud stays organized. the distortion is ignored here,
+// a DepthLookup applies it
+inline void convert(const ofPixels& color, const ofShortPixels& depth, ColorPointCloud &cloud, const CameraIntrinsics &intrinsics, const int skip = 1)
 {
 	if (!cloud)
 		cloud = New<ColorPointCloud>();
 	
-	cloud->width = color.getWidth() / skip;
-	cloud->height = color.getHeight() / skip;
+	const int width = depth.getWidth();
+	const int height = depth.getHeight();
+
+	cloud->width = width / skip;
+	cloud->height = height / skip;
 	cloud->is_dense = false;
 	
 	cloud->sensor_origin_.setZero();
@@ -275,26 +327,26 @@ inline void convert(const ofPixels& color, const ofShortPixels& depth, ColorPoin
 	cloud->resize(cloud->width * cloud->height);
 	
 	const int bytesParPixel = color.getBytesPerPixel();
-	const int centerX = 640 / 2;
-	const int centerY = 480 / 2;
+	const bool has_color = color.isAllocated();
 	
-	const float ref_pix_size = 0.104200;
-	const float ref_distance = 1. / 120.0;
-	const float factor_base = ref_pix_size * ref_distance * 2.f;
+	const float inv_fx = 1. / intrinsics.fx;
+	const float inv_fy = 1. / intrinsics.fy;
 	
 	unsigned int depth_idx = 0;
 	
 	float bad_point = std::numeric_limits<float>::quiet_NaN();
 	
-	for (int y = 0; y < 480; y += skip)
+	for (int gy = 0; gy < cloud->height; gy++)
 	{
-		const unsigned short *depth_ptr = depth.getPixels() + 640 * y;
-		const unsigned char *color_ptr = color.getPixels() + 640 * y * bytesParPixel;
+		const int y = gy * skip;
+		const unsigned short *depth_ptr = depth.getPixels() + width * y;
+		const unsigned char *color_ptr = has_color ? color.getPixels() + width * y * bytesParPixel : NULL;
+		const float row_factor = (y - intrinsics.cy) * inv_fy;
 		
-		for (register int x = 0; x < 640; x += skip)
+		for (int gx = 0; gx < cloud->width; gx++)
 		{
-			const unsigned short d = *depth_ptr;
-			const unsigned char *c = color_ptr;
+			const int x = gx * skip;
+			const unsigned short d = depth_ptr[x];
 			ColorPointType &pp = cloud->points[depth_idx];
 			
 			if (d == 0)
@@ -303,71 +355,119 @@ inline void convert(const ofPixels& color, const ofShortPixels& depth, ColorPoin
 			}
 			else
 			{
-				// centimeter to meter
+				// millimeter to meter
 				pp.z = d * 0.001;
-				const float factor = factor_base * pp.z;
 				
-				pp.x = (x - centerX) * factor;
-				pp.y = (y - centerY) * factor;
+				pp.x = (x - intrinsics.cx) * inv_fx * pp.z;
+				pp.y = row_factor * pp.z;
 			}
 			
-			pp.r = c[0];
-			pp.g = c[1];
-			pp.b = c[2];
-			
-			depth_ptr += skip;
-			color_ptr += skip * bytesParPixel;
+			if (has_color)
+			{
+				const unsigned char *c = color_ptr + x * bytesParPixel;
+				pp.r = c[0];
+				pp.g = c[1];
+				pp.b = c[2];
+			}
+			else
+			{
+				pp.r = pp.g = pp.b = 255;
+			}
 			
 			depth_idx++;
 		}
 	}
 }
+
+inline void convert(const ofPixels& color, const ofShortPixels& depth, ColorPointCloud &cloud, const int skip = 1)
+{
+	convert(color, depth, cloud, CameraIntrinsics(), skip);
+}
 	
 void convert(const ofPixels& color, const ofShortPixels& depth, ColorNormalPointCloud &cloud, const int skip = 1);
 	
-template <>
-inline void convert(const ofMesh& mesh, PointCloud& cloud)
+template <typename P>
+inline void convert(const ofMesh& mesh, boost::shared_ptr<pcl::PointCloud<P> >& cloud)
 {
 	ofMesh &m = const_cast<ofMesh&>(mesh);
-	convert(m.getVertices(), cloud);
+	convert(m.getVertices(), m.getColors(), m.getNormals(), cloud);
 }
 
+// polygons are fan triangulated, colors and normals are kept when the blob
+// has those fields
 template <>
-inline void convert(const ofMesh& mesh, ColorPointCloud& cloud)
+inline void convert(const pcl::PolygonMesh& polygon_mesh, ofMesh& mesh)
 {
-	ofMesh &m = const_cast<ofMesh&>(mesh);
-	convert(m.getVertices(), m.getColors(), cloud);
-}
+	const sensor_msgs::PointCloud2 &blob = polygon_mesh.cloud;
 
-template <>
-inline void convert(const ofMesh& mesh, ColorNormalPointCloud& cloud)
-{
-	ofMesh &m = const_cast<ofMesh&>(mesh);
-	convert(m.getVertices(), m.getColors(), m.getNormals(), cloud);
-}
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
 
-inline ofMesh toOF(const PointCloud cloud)
-{
-	ofMesh mesh;
-	convert(cloud, mesh);
-	return mesh;
-}
-	
-inline ofMesh toOF(const PointNormalPointCloud cloud)
-{
-	ofMesh mesh;
-	convert(cloud, mesh);
-	return mesh;
+	if (pcl::getFieldIndex(blob, "normal_x") >= 0 && pcl::getFieldIndex(blob, "rgb") >= 0)
+	{
+		ColorNormalPointCloud cloud = New<ColorNormalPointCloud>();
+		pcl::fromROSMsg(blob, *cloud);
+		convert(cloud, mesh);
+	}
+	else if (pcl::getFieldIndex(blob, "rgb") >= 0)
+	{
+		ColorPointCloud cloud = New<ColorPointCloud>();
+		pcl::fromROSMsg(blob, *cloud);
+		convert(cloud, mesh);
+	}
+	else if (pcl::getFieldIndex(blob, "normal_x") >= 0)
+	{
+		PointNormalPointCloud cloud = New<PointNormalPointCloud>();
+		pcl::fromROSMsg(blob, *cloud);
+		convert(cloud, mesh);
+	}
+	else
+	{
+		PointCloud cloud = New<PointCloud>();
+		pcl::fromROSMsg(blob, *cloud);
+		convert(cloud, mesh);
+	}
+
+	for (int i = 0; i < polygon_mesh.polygons.size(); i++)
+	{
+		const vector<uint32_t> &v = polygon_mesh.polygons[i].vertices;
+		for (int k = 1; k + 1 < v.size(); k++)
+		{
+			mesh.addIndex(v[0]);
+			mesh.addIndex(v[k]);
+			mesh.addIndex(v[k + 1]);
+		}
+	}
 }
 
-inline ofMesh toOF(const ColorPointCloud cloud)
+// area weighted vertex normals of an indexed triangle mesh
+inline void computeNormals(ofMesh &mesh)
 {
-	ofMesh mesh;
-	convert(cloud, mesh);
-	return mesh;
+	const vector<ofVec3f> &vertices = mesh.getVertices();
+	const vector<ofIndexType> &indices = mesh.getIndices();
+	vector<ofVec3f> &normals = mesh.getNormals();
+
+	normals.assign(vertices.size(), ofVec3f(0, 0, 0));
+
+	for (int i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const ofVec3f &a = vertices[indices[i]];
+		const ofVec3f &b = vertices[indices[i + 1]];
+		const ofVec3f &c = vertices[indices[i + 2]];
+
+		const ofVec3f n = (b - a).getCrossed(c - a);
+
+		normals[indices[i]] += n;
+		normals[indices[i + 1]] += n;
+		normals[indices[i + 2]] += n;
+	}
+
+	for (int i = 0; i < normals.size(); i++)
+		normals[i].normalize();
 }
 
-inline ofMesh toOF(const ColorNormalPointCloud cloud)
+template <typename P>
+inline ofMesh toOF(const boost::shared_ptr<pcl::PointCloud<P> > &cloud)
 {
 	ofMesh mesh;
 	convert(cloud, mesh);
@@ -376,64 +476,45 @@ inline ofMesh toOF(const ColorNormalPointCloud cloud)
 
 inline PointCloud toPCL(const vector<ofVec3f> &points)
 {
-	PointCloud cloud(new PointCloud::value_type);
+	PointCloud cloud = New<PointCloud>();
 	convert(points, cloud);
 	return cloud;
 }
 
 inline ColorPointCloud toPCL(const vector<ofVec3f> &points, const vector<ofFloatColor> &colors)
 {
-	ColorPointCloud cloud(new ColorPointCloud::value_type);
+	ColorPointCloud cloud = New<ColorPointCloud>();
 	convert(points, colors, cloud);
 	return cloud;
 }
 
 inline ColorPointCloud toPCL(const vector<ofVec3f> &points, const vector<ofColor> &colors)
 {
-	ColorPointCloud cloud(new ColorPointCloud::value_type);
+	ColorPointCloud cloud = New<ColorPointCloud>();
 	convert(points, colors, cloud);
 	return cloud;
 }
 
 inline ColorNormalPointCloud toPCL(const vector<ofVec3f> &points, const vector<ofFloatColor> &colors, const vector<ofVec3f> &normals)
 {
-	ColorNormalPointCloud cloud(new ColorNormalPointCloud::value_type);
+	ColorNormalPointCloud cloud = New<ColorNormalPointCloud>();
 	convert(points, colors, normals, cloud);
 	return cloud;
 }
 
 inline ColorNormalPointCloud toPCL(const vector<ofVec3f> &points, const vector<ofColor> &colors, const vector<ofVec3f> &normals)
 {
-	ColorNormalPointCloud cloud(new ColorNormalPointCloud::value_type);
+	ColorNormalPointCloud cloud = New<ColorNormalPointCloud>();
 	convert(points, colors, normals, cloud);
 	return cloud;
 }
 
 template <class T>
-T toPCL(const ofMesh &mesh);
-
-template <>
-inline PointCloud toPCL(const ofMesh &mesh)
-{
-	PointCloud cloud(new PointCloud::value_type);
-	convert(mesh, cloud);
-	return cloud;
-}
-
-template <>
-inline ColorPointCloud toPCL(const ofMesh &mesh)
+inline T toPCL(const ofMesh &mesh)
 {
-	ColorPointCloud cloud(new ColorPointCloud::value_type);
+	T cloud = New<T>();
 	convert(mesh, cloud);
 	return cloud;
 }
 
-template <>
-inline ColorNormalPointCloud toPCL(const ofMesh &mesh)
-{
-	ColorNormalPointCloud cloud(new ColorNormalPointCloud::value_type);
-	convert(mesh, cloud);
-	return cloud;
 }
-
-}
\ No newline at end of file
@@ -5,54 +5,103 @@ using namespace pcl;
 namespace ofxPCL
 {
 
-ofMesh organizedFastMesh(const ofPixels& colorImage, const ofShortPixels& depthImage, const int skip)
+OrganizedMesher::OrganizedMesher()
+	: triangle_pixel_size(1)
+	, triangulation_type(pcl::OrganizedFastMesh<ColorPointType>::TRIANGLE_RIGHT_CUT)
 {
-	ColorPointCloud temp = New<ColorPointCloud>();
-	
-	convert(colorImage, depthImage, temp, skip);
-	
-	pcl::OrganizedFastMesh<ColorPointType> ofm;
-	ofm.setTrianglePixelSize(1);
-	ofm.setTriangulationType(pcl::OrganizedFastMesh<ColorPointType>::TRIANGLE_RIGHT_CUT);
-	ofm.setInputCloud(temp);
-	
-	boost::shared_ptr<std::vector<pcl::Vertices> > verts(new std::vector<pcl::Vertices>);
-	ofm.reconstruct(*verts);
-	
-	NormalPointCloud normals = New<NormalPointCloud>();
-	integralImageNormalEstimation(temp, normals);
-		   
-	ofMesh mesh;
-	
-	for (int i = 0; i < verts->size(); i++)
+	cloud = New<ColorPointCloud>();
+	normals = New<NormalPointCloud>();
+}
+
+void OrganizedMesher::setTrianglePixelSize(int size)
+{
+	triangle_pixel_size = std::max(1, size);
+}
+
+void OrganizedMesher::setTriangulationType(TriangulationType type)
+{
+	triangulation_type = type;
+}
+
+void OrganizedMesher::update(const ofPixels& colorImage, const ofShortPixels& depthImage, ofMesh &mesh, const int skip)
+{
+	convert(colorImage, depthImage, cloud, skip);
+
+	ofm.setTrianglePixelSize(triangle_pixel_size);
+	ofm.setTriangulationType(triangulation_type);
+	ofm.setInputCloud(cloud);
+	ofm.reconstruct(polygons);
+
+	integralImageNormalEstimation(cloud, normals);
+
+	// grid index -> vertex index, -1 for points no triangle uses
+	const size_t num_point = cloud->points.size();
+	remap.assign(num_point, -1);
+
+	int num_vertices = 0;
+	int num_triangles = 0;
+
+	for (int i = 0; i < polygons.size(); i++)
+	{
+		const pcl::Vertices &v = polygons[i];
+		if (v.vertices.size() != 3) continue;
+
+		for (int k = 0; k < 3; k++)
+		{
+			int &index = remap[v.vertices[k]];
+			if (index < 0) index = num_vertices++;
+		}
+
+		num_triangles++;
+	}
+
+	vector<ofVec3f> &vertices = mesh.getVertices();
+	vector<ofFloatColor> &colors = mesh.getColors();
+	vector<ofVec3f> &mesh_normals = mesh.getNormals();
+	vector<ofIndexType> &indices = mesh.getIndices();
+
+	// resize() keeps the capacity of the previous frame
+	vertices.resize(num_vertices);
+	colors.resize(num_vertices);
+	mesh_normals.resize(num_vertices);
+	indices.resize(num_triangles * 3);
+
+	const float inv_byte = 1. / 255.;
+
+	for (int i = 0; i < num_point; i++)
+	{
+		const int index = remap[i];
+		if (index < 0) continue;
+
+		const ColorPointType &p = cloud->points[i];
+		const NormalType &n = normals->points[i];
+
+		vertices[index].set(p.x, p.y, p.z);
+		colors[index].set(p.r * inv_byte, p.g * inv_byte, p.b * inv_byte);
+		mesh_normals[index].set(-n.normal_x, -n.normal_y, -n.normal_z);
+	}
+
+	int k = 0;
+	for (int i = 0; i < polygons.size(); i++)
 	{
-		const pcl::Vertices &v = verts->at(i);
-		
+		const pcl::Vertices &v = polygons[i];
 		if (v.vertices.size() != 3) continue;
-		
-		const ColorPointType &p1 = temp->points[v.vertices[0]];
-		const ColorPointType &p2 = temp->points[v.vertices[1]];
-		const ColorPointType &p3 = temp->points[v.vertices[2]];
-		
-		const NormalType &n1 = normals->points[v.vertices[0]];
-		const NormalType &n2 = normals->points[v.vertices[1]];
-		const NormalType &n3 = normals->points[v.vertices[2]];
-		
-		mesh.addColor(ofColor(p1.r, p1.g, p1.b));
-		mesh.addColor(ofColor(p2.r, p2.g, p2.b));
-		mesh.addColor(ofColor(p3.r, p3.g, p3.b));
-		
-		mesh.addNormal(ofVec3f(-n1.normal_x, -n1.normal_y, -n1.normal_z));
-		mesh.addNormal(ofVec3f(-n2.normal_x, -n2.normal_y, -n2.normal_z));
-		mesh.addNormal(ofVec3f(-n3.normal_x, -n3.normal_y, -n3.normal_z));
-		
-		mesh.addVertex(ofVec3f(p1.x, p1.y, p1.z));
-		mesh.addVertex(ofVec3f(p2.x, p2.y, p2.z));
-		mesh.addVertex(ofVec3f(p3.x, p3.y, p3.z));
+
+		indices[k++] = remap[v.vertices[0]];
+		indices[k++] = remap[v.vertices[1]];
+		indices[k++] = remap[v.vertices[2]];
 	}
-	
+
 	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
-	
+}
+
+ofMesh organizedFastMesh(const ofPixels& colorImage, const ofShortPixels& depthImage, const int skip)
+{
+	OrganizedMesher mesher;
+
+	ofMesh mesh;
+	mesher.update(colorImage, depthImage, mesh, skip);
+
 	return mesh;
 }
 	
@@ -9,6 +9,17 @@
 #include "Types.h"
 #include "Utility.h"
 #include "Tree.h"
+#include "Parallel.h"
+#include "DepthMesher.h"
+#include "QuadtreeMesher.h"
+#include "SparseVolume.h"
+#include "TSDFVolume.h"
+#include "Odometry.h"
+#include "Decimation.h"
+#include "SoACloud.h"
+#include "DepthLookup.h"
+#include "DepthFilter.h"
+#include "MultiSensor.h"
 
 // file io
 #include <pcl/io/pcd_io.h>
@@ -33,14 +44,21 @@
 #include <pcl/ModelCoefficients.h>
 #include <pcl/segmentation/sac_segmentation.h>
 #include <pcl/sample_consensus/method_types.h>
+#include <pcl/sample_consensus/sac_model_plane.h>
+#include <pcl/sample_consensus/sac_model_line.h>
+#include <pcl/sample_consensus/sac_model_circle.h>
+#include <pcl/sample_consensus/sac_model_sphere.h>
 #include <pcl/filters/extract_indices.h>
 
 // triangulate
 #include <pcl/features/normal_3d.h>
 #include <pcl/surface/gp3.h>
-#include <pcl/surface/grid_projection.h>
 #include <pcl/Vertices.h>
 
+// poisson
+#include <pcl/surface/poisson.h>
+#include <pcl/pcl_config.h>
+
 // mls
 #include <pcl/surface/mls.h>
 #include <pcl/io/pcd_io.h>
@@ -57,7 +75,7 @@ namespace ofxPCL
 template <typename T>
 inline T loadPointCloud(string path)
 {
-	T cloud(new typename T::value_type);
+	T cloud = New<T>();
 	path = ofToDataPath(path);
 
 	if (pcl::io::loadPCDFile<typename T::value_type::PointType>(path.c_str(), *cloud) == -1)
@@ -80,6 +98,209 @@ inline void savePointCloud(string path, T cloud)
 //
 // transform
 //
+// the points are transformed in place as aligned 4 float vectors, which
+// eigen turns into sse / neon multiply-adds, and normals are rotated along
+// with them for the types that have some. many clouds can go through one
+// parallelFor, and a crop box can be applied in the same pass.
+//
+
+// the matrices of one transform. normals get the inverse transpose, which
+// is the rotation itself unless the matrix scales or shears
+struct PointTransform
+{
+	Eigen::Matrix<float, 4, 4, Eigen::DontAlign> points, normals;
+	bool renormalize;
+
+	PointTransform(const ofMatrix4x4 &matrix)
+	{
+		points = toEigen(matrix);
+
+		const Eigen::Matrix3f r = points.topLeftCorner<3, 3>();
+		const Eigen::Matrix3f n = r.inverse().transpose();
+
+		normals.setZero();
+		normals.topLeftCorner<3, 3>() = n;
+
+		renormalize = !(n - r).isZero(1e-5);
+	}
+};
+
+template <typename P, bool enabled = PointFields<P>::has_normal>
+struct NormalTransform
+{
+	static void apply(P &p, const Eigen::Matrix4f &m, bool renormalize) {}
+};
+
+template <typename P>
+struct NormalTransform<P, true>
+{
+	static void apply(P &p, const Eigen::Matrix4f &m, bool renormalize)
+	{
+		Eigen::Vector4f n = p.getNormalVector4fMap();
+		n = m * n;
+		if (renormalize) n.normalize();
+		p.getNormalVector4fMap() = n;
+	}
+};
+
+struct TransformCrop
+{
+	ofVec3f min, max;
+
+	// outside points become nan instead of being removed
+	bool keep_organized;
+};
+
+template <typename P>
+class TransformKernel
+{
+public:
+
+	struct Range
+	{
+		pcl::PointCloud<P> *cloud;
+		int transform;
+		int begin, end;
+
+		// points left at the front of the range after cropping
+		int kept;
+	};
+
+	TransformKernel(vector<Range> &ranges, const vector<PointTransform> &transforms, const TransformCrop *crop)
+		: ranges(ranges), transforms(transforms), crop(crop) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			run(ranges[i]);
+	}
+
+protected:
+
+	vector<Range> &ranges;
+	const vector<PointTransform> &transforms;
+	const TransformCrop *crop;
+
+	void run(Range &range)
+	{
+		const PointTransform &t = transforms[range.transform];
+		const Eigen::Matrix4f m = t.points;
+		const Eigen::Matrix4f nm = t.normals;
+		const bool renormalize = t.renormalize;
+
+		P *points = &range.cloud->points[0];
+
+		if (!crop)
+		{
+			for (int i = range.begin; i < range.end; i++)
+				apply(points[i], m, nm, renormalize);
+
+			range.kept = range.end - range.begin;
+			return;
+		}
+
+		const Eigen::Vector3f min(crop->min.x, crop->min.y, crop->min.z);
+		const Eigen::Vector3f max(crop->max.x, crop->max.y, crop->max.z);
+		const float bad_point = std::numeric_limits<float>::quiet_NaN();
+
+		int k = range.begin;
+
+		for (int i = range.begin; i < range.end; i++)
+		{
+			P &p = points[i];
+			apply(p, m, nm, renormalize);
+
+			// nan fails both comparisons and is cropped as well
+			const Eigen::Vector3f v = p.getVector3fMap();
+			const bool inside = (v.array() >= min.array()).all() && (v.array() <= max.array()).all();
+
+			if (crop->keep_organized)
+			{
+				if (!inside) p.x = p.y = p.z = bad_point;
+			}
+			else if (inside)
+			{
+				if (k != i) points[k] = p;
+				k++;
+			}
+		}
+
+		range.kept = crop->keep_organized ? range.end - range.begin : k - range.begin;
+	}
+
+	static void apply(P &p, const Eigen::Matrix4f &m, const Eigen::Matrix4f &nm, bool renormalize)
+	{
+		p.data[3] = 1;
+		p.getVector4fMap() = m * p.getVector4fMap();
+		NormalTransform<P>::apply(p, nm, renormalize);
+	}
+};
+
+// transforms `clouds[i]` by `transforms[i]`, cropped to `crop` if it isn't
+// NULL
+template <typename P>
+void transform(const vector<pcl::PointCloud<P>*> &clouds, const vector<PointTransform> &transforms, const TransformCrop *crop = NULL)
+{
+	assert(clouds.size() == transforms.size());
+
+	// points per range, small enough that a few clouds still spread over
+	// all threads
+	const int grain = 16384;
+
+	typedef typename TransformKernel<P>::Range Range;
+	vector<Range> ranges;
+
+	for (int i = 0; i < clouds.size(); i++)
+	{
+		const int n = clouds[i]->points.size();
+
+		for (int begin = 0; begin < n; begin += grain)
+		{
+			Range range;
+			range.cloud = clouds[i];
+			range.transform = i;
+			range.begin = begin;
+			range.end = std::min(n, begin + grain);
+			range.kept = 0;
+			ranges.push_back(range);
+		}
+	}
+
+	TransformKernel<P> kernel(ranges, transforms, crop);
+	parallelFor(0, ranges.size(), kernel);
+
+	if (!crop) return;
+
+	if (crop->keep_organized)
+	{
+		for (int i = 0; i < clouds.size(); i++)
+			clouds[i]->is_dense = false;
+
+		return;
+	}
+
+	// close the gaps the ranges left, in order
+	int r = 0;
+	for (int i = 0; i < clouds.size(); i++)
+	{
+		pcl::PointCloud<P> &cloud = *clouds[i];
+		int size = 0;
+
+		for (; r < ranges.size() && ranges[r].cloud == clouds[i]; r++)
+		{
+			const Range &range = ranges[r];
+			if (size != range.begin)
+				std::copy(cloud.points.begin() + range.begin, cloud.points.begin() + range.begin + range.kept, cloud.points.begin() + size);
+			size += range.kept;
+		}
+
+		cloud.points.resize(size);
+		cloud.width = size;
+		cloud.height = 1;
+		cloud.is_dense = true;
+	}
+}
+
 template <typename T>
 void transform(T cloud, ofMatrix4x4 matrix)
 {
@@ -87,9 +308,68 @@ void transform(T cloud, ofMatrix4x4 matrix)
 	
 	if (cloud->points.empty()) return;
 
-	Eigen::Matrix4f mat;
-	memcpy(&mat, matrix.getPtr(), sizeof(float) * 16);
-	pcl::transformPointCloud(*cloud, *cloud, mat);
+	vector<typename T::value_type*> clouds(1, cloud.get());
+	transform(clouds, vector<PointTransform>(1, PointTransform(matrix)));
+}
+
+// transforms, then keeps the points inside [crop_min, crop_max]
+template <typename T>
+void transform(T cloud, const ofMatrix4x4 &matrix, const ofVec3f &crop_min, const ofVec3f &crop_max, bool keep_organized = false)
+{
+	assert(cloud);
+
+	if (cloud->points.empty()) return;
+
+	TransformCrop crop;
+	crop.min = crop_min;
+	crop.max = crop_max;
+	crop.keep_organized = keep_organized;
+
+	vector<typename T::value_type*> clouds(1, cloud.get());
+	transform(clouds, vector<PointTransform>(1, PointTransform(matrix)), &crop);
+}
+
+// one matrix per cloud, e.g. the extrinsics of several sensors, all in one
+// parallel pass
+template <typename T>
+void transform(const vector<T> &clouds, const vector<ofMatrix4x4> &matrices)
+{
+	assert(clouds.size() == matrices.size());
+
+	vector<typename T::value_type*> ptrs;
+	vector<PointTransform> transforms;
+
+	for (int i = 0; i < clouds.size(); i++)
+	{
+		assert(clouds[i]);
+		ptrs.push_back(clouds[i].get());
+		transforms.push_back(PointTransform(matrices[i]));
+	}
+
+	transform(ptrs, transforms);
+}
+
+template <typename T>
+void transform(const vector<T> &clouds, const vector<ofMatrix4x4> &matrices, const ofVec3f &crop_min, const ofVec3f &crop_max, bool keep_organized = false)
+{
+	assert(clouds.size() == matrices.size());
+
+	TransformCrop crop;
+	crop.min = crop_min;
+	crop.max = crop_max;
+	crop.keep_organized = keep_organized;
+
+	vector<typename T::value_type*> ptrs;
+	vector<PointTransform> transforms;
+
+	for (int i = 0; i < clouds.size(); i++)
+	{
+		assert(clouds[i]);
+		ptrs.push_back(clouds[i].get());
+		transforms.push_back(PointTransform(matrices[i]));
+	}
+
+	transform(ptrs, transforms, &crop);
 }
 
 //
@@ -159,61 +439,222 @@ inline void radiusOutlierRemoval(T cloud, double radius, int num_min_points)
 //
 // segmentation
 //
+struct SegmentationParams
+{
+	pcl::SacModel model_type;
+	float distance_threshold;
+	int min_points_limit;
+	int max_segment_count;
+
+	// per model, fewer are drawn once the inlier ratio shows that enough
+	// samples were tried
+	int max_iterations;
+	float probability;
+
+	SegmentationParams(const pcl::SacModel model_type = pcl::SACMODEL_PLANE, const float distance_threshold = 1, const int min_points_limit = 10, const int max_segment_count = 30)
+		: model_type(model_type)
+		, distance_threshold(distance_threshold)
+		, min_points_limit(min_points_limit)
+		, max_segment_count(max_segment_count)
+		, max_iterations(500)
+		, probability(0.99)
+	{}
+};
+
 template <typename T>
-inline vector<T> segmentation(T cloud, const pcl::SacModel model_type = pcl::SACMODEL_PLANE, const float distance_threshold = 1, const int min_points_limit = 10, const int max_segment_count = 30)
+struct SegmentationResult
 {
-	assert(cloud);
-	
-	if (cloud->points.empty()) return;
+	vector<T> segments;
 
-	pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients());
-	pcl::PointIndices::Ptr inliers(new pcl::PointIndices());
+	// the deadline expired before all models were searched, `segments` has
+	// the ones found until then
+	bool truncated;
 
-	pcl::SACSegmentation<typename T::value_type::PointType> seg;
-	seg.setOptimizeCoefficients(false);
+	float elapsed_ms;
+
+	SegmentationResult() : truncated(false), elapsed_ms(0) {}
+};
+
+template <typename P>
+typename pcl::SampleConsensusModel<P>::Ptr createSampleConsensusModel(const pcl::SacModel model_type, const typename pcl::PointCloud<P>::ConstPtr &cloud)
+{
+	typedef typename pcl::SampleConsensusModel<P>::Ptr Ptr;
+
+	switch (model_type)
+	{
+	case pcl::SACMODEL_PLANE: return Ptr(new pcl::SampleConsensusModelPlane<P>(cloud));
+	case pcl::SACMODEL_LINE: return Ptr(new pcl::SampleConsensusModelLine<P>(cloud));
+	case pcl::SACMODEL_CIRCLE2D: return Ptr(new pcl::SampleConsensusModelCircle2D<P>(cloud));
+	case pcl::SACMODEL_SPHERE: return Ptr(new pcl::SampleConsensusModelSphere<P>(cloud));
+	default: return Ptr();
+	}
+}
 
-	seg.setModelType(model_type);
+// the models createSampleConsensusModel() doesn't build go through pcl's
+// SACSegmentation as before, with the deadline only checked between models
+template <typename T>
+bool segmentationIndicesSAC(const T &cloud, vector<int> &remaining, const SegmentationParams &params, const Deadline &deadline,
+							vector<vector<int> > &segments)
+{
+	typedef typename T::value_type::PointType PointType;
+
+	pcl::SACSegmentation<PointType> seg;
+	seg.setOptimizeCoefficients(false);
+	seg.setModelType(params.model_type);
 	seg.setMethodType(pcl::SAC_RANSAC);
-	seg.setDistanceThreshold(distance_threshold);
-	seg.setMaxIterations(500);
+	seg.setDistanceThreshold(params.distance_threshold);
+	seg.setMaxIterations(params.max_iterations);
+	seg.setProbability(params.probability);
+	seg.setInputCloud(cloud);
 
-	T temp(new typename T::value_type(*cloud));
-	const size_t original_szie = temp->points.size();
+	const size_t original_size = remaining.size();
 
-	pcl::ExtractIndices<typename T::value_type::PointType> extract;
-	vector<T> result;
+	pcl::ModelCoefficients coefficients;
+	pcl::PointIndices inliers;
 
-	int segment_count = 0;
-	while (temp->size() > original_szie * 0.3)
+	while (remaining.size() > original_size * 0.3 && segments.size() < params.max_segment_count)
 	{
-		if (segment_count > max_segment_count) break;
-		segment_count++;
+		if (deadline.expired()) return true;
+
+		seg.setIndices(pcl::IndicesPtr(new vector<int>(remaining)));
+		seg.segment(inliers, coefficients);
+
+		if (inliers.indices.size() < params.min_points_limit) break;
+
+		vector<int> &segment = inliers.indices;
+		std::sort(segment.begin(), segment.end());
+		segments.push_back(segment);
+
+		vector<int> rest;
+		rest.reserve(remaining.size() - segment.size());
+		std::set_difference(remaining.begin(), remaining.end(), segment.begin(), segment.end(), std::back_inserter(rest));
+		remaining.swap(rest);
+	}
+
+	return false;
+}
 
-		seg.setInputCloud(temp);
-		seg.segment(*inliers, *coefficients);
+// ransac models one after another among the sorted `candidates`, each
+// one's inliers are removed before searching the next. the deadline is
+// checked between samples, and the best model of an interrupted search is
+// still kept. returns whether the deadline cut the search short.
+template <typename T>
+bool segmentationIndices(const T &cloud, const vector<int> &candidates, const SegmentationParams &params, const Deadline &deadline,
+						 vector<vector<int> > &segments)
+{
+	typedef typename T::value_type::PointType PointType;
+
+	segments.clear();
+
+	vector<int> remaining;
+	remaining.reserve(candidates.size());
+
+	for (int i = 0; i < candidates.size(); i++)
+		if (pcl_isfinite(cloud->points[candidates[i]].x)) remaining.push_back(candidates[i]);
+
+	typename pcl::SampleConsensusModel<PointType>::Ptr model = createSampleConsensusModel<PointType>(params.model_type, cloud);
+	if (!model)
+		return segmentationIndicesSAC(cloud, remaining, params, deadline, segments);
+
+	// the 30% stop is of the finite candidates, as in segmentationIndicesSAC()
+	const size_t original_size = remaining.size();
 
-		if (inliers->indices.size() < min_points_limit)
-			break;
+	vector<int> samples, inliers;
+	Eigen::VectorXf coefficients, best_coefficients;
 
-		T filterd_point_cloud(new typename T::value_type);
+	bool truncated = false;
 
-		extract.setInputCloud(temp);
-		extract.setIndices(inliers);
-		extract.setNegative(false);
-		extract.filter(*filterd_point_cloud);
+	while (remaining.size() > original_size * 0.3 && segments.size() < params.max_segment_count)
+	{
+		model->setIndices(remaining);
+
+		int best_count = 0;
+		int needed_iterations = params.max_iterations;
 
-		if (filterd_point_cloud->points.size() > 0)
+		for (int iteration = 0; iteration < needed_iterations; iteration++)
 		{
-			result.push_back(filterd_point_cloud);
+			if (deadline.expired())
+			{
+				truncated = true;
+				break;
+			}
+
+			// pcl sets the iterations to INT_MAX when there are too few
+			// points to sample from, and clears the samples when it found
+			// no valid ones. either way more tries won't help
+			int iterations = iteration;
+			model->getSamples(iterations, samples);
+			if (iterations == std::numeric_limits<int>::max() || samples.empty()) break;
+
+			if (!model->computeModelCoefficients(samples, coefficients)) continue;
+
+			const int count = model->countWithinDistance(coefficients, params.distance_threshold);
+			if (count <= best_count) continue;
+
+			best_count = count;
+			best_coefficients = coefficients;
+
+			const double w = (double)count / remaining.size();
+			const double p_no_outliers = std::min(1. - std::numeric_limits<double>::epsilon(), pow(w, (double)samples.size()));
+
+			if (p_no_outliers > std::numeric_limits<double>::epsilon())
+				needed_iterations = std::min<double>(params.max_iterations, log(1. - params.probability) / log(1. - p_no_outliers));
 		}
 
-		extract.setNegative(true);
-		extract.filter(*temp);
+		if (best_count == 0 || best_count < params.min_points_limit) break;
+
+		model->selectWithinDistance(best_coefficients, params.distance_threshold, inliers);
+		if (inliers.size() < params.min_points_limit) break;
+
+		// both sorted, remaining minus inliers
+		std::sort(inliers.begin(), inliers.end());
+		segments.push_back(inliers);
+
+		vector<int> rest;
+		rest.reserve(remaining.size() - inliers.size());
+		std::set_difference(remaining.begin(), remaining.end(), inliers.begin(), inliers.end(), std::back_inserter(rest));
+		remaining.swap(rest);
+
+		if (truncated) break;
+	}
+
+	return truncated;
+}
+
+template <typename T>
+SegmentationResult<T> segmentation(T cloud, const SegmentationParams &params, const Deadline &deadline = Deadline())
+{
+	assert(cloud);
+
+	Poco::Timestamp timer;
+	SegmentationResult<T> result;
+
+	if (cloud->points.empty()) return result;
+
+	vector<int> candidates(cloud->points.size());
+	for (int i = 0; i < candidates.size(); i++)
+		candidates[i] = i;
+
+	vector<vector<int> > segments;
+	result.truncated = segmentationIndices(cloud, candidates, params, deadline, segments);
+
+	for (int i = 0; i < segments.size(); i++)
+	{
+		T segment = New<T>();
+		pcl::copyPointCloud(*cloud, segments[i], *segment);
+		result.segments.push_back(segment);
 	}
 
+	result.elapsed_ms = timer.elapsed() * 0.001;
 	return result;
 }
 
+template <typename T>
+inline vector<T> segmentation(T cloud, const pcl::SacModel model_type = pcl::SACMODEL_PLANE, const float distance_threshold = 1, const int min_points_limit = 10, const int max_segment_count = 30)
+{
+	return segmentation(cloud, SegmentationParams(model_type, distance_threshold, min_points_limit, max_segment_count)).segments;
+}
+
 //
 // normal estimation
 //
@@ -228,7 +669,7 @@ inline void normalEstimation(const T1 &cloud, T2 &output_cloud_with_normals)
 	if (cloud->points.empty()) return;
 
 	pcl::NormalEstimation<typename T1::value_type::PointType, NormalType> n;
-	NormalPointCloud normals(new typename NormalPointCloud::value_type);
+	NormalPointCloud normals = New<NormalPointCloud>();
 
 	KdTree<typename T1::value_type::PointType> kdtree(cloud);
 
@@ -272,91 +713,868 @@ void movingLeastSquares(const T1 &cloud, T2 &output_cloud_with_normals, float se
 	mls.process(*output_cloud_with_normals);
 }
 
+struct MLSResult
+{
+	int num_processed;
+
+	// the deadline expired before every point was processed, the output
+	// only has the finished chunks
+	bool truncated;
+
+	float elapsed_ms;
+
+	MLSResult() : num_processed(0), truncated(false), elapsed_ms(0) {}
+};
+
+template <typename P>
+struct AxisLess
+{
+	const pcl::PointCloud<P> &cloud;
+	int axis;
+
+	AxisLess(const pcl::PointCloud<P> &cloud, int axis) : cloud(cloud), axis(axis) {}
+
+	bool operator()(int a, int b) const { return cloud.points[a].data[axis] < cloud.points[b].data[axis]; }
+};
+
+// the points are cut into slabs along the longest axis and every slab into
+// tiles along the second longest. `order` holds the point indices slab by
+// slab, each slab sorted along the second axis, and a tile is a range of it
+template <typename T1, typename T2>
+class MLSChunks
+{
+public:
+
+	typedef typename T1::value_type::PointType InputType;
+	typedef typename T2::value_type::PointType OutputType;
+
+	MLSChunks(const T1 &cloud, float search_radius, const vector<int> &order, int axis0, int axis1,
+			  const vector<int> &slab_begin, const vector<float> &slab_min, const vector<float> &slab_max,
+			  int tiles_per_slab, const Deadline &deadline, vector<T2> &outputs)
+		: cloud(cloud), search_radius(search_radius), order(order), axis0(axis0), axis1(axis1)
+		, slab_begin(slab_begin), slab_min(slab_min), slab_max(slab_max)
+		, tiles_per_slab(tiles_per_slab), deadline(deadline), outputs(outputs) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			if (deadline.expired()) return;
+
+			const int slab = i / tiles_per_slab;
+			const int tile = i % tiles_per_slab;
+
+			const int slab_size = slab_begin[slab + 1] - slab_begin[slab];
+			const int first = slab_begin[slab] + slab_size * tile / tiles_per_slab;
+			const int last = slab_begin[slab] + slab_size * (tile + 1) / tiles_per_slab;
+			if (first == last) continue;
+
+			// the tile's box, grown by the search radius
+			float min0 = std::numeric_limits<float>::max(), max0 = -min0;
+			for (int k = first; k < last; k++)
+			{
+				const float v = cloud->points[order[k]].data[axis0];
+				min0 = std::min(min0, v);
+				max0 = std::max(max0, v);
+			}
+
+			min0 -= search_radius;
+			max0 += search_radius;
+
+			const float min1 = cloud->points[order[first]].data[axis1] - search_radius;
+			const float max1 = cloud->points[order[last - 1]].data[axis1] + search_radius;
+
+			// the tile's own points come first, then the halo from every
+			// slab that reaches into the box
+			typename pcl::PointCloud<InputType>::Ptr input = New<typename pcl::PointCloud<InputType>::Ptr>();
+			input->points.reserve((last - first) * 2);
+
+			for (int k = first; k < last; k++)
+				input->points.push_back(cloud->points[order[k]]);
+
+			for (int s = 0; s + 1 < slab_begin.size(); s++)
+			{
+				if (slab_max[s] < min0 || slab_min[s] > max0) continue;
+
+				vector<int>::const_iterator it = std::lower_bound(order.begin() + slab_begin[s], order.begin() + slab_begin[s + 1], min1, AxisValueLess(*cloud, axis1));
+
+				for (; it != order.begin() + slab_begin[s + 1]; ++it)
+				{
+					const int k = it - order.begin();
+					const InputType &p = cloud->points[*it];
+
+					if (p.data[axis1] > max1) break;
+					if (k >= first && k < last) continue;
+					if (p.data[axis0] < min0 || p.data[axis0] > max0) continue;
+
+					input->points.push_back(p);
+				}
+			}
+
+			input->width = input->points.size();
+			input->height = 1;
+			input->is_dense = true;
+
+			pcl::IndicesPtr indices(new vector<int>(last - first));
+			for (int k = 0; k < indices->size(); k++)
+				(*indices)[k] = k;
+
+			// the tree only covers the tile and its halo
+			KdTree<InputType> kdtree;
+			pcl::MovingLeastSquares<InputType, OutputType> mls;
+
+			mls.setComputeNormals(true);
+			mls.setInputCloud(input);
+			mls.setIndices(indices);
+			mls.setPolynomialFit(true);
+			mls.setSearchMethod(kdtree.kdtree);
+			mls.setSearchRadius(search_radius);
+
+			T2 output = New<T2>();
+			mls.process(*output);
+
+			outputs[i] = output;
+		}
+	}
+
+protected:
+
+	struct AxisValueLess
+	{
+		const typename T1::value_type &cloud;
+		int axis;
+
+		AxisValueLess(const typename T1::value_type &cloud, int axis) : cloud(cloud), axis(axis) {}
+
+		bool operator()(int a, float v) const { return cloud.points[a].data[axis] < v; }
+	};
+
+	const T1 &cloud;
+	float search_radius;
+	const vector<int> &order;
+	int axis0, axis1;
+	const vector<int> &slab_begin;
+	const vector<float> &slab_min, &slab_max;
+	int tiles_per_slab;
+	const Deadline &deadline;
+	vector<T2> &outputs;
+};
+
+// anytime version, the points are smoothed in spatially compact chunks of
+// about `chunk_size` on the thread pool and no new chunk starts after the
+// deadline expired. every chunk only searches its own points and the ones
+// within the search radius around them, so the chunks together cost about
+// as much as one pass over the whole cloud. the output is in chunk order
+// and has no invalid points.
+template <typename T1, typename T2>
+MLSResult movingLeastSquares(const T1 &cloud, T2 &output_cloud_with_normals, float search_radius, const Deadline &deadline, int chunk_size = 4096)
+{
+	typedef typename T1::value_type::PointType InputType;
+
+	if (output_cloud_with_normals == NULL)
+		output_cloud_with_normals = New<T2>();
+
+	assert(cloud);
+
+	Poco::Timestamp timer;
+	MLSResult result;
+
+	output_cloud_with_normals->clear();
+
+	vector<int> order;
+	order.reserve(cloud->points.size());
+
+	for (int i = 0; i < cloud->points.size(); i++)
+	{
+		const InputType &p = cloud->points[i];
+		if (pcl_isfinite(p.x) && pcl_isfinite(p.y) && pcl_isfinite(p.z)) order.push_back(i);
+	}
+
+	if (order.empty()) return result;
+
+	const int n = order.size();
+
+	// the two longest axes
+	Eigen::Vector4f min_pt, max_pt;
+	pcl::getMinMax3D(*cloud, order, min_pt, max_pt);
+
+	const Eigen::Vector4f extent = max_pt - min_pt;
+
+	int axes[3] = {0, 1, 2};
+	if (extent[axes[1]] > extent[axes[0]]) std::swap(axes[0], axes[1]);
+	if (extent[axes[2]] > extent[axes[0]]) std::swap(axes[0], axes[2]);
+	if (extent[axes[2]] > extent[axes[1]]) std::swap(axes[1], axes[2]);
+
+	// close to square tiles
+	chunk_size = std::max(1, chunk_size);
+	const int num_chunks = (n + chunk_size - 1) / chunk_size;
+	const float aspect = extent[axes[1]] > 0 ? extent[axes[0]] / extent[axes[1]] : num_chunks;
+
+	const int num_slabs = ofClamp(sqrt(num_chunks * aspect) + 0.5, 1, num_chunks);
+	const int tiles_per_slab = (num_chunks + num_slabs - 1) / num_slabs;
+
+	std::sort(order.begin(), order.end(), AxisLess<InputType>(*cloud, axes[0]));
+
+	vector<int> slab_begin(num_slabs + 1);
+	vector<float> slab_min(num_slabs), slab_max(num_slabs);
+
+	for (int s = 0; s <= num_slabs; s++)
+		slab_begin[s] = (long long)n * s / num_slabs;
+
+	for (int s = 0; s < num_slabs; s++)
+	{
+		if (slab_begin[s] == slab_begin[s + 1])
+		{
+			slab_min[s] = std::numeric_limits<float>::max();
+			slab_max[s] = -std::numeric_limits<float>::max();
+			continue;
+		}
+
+		slab_min[s] = cloud->points[order[slab_begin[s]]].data[axes[0]];
+		slab_max[s] = cloud->points[order[slab_begin[s + 1] - 1]].data[axes[0]];
+
+		std::sort(order.begin() + slab_begin[s], order.begin() + slab_begin[s + 1], AxisLess<InputType>(*cloud, axes[1]));
+	}
+
+	const int num_tiles = num_slabs * tiles_per_slab;
+	vector<T2> outputs(num_tiles);
+
+	MLSChunks<T1, T2> chunks(cloud, search_radius, order, axes[0], axes[1], slab_begin, slab_min, slab_max, tiles_per_slab, deadline, outputs);
+	parallelFor(0, num_tiles, chunks, 1);
+
+	for (int i = 0; i < num_tiles; i++)
+	{
+		const int slab = i / tiles_per_slab;
+		const int slab_size = slab_begin[slab + 1] - slab_begin[slab];
+		const int tile = i % tiles_per_slab;
+		const int size = slab_size * (tile + 1) / tiles_per_slab - slab_size * tile / tiles_per_slab;
+
+		if (size == 0) continue;
+
+		if (!outputs[i])
+		{
+			result.truncated = true;
+			continue;
+		}
+
+		*output_cloud_with_normals += *outputs[i];
+		result.num_processed += size;
+	}
+
+	result.elapsed_ms = timer.elapsed() * 0.001;
+	return result;
+}
+
 //
 // triangulate
 //
+struct TriangulateParams
+{
+	// maximum distance between connected points (maximum edge length)
+	float search_radius;
+
+	float mu;
+	int max_nearest_neighbors;
+	float max_surface_angle;
+	float min_angle;
+	float max_angle;
+	bool normal_consistency;
+
+	// the cloud is cut into slabs along its longest axis and each slab is
+	// triangulated on its own thread. 1 runs the whole cloud at once.
+	int num_partitions;
+
+	TriangulateParams(float search_radius = 30)
+		: search_radius(search_radius)
+		, mu(2.5)
+		, max_nearest_neighbors(20)
+		, max_surface_angle(ofDegToRad(90))
+		, min_angle(ofDegToRad(10))
+		, max_angle(ofDegToRad(180))
+		, normal_consistency(false)
+		, num_partitions(1)
+	{}
+};
+
 template <typename T>
-ofMesh triangulate(const T &cloud_with_normals, float search_radius = 30)
+void triangulate(const T &cloud_with_normals, vector<ofIndexType> &indices, const TriangulateParams &params, const vector<int> *point_indices = NULL)
 {
-	assert(cloud_with_normals);
-	
-	ofMesh mesh;
-	
-	if (cloud_with_normals->points.empty()) return mesh;
-	
-	KdTree<typename T::value_type::PointType> kdtree(cloud_with_normals);
+	typedef typename T::value_type::PointType PointType;
+
+	indices.clear();
+
+	T input = cloud_with_normals;
+
+	if (point_indices)
+	{
+		input = New<T>();
+		pcl::copyPointCloud(*cloud_with_normals, *point_indices, *input);
+	}
+
+	if (input->points.empty()) return;
 
-	typename pcl::GreedyProjectionTriangulation<typename T::value_type::PointType> gp3;
-	pcl::PolygonMesh triangles;
+	KdTree<PointType> kdtree(input);
 
-	// Set the maximum distance between connected points (maximum edge length)
-	gp3.setSearchRadius(search_radius);
+	typename pcl::GreedyProjectionTriangulation<PointType> gp3;
+	std::vector<pcl::Vertices> polygons;
 
-	gp3.setMu(2.5);
-	gp3.setMaximumNearestNeighbors(20);
-	gp3.setMaximumSurfaceAngle(ofDegToRad(90));
-	gp3.setMinimumAngle(ofDegToRad(10));
-	gp3.setMaximumAngle(ofDegToRad(180));
-	gp3.setNormalConsistency(false);
+	gp3.setSearchRadius(params.search_radius);
 
-	gp3.setInputCloud(cloud_with_normals);
+	gp3.setMu(params.mu);
+	gp3.setMaximumNearestNeighbors(params.max_nearest_neighbors);
+	gp3.setMaximumSurfaceAngle(params.max_surface_angle);
+	gp3.setMinimumAngle(params.min_angle);
+	gp3.setMaximumAngle(params.max_angle);
+	gp3.setNormalConsistency(params.normal_consistency);
+
+	gp3.setInputCloud(input);
 	gp3.setSearchMethod(kdtree.kdtree);
-	gp3.reconstruct(triangles);
+	gp3.reconstruct(polygons);
+
+	indices.reserve(polygons.size() * 3);
+
+	for (int i = 0; i < polygons.size(); i++)
+	{
+		const pcl::Vertices &v = polygons[i];
+		if (v.vertices.size() != 3) continue;
+
+		for (int k = 0; k < 3; k++)
+			indices.push_back(point_indices ? (*point_indices)[v.vertices[k]] : v.vertices[k]);
+	}
+}
+
+template <typename T>
+class TriangulatePartition
+{
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	TriangulatePartition(const T &cloud, const TriangulateParams &params, int axis, const vector<float> &bounds, vector<vector<ofIndexType> > &indices)
+		: cloud(cloud), params(params), axis(axis), bounds(bounds), indices(indices) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const float lo = bounds[i];
+			const float hi = bounds[i + 1];
+
+			// slab plus a halo of one search radius on each side
+			vector<int> point_indices;
+			for (int k = 0; k < cloud->points.size(); k++)
+			{
+				const float v = cloud->points[k].data[axis];
+				if (v >= lo - params.search_radius && v < hi + params.search_radius)
+					point_indices.push_back(k);
+			}
+
+			vector<ofIndexType> triangles;
+			triangulate(cloud, triangles, params, &point_indices);
+
+			// keep the triangles whose centroid is inside the slab, the halo
+			// ones are owned by the neighbor
+			vector<ofIndexType> &result = indices[i];
+			result.clear();
+			result.reserve(triangles.size());
+
+			for (int k = 0; k + 2 < triangles.size(); k += 3)
+			{
+				const float c = (cloud->points[triangles[k]].data[axis]
+								 + cloud->points[triangles[k + 1]].data[axis]
+								 + cloud->points[triangles[k + 2]].data[axis]) / 3;
+
+				if (c < lo || c >= hi) continue;
+
+				result.push_back(triangles[k]);
+				result.push_back(triangles[k + 1]);
+				result.push_back(triangles[k + 2]);
+			}
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	const TriangulateParams &params;
+	int axis;
+	const vector<float> &bounds;
+	vector<vector<ofIndexType> > &indices;
+};
+
+class IndexBufferCopy
+{
+public:
+
+	IndexBufferCopy(const vector<vector<ofIndexType> > &src, const vector<size_t> &offsets, vector<ofIndexType> &dst)
+		: src(src), offsets(offsets), dst(dst) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			if (src[i].empty()) continue;
+			memcpy(&dst[offsets[i]], &src[i][0], sizeof(ofIndexType) * src[i].size());
+		}
+	}
+
+protected:
+
+	const vector<vector<ofIndexType> > &src;
+	const vector<size_t> &offsets;
+	vector<ofIndexType> &dst;
+};
+
+template <typename T>
+void triangulate(const T &cloud_with_normals, ofMesh &mesh, const TriangulateParams &params)
+{
+	assert(cloud_with_normals);
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+	if (cloud_with_normals->points.empty()) return;
 
 	convert(cloud_with_normals, mesh);
 
-	for (int i = 0; i < triangles.polygons.size(); i++)
+	vector<ofIndexType> &indices = mesh.getIndices();
+
+	const int num_partitions = std::max(1, params.num_partitions);
+	if (num_partitions == 1)
+	{
+		triangulate(cloud_with_normals, indices, params);
+		return;
+	}
+
+	// partition along the longest axis with roughly equal point counts
+	Eigen::Vector4f min_pt, max_pt;
+	pcl::getMinMax3D(*cloud_with_normals, min_pt, max_pt);
+
+	int axis = 0;
+	const Eigen::Vector4f extent = max_pt - min_pt;
+	if (extent[1] > extent[axis]) axis = 1;
+	if (extent[2] > extent[axis]) axis = 2;
+
+	vector<float> values;
+	values.reserve(cloud_with_normals->points.size());
+	for (int i = 0; i < cloud_with_normals->points.size(); i++)
 	{
-		pcl::Vertices &v = triangles.polygons[i];
+		const float v = cloud_with_normals->points[i].data[axis];
+		if (pcl_isfinite(v)) values.push_back(v);
+	}
+
+	if (values.empty()) return;
+
+	vector<float> bounds(num_partitions + 1);
+	bounds.front() = -std::numeric_limits<float>::max();
+	bounds.back() = std::numeric_limits<float>::max();
 
-		if (v.vertices.size() == 3)
-			mesh.addTriangle(v.vertices[0], v.vertices[1], v.vertices[2]);
+	for (int i = 1; i < num_partitions; i++)
+	{
+		vector<float>::iterator nth = values.begin() + values.size() * i / num_partitions;
+		std::nth_element(values.begin(), nth, values.end());
+		bounds[i] = *nth;
 	}
 
+	vector<vector<ofIndexType> > partitions(num_partitions);
+
+	TriangulatePartition<T> partition(cloud_with_normals, params, axis, bounds, partitions);
+	parallelFor(0, num_partitions, partition);
+
+	// write every partition straight into its slice of the index buffer
+	vector<size_t> offsets(num_partitions, 0);
+	size_t num_indices = 0;
+	for (int i = 0; i < num_partitions; i++)
+	{
+		offsets[i] = num_indices;
+		num_indices += partitions[i].size();
+	}
+
+	indices.resize(num_indices);
+
+	IndexBufferCopy copy(partitions, offsets, indices);
+	parallelFor(0, num_partitions, copy);
+}
+
+template <typename T>
+ofMesh triangulate(const T &cloud_with_normals, float search_radius = 30)
+{
+	ofMesh mesh;
+	triangulate(cloud_with_normals, mesh, TriangulateParams(search_radius));
 	return mesh;
 }
 
 //
-// GridProjection # dosen't work...?
+// marching cubes
 //
+struct MarchingCubesParams
+{
+	// voxel size
+	float resolution;
+
+	// voxels around each point that get a signed distance
+	int truncation;
+
+	// nearest points averaged into each distance
+	int num_neighbors;
+
+	MarchingCubesParams(float resolution = 1)
+		: resolution(resolution)
+		, truncation(3)
+		, num_neighbors(4)
+	{}
+};
+
+template <typename P>
+struct VoxelColor
+{
+	static const bool enabled = false;
+	static inline void set(SparseVolume::Voxel &v, const P &p) {}
+};
+
+template <>
+struct VoxelColor<ColorNormalPointType>
+{
+	static const bool enabled = true;
+	static inline void set(SparseVolume::Voxel &v, const ColorNormalPointType &p)
+	{
+		v.r = p.r;
+		v.g = p.g;
+		v.b = p.b;
+	}
+};
+
+// hoppe style signed distance, the normal weighted offset to the nearest points
 template <typename T>
-ofMesh gridProjection(const T &cloud_with_normals, float resolution = 1, int padding_size = 3)
+class SignedDistanceFill
 {
+public:
+
+	typedef typename T::value_type::PointType PointType;
+
+	SignedDistanceFill(const T &cloud, KdTree<PointType> &kdtree, SparseVolume &volume, const MarchingCubesParams &params)
+		: cloud(cloud), kdtree(kdtree), volume(volume), params(params) {}
+
+	void operator()(int begin, int end)
+	{
+		const int S = SparseVolume::BLOCK_SIZE;
+		const float res = params.resolution;
+		const float max_distance = params.truncation * res;
+		const float max_sq_distance = max_distance * max_distance;
+		const float smoothing = res * res;
+
+		vector<int> indices;
+		vector<float> sq_distances;
+		PointType query;
+
+		for (int i = begin; i < end; i++)
+		{
+			SparseVolume::Block &block = *volume.getBlocks()[i];
+			block.dirty = true;
+
+			for (int lz = 0; lz < S; lz++)
+			for (int ly = 0; ly < S; ly++)
+			for (int lx = 0; lx < S; lx++)
+			{
+				SparseVolume::Voxel &voxel = block.voxels[SparseVolume::voxelIndex(lx, ly, lz)];
+
+				query.x = (block.x * S + lx) * res;
+				query.y = (block.y * S + ly) * res;
+				query.z = (block.z * S + lz) * res;
+
+				const int n = kdtree.kdtree->nearestKSearch(query, params.num_neighbors, indices, sq_distances);
+
+				if (n == 0 || sq_distances[0] > max_sq_distance)
+				{
+					voxel.weight = 0;
+					continue;
+				}
+
+				float sdf = 0;
+				float weight = 0;
+
+				for (int k = 0; k < n; k++)
+				{
+					const PointType &p = cloud->points[indices[k]];
+					const float w = 1. / (sq_distances[k] + smoothing);
+
+					sdf += w * (p.normal_x * (query.x - p.x) + p.normal_y * (query.y - p.y) + p.normal_z * (query.z - p.z));
+					weight += w;
+				}
+
+				voxel.sdf = sdf / weight;
+				voxel.weight = 1;
+
+				VoxelColor<PointType>::set(voxel, cloud->points[indices[0]]);
+			}
+		}
+	}
+
+protected:
+
+	const T &cloud;
+	KdTree<PointType> &kdtree;
+	SparseVolume &volume;
+	const MarchingCubesParams &params;
+};
+
+template <typename T>
+void marchingCubes(const T &cloud_with_normals, ofMesh &mesh, const MarchingCubesParams &params)
+{
+	typedef typename T::value_type::PointType PointType;
+
+	assert(cloud_with_normals);
+
+	mesh.clear();
+
+	if (cloud_with_normals->points.empty()) return;
+
+	SparseVolume volume(params.resolution);
+	volume.setHasColor(VoxelColor<PointType>::enabled);
+
+	// allocate only the blocks within the truncation distance of a point
+	const float inv_resolution = 1. / params.resolution;
+	const int t = params.truncation;
+
+	for (int i = 0; i < cloud_with_normals->points.size(); i++)
+	{
+		const PointType &p = cloud_with_normals->points[i];
+		if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z)) continue;
+
+		const int gx = floorf(p.x * inv_resolution);
+		const int gy = floorf(p.y * inv_resolution);
+		const int gz = floorf(p.z * inv_resolution);
+
+		for (int bz = SparseVolume::blockCoord(gz - t); bz <= SparseVolume::blockCoord(gz + t + 1); bz++)
+		for (int by = SparseVolume::blockCoord(gy - t); by <= SparseVolume::blockCoord(gy + t + 1); by++)
+		for (int bx = SparseVolume::blockCoord(gx - t); bx <= SparseVolume::blockCoord(gx + t + 1); bx++)
+			volume.getBlock(bx, by, bz);
+	}
+
+	KdTree<PointType> kdtree(cloud_with_normals);
+
+	SignedDistanceFill<T> fill(cloud_with_normals, kdtree, volume, params);
+	parallelFor(0, volume.getNumBlocks(), fill);
+
+	volume.extract(mesh);
+}
+
+template <typename T>
+ofMesh marchingCubes(const T &cloud_with_normals, float resolution = 1, int truncation = 3)
+{
+	MarchingCubesParams params(resolution);
+	params.truncation = truncation;
+
 	ofMesh mesh;
+	marchingCubes(cloud_with_normals, mesh, params);
+	return mesh;
+}
 
-	if (cloud_with_normals->points.empty()) return mesh;
+//
+// GridProjection
+//
+// pcl::GridProjection allocates a dense grid over the whole bounding box,
+// this runs the sparse marching cubes above with the same parameters.
+//
+template <typename T>
+ofMesh gridProjection(const T &cloud_with_normals, float resolution = 1, int padding_size = 3)
+{
+	return marchingCubes(cloud_with_normals, resolution, padding_size);
+}
 
-	typename pcl::KdTreeFLANN<typename T::value_type::PointType>::Ptr tree(new pcl::KdTreeFLANN<typename T::value_type::PointType>);
-	tree->setInputCloud(cloud_with_normals);
+//
+// poisson
+//
+struct PoissonParams
+{
+	// octree depth, the mesh resolution doubles with every level
+	int depth;
 
-	pcl::GridProjection<typename T::value_type::PointType> gp;
-	pcl::PolygonMesh triangles;
+	// minimum number of points per octree node, raise it for noisy input
+	float samples_per_node;
 
-	gp.setResolution(resolution);
-	gp.setPaddingSize(padding_size);
-	gp.setNearestNeighborNum(30);
+	// ratio between the reconstruction cube and the bounding cube of the points
+	float scale;
 
-	// Get result
-	gp.setInputCloud(cloud_with_normals);
-	gp.setSearchMethod(tree);
-	gp.reconstruct(triangles);
+	// 0 uses getNumThreads(). pcl's poisson solver only runs on several
+	// threads from 1.8 on, before that only the copy into the mesh does
+	int num_threads;
 
-	convert(cloud_with_normals, mesh);
+	PoissonParams(int depth = 8)
+		: depth(depth)
+		, samples_per_node(1)
+		, scale(1.25)
+		, num_threads(0)
+	{}
+};
+
+template <typename PointType>
+class VertexCopy
+{
+public:
 
-	for (int i = 0; i < triangles.polygons.size(); i++)
+	VertexCopy(const pcl::PointCloud<PointType> &points, vector<ofVec3f> &vertices)
+		: points(points), vertices(vertices) {}
+
+	void operator()(int begin, int end)
 	{
-		pcl::Vertices &v = triangles.polygons[i];
+		for (int i = begin; i < end; i++)
+		{
+			const PointType &p = points.points[i];
+			vertices[i].set(p.x, p.y, p.z);
+		}
+	}
+
+protected:
 
-		if (v.vertices.size() == 4)
+	const pcl::PointCloud<PointType> &points;
+	vector<ofVec3f> &vertices;
+};
+
+// fans every polygon into triangles at its own offset of the index buffer
+class PolygonFan
+{
+public:
+
+	PolygonFan(const std::vector<pcl::Vertices> &polygons, const vector<size_t> &offsets, vector<ofIndexType> &indices)
+		: polygons(polygons), offsets(offsets), indices(indices) {}
+
+	void operator()(int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
 		{
-			mesh.addTriangle(v.vertices[0], v.vertices[1], v.vertices[2]);
-			mesh.addTriangle(v.vertices[2], v.vertices[3], v.vertices[0]);
+			const vector<uint32_t> &v = polygons[i].vertices;
+			size_t k = offsets[i];
+
+			for (int j = 2; j < v.size(); j++)
+			{
+				indices[k++] = v[0];
+				indices[k++] = v[j - 1];
+				indices[k++] = v[j];
+			}
 		}
 	}
 
+protected:
+
+	const std::vector<pcl::Vertices> &polygons;
+	const vector<size_t> &offsets;
+	vector<ofIndexType> &indices;
+};
+
+template <typename T>
+void poissonReconstruction(const T &cloud_with_normals, ofMesh &mesh, const PoissonParams &params)
+{
+	typedef typename T::value_type::PointType PointType;
+
+	assert(cloud_with_normals);
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+	if (cloud_with_normals->points.empty()) return;
+
+	pcl::Poisson<PointType> poisson;
+	poisson.setDepth(params.depth);
+	poisson.setSamplesPerNode(params.samples_per_node);
+	poisson.setScale(params.scale);
+
+	bool threads_supported = false;
+
+#ifdef PCL_VERSION_COMPARE
+#if PCL_VERSION_COMPARE(>=, 1, 8, 0)
+	poisson.setThreads(params.num_threads > 0 ? params.num_threads : getNumThreads());
+	threads_supported = true;
+#endif
+#endif
+
+	if (!threads_supported && params.num_threads > 1)
+		ofLogWarning("ofxPCL::poissonReconstruction") << "num_threads needs pcl 1.8, solving on one thread";
+
+	poisson.setInputCloud(cloud_with_normals);
+
+	// reconstruct into plain points and polygons, no PolygonMesh blob
+	pcl::PointCloud<PointType> points;
+	std::vector<pcl::Vertices> polygons;
+	poisson.reconstruct(points, polygons);
+
+	vector<ofVec3f> &vertices = mesh.getVertices();
+	vector<ofIndexType> &indices = mesh.getIndices();
+
+	vertices.resize(points.size());
+
+	VertexCopy<PointType> copy(points, vertices);
+	parallelFor(0, points.size(), copy, 4096);
+
+	// polygons are fanned into triangles
+	vector<size_t> offsets(polygons.size(), 0);
+	size_t num_indices = 0;
+	for (int i = 0; i < polygons.size(); i++)
+	{
+		offsets[i] = num_indices;
+		num_indices += std::max<int>(0, polygons[i].vertices.size() - 2) * 3;
+	}
+
+	indices.resize(num_indices);
+
+	PolygonFan fan(polygons, offsets, indices);
+	parallelFor(0, polygons.size(), fan, 4096);
+
+	// the output points carry no usable normals
+	computeNormals(mesh);
+}
+
+template <typename T>
+ofMesh poissonReconstruction(const T &cloud_with_normals, int depth = 8, float samples_per_node = 1, int num_threads = 0)
+{
+	PoissonParams params(depth);
+	params.samples_per_node = samples_per_node;
+	params.num_threads = num_threads;
+
+	ofMesh mesh;
+	poissonReconstruction(cloud_with_normals, mesh, params);
 	return mesh;
 }
 
+//
+// organized fast mesh
+//
+// writes every valid grid point once and builds a triangle index buffer.
+// keep one instance around and call update() every frame, the point
+// cloud, normals and mesh buffers are reused instead of reallocated.
+//
+class OrganizedMesher
+{
+public:
+
+	typedef pcl::OrganizedFastMesh<ColorPointType>::TriangulationType TriangulationType;
+
+	OrganizedMesher();
+
+	void setTrianglePixelSize(int size);
+	int getTrianglePixelSize() const { return triangle_pixel_size; }
+
+	void setTriangulationType(TriangulationType type);
+	TriangulationType getTriangulationType() const { return triangulation_type; }
+
+	void update(const ofPixels& colorImage, const ofShortPixels& depthImage, ofMesh &mesh, const int skip = 4);
+
+	const ColorPointCloud& getPointCloud() const { return cloud; }
+	const NormalPointCloud& getNormals() const { return normals; }
+
+protected:
+
+	int triangle_pixel_size;
+	TriangulationType triangulation_type;
+
+	pcl::OrganizedFastMesh<ColorPointType> ofm;
+
+	ColorPointCloud cloud;
+	NormalPointCloud normals;
+	std::vector<pcl::Vertices> polygons;
+	vector<int> remap;
+};
+
 ofMesh organizedFastMesh(const ofPixels& colorImage, const ofShortPixels& depthImage, const int skip = 4);
 
 template <typename T>
@@ -377,4 +1595,12 @@ void integralImageNormalEstimation(const T& cloud, NormalPointCloud& normals)
 	ne.compute(*normals);
 }
 	
-}
\ No newline at end of file
+}
+
+#include "Tiling.h"
+#include "CloudView.h"
+#include "Registration.h"
+#include "Features.h"
+#include "Keypoints.h"
+#include "GlobalRegistration.h"
+#include "Pipeline.h"